@@ -0,0 +1,267 @@
+/* Synthetic corpora generator for benchmarks.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "corpus.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Number of words of the vocabulary */
+#define VOCABULARY_SIZE 2048
+
+/* Maximum length of a generated line */
+#define MAX_LINE 512
+
+static const char *corpus_names[CORPUS_TYPES] = {
+  "text", "logs", "json", "random"
+};
+
+static const char *syllables[] = {
+  "a", "e", "i", "o", "u", "an", "ar", "be", "ca", "co", "de", "di", "en",
+  "er", "es", "fa", "ge", "ha", "in", "is", "la", "le", "li", "lo", "ma",
+  "me", "mo", "na", "ne", "no", "on", "or", "pa", "pe", "po", "ra", "re",
+  "ri", "ro", "sa", "se", "si", "ta", "te", "th", "ti", "to", "un", "ur",
+  "ve", "wa", "we"
+};
+
+static const char *levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN",
+                                "ERROR" };
+
+static const char *methods[] = { "GET", "GET", "GET", "POST", "PUT",
+                                 "DELETE" };
+
+static const char *events[] = { "click", "view", "scroll", "purchase",
+                                "login", "logout" };
+
+/**
+ * Generator status.
+ */
+typedef struct {
+  unsigned int state;
+  char words[VOCABULARY_SIZE][16];
+} corpus_status;
+
+/* ======================================================================== */
+/** 
+ * Generates a random number (xorshift32).
+ * @param status The generator status.
+ * @return A random number.
+ */
+static unsigned int _corpus_random(corpus_status *status) {
+  unsigned int x = status->state;
+  
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  status->state = x;
+  return x;
+}
+
+/* ======================================================================== */
+/** 
+ * Chooses a word of the vocabulary (the first words are much more
+ * frequent, like in natural languages).
+ * @param status The generator status.
+ * @return The word.
+ */
+static const char *_corpus_word(corpus_status *status) {
+  unsigned int r;
+  
+  // Approximation of a Zipf distribution
+  r = _corpus_random(status) % VOCABULARY_SIZE;
+  r = (r * r) / VOCABULARY_SIZE;
+  r = (r * r) / VOCABULARY_SIZE;
+  return status->words[r];
+}
+
+/* ======================================================================== */
+/** 
+ * Initializes the generator status.
+ * @param status The generator status.
+ * @param seed The random seed.
+ */
+static void _corpus_init(corpus_status *status, unsigned int seed) {
+  int i, j, n;
+  int nsyllables = sizeof(syllables) / sizeof(char *);
+  
+  status->state = (seed == 0) ? 0x12345678 : seed;
+  
+  for (i = 0; i < VOCABULARY_SIZE; i++) {
+    status->words[i][0] = '\0';
+    n = 1 + (_corpus_random(status) % 4);
+    for (j = 0; j < n; j++) {
+      strcat(status->words[i],
+             syllables[_corpus_random(status) % nsyllables]);
+    }
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Generates a line of text.
+ * @param status The generator status.
+ * @param line The destination line.
+ * @return The line length.
+ */
+static int _corpus_text_line(corpus_status *status, char *line) {
+  int l, n, i;
+  const char *w;
+  
+  l = 0;
+  n = 5 + (_corpus_random(status) % 15);
+  for (i = 0; i < n; i++) {
+    w = _corpus_word(status);
+    l += sprintf(line + l, "%s%s", (i == 0) ? "" : " ", w);
+    if (i == 0) {
+      line[0] = line[0] - 'a' + 'A';
+    }
+    else if (i < n - 1 && (_corpus_random(status) % 10) == 0) {
+      line[l++] = ',';
+    }
+  }
+  line[l++] = '.';
+  line[l++] = ((_corpus_random(status) % 4) == 0) ? '\n' : ' ';
+  
+  return l;
+}
+
+/* ======================================================================== */
+/** 
+ * Generates a log line.
+ * @param status The generator status.
+ * @param line The destination line.
+ * @param n The line number.
+ * @return The line length.
+ */
+static int _corpus_log_line(corpus_status *status, char *line, size_t n) {
+  unsigned int r = _corpus_random(status);
+  
+  return sprintf(line, "2022-05-%02u %02u:%02u:%02u.%03u %-5s [worker-%u] "
+                 "%s /api/v1/%s/%u status=%u latency=%ums\n",
+                 (unsigned) (1 + (n / 864000) % 28),
+                 (unsigned) ((n / 36000) % 24), (unsigned) ((n / 600) % 60),
+                 (unsigned) ((n / 10) % 60), (unsigned) ((n % 10) * 100
+                                                         + r % 100),
+                 levels[r % 6], (r >> 3) % 8, methods[(r >> 6) % 6],
+                 _corpus_word(status), _corpus_random(status) % 100000,
+                 ((r >> 9) % 10 == 0) ? 404 : 200, (r >> 12) % 500);
+}
+
+/* ======================================================================== */
+/** 
+ * Generates a JSON line.
+ * @param status The generator status.
+ * @param line The destination line.
+ * @param n The line number.
+ * @return The line length.
+ */
+static int _corpus_json_line(corpus_status *status, char *line, size_t n) {
+  unsigned int r = _corpus_random(status);
+  
+  return sprintf(line, "{\"id\":%lu,\"ts\":%lu,\"user\":\"%s%u\","
+                 "\"event\":\"%s\",\"tags\":[\"%s\",\"%s\"],"
+                 "\"value\":%u.%02u,\"ok\":%s}\n",
+                 (unsigned long) n, 1651363200000UL + n * 37,
+                 _corpus_word(status), r % 1000, events[(r >> 10) % 6],
+                 _corpus_word(status), _corpus_word(status),
+                 (r >> 13) % 1000, (r >> 3) % 100,
+                 ((r >> 20) % 8 == 0) ? "false" : "true");
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the type of a corpus from its name.
+ * @param name The corpus name (text, logs, json or random).
+ * @return The corpus type (or -1 if the name is unknown).
+ */
+int corpus_type(const char *name) {
+  int i;
+  
+  for (i = 0; i < CORPUS_TYPES; i++) {
+    if (strcmp(name, corpus_names[i]) == 0) {
+      return i;
+    }
+  }
+  
+  return -1;
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the name of a corpus type.
+ * @param type The corpus type.
+ * @return The corpus name.
+ */
+const char *corpus_name(int type) {
+  if (type < 0 || type >= CORPUS_TYPES) {
+    return "unknown";
+  }
+  
+  return corpus_names[type];
+}
+
+/* ======================================================================== */
+/** 
+ * Generates a synthetic corpus (the same seed always generates the
+ * same data).
+ * @param type The corpus type.
+ * @param dst The destination array.
+ * @param length The number of bytes to generate.
+ * @param seed The random seed.
+ */
+void corpus_generate(int type, unsigned char *dst, size_t length,
+                     unsigned int seed) {
+  corpus_status *status;
+  char line[MAX_LINE];
+  size_t i, n;
+  int l;
+  
+  status = (corpus_status *) malloc(sizeof(corpus_status));
+  if (status == NULL) {
+    memset(dst, 0, length);
+    return;
+  }
+  _corpus_init(status, seed);
+  
+  i = 0;
+  n = 0;
+  while (i < length) {
+    switch (type) {
+      case CORPUS_LOGS:
+        l = _corpus_log_line(status, line, n);
+        break;
+      case CORPUS_JSON:
+        l = _corpus_json_line(status, line, n);
+        break;
+      case CORPUS_RANDOM:
+        for (l = 0; l < MAX_LINE; l++) {
+          line[l] = (char) (_corpus_random(status) >> 24);
+        }
+        break;
+      default:
+        l = _corpus_text_line(status, line);
+        break;
+    }
+    
+    if (l > length - i) {
+      l = length - i;
+    }
+    memcpy(dst + i, line, l);
+    i += l;
+    n++;
+  }
+  
+  free(status);
+}
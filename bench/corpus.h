@@ -0,0 +1,53 @@
+/* Synthetic corpora generator for benchmarks.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdlib.h>
+
+/* Corpus types */
+#define CORPUS_TEXT   0  /* English like text. */
+#define CORPUS_LOGS   1  /* Application log lines. */
+#define CORPUS_JSON   2  /* JSON events (one per line). */
+#define CORPUS_RANDOM 3  /* Random bytes. */
+#define CORPUS_TYPES  4
+
+/** 
+ * Gets the type of a corpus from its name.
+ * @param name The corpus name (text, logs, json or random).
+ * @return The corpus type (or -1 if the name is unknown).
+ */
+int corpus_type(const char *name);
+
+/** 
+ * Gets the name of a corpus type.
+ * @param type The corpus type.
+ * @return The corpus name.
+ */
+const char *corpus_name(int type);
+
+/** 
+ * Generates a synthetic corpus (the same seed always generates the
+ * same data).
+ * @param type The corpus type.
+ * @param dst The destination array.
+ * @param length The number of bytes to generate.
+ * @param seed The random seed.
+ */
+void corpus_generate(int type, unsigned char *dst, size_t length,
+                     unsigned int seed);
+
+#endif
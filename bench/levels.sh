@@ -0,0 +1,79 @@
+#!/bin/sh
+# Compression levels benchmark.
+# -----------------------------
+# Compresses and decompresses a file with every compression level and
+# prints the compression ratio and the speed of each level as a markdown
+# table. Every level is run $RUNS times (3 by default) and the best times
+# are printed.
+#
+# Usage: [RUNS=<num>] bench/levels.sh <input_file> [srcomp_binary]
+#                                     [extra srcomp options]
+#
+# Copyright (C) 2022 Abraham Macias Paredes.
+#
+# This program is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published
+# by the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+if [ $# -lt 1 ]; then
+  echo "USAGE: $0 <input_file> [srcomp_binary] [extra srcomp options]"
+  exit 1
+fi
+
+INPUT=$1
+SRCOMP=${2:-src/srcomp}
+RUNS=${RUNS:-3}
+[ $# -ge 2 ] && shift 2 || shift 1
+
+TMP=${TMPDIR:-/tmp}/srcomp_levels.$$
+trap 'rm -f $TMP.srz $TMP.out' EXIT
+
+# Current time in seconds (with nanoseconds)
+now() {
+  date +%s.%N
+}
+
+SIZE=$(wc -c < "$INPUT")
+
+echo "| Level | Ratio | Compression (MB/s) | Decompression (MB/s) |"
+echo "|------:|------:|-------------------:|---------------------:|"
+
+# Shortest of two times (the first one can be empty)
+best() {
+  echo "$1 $2" | awk '{ print (NF == 2 && $1 < $2) ? $1 : $NF }'
+}
+
+for LEVEL in 1 2 3 4 5 6 7 8 9; do
+  CTIME=
+  DTIME=
+  RUN=0
+  while [ $RUN -lt $RUNS ]; do
+    T0=$(now)
+    "$SRCOMP" -c -$LEVEL "$@" -i "$INPUT" -o $TMP.srz || exit 1
+    T1=$(now)
+    "$SRCOMP" -d -i $TMP.srz -o $TMP.out || exit 1
+    T2=$(now)
+
+    if ! cmp -s "$INPUT" $TMP.out; then
+      echo "Level $LEVEL: the decompressed data is different!" >&2
+      exit 1
+    fi
+
+    CTIME=$(best "$CTIME" $(echo "$T0 $T1" | awk '{ print $2 - $1 }'))
+    DTIME=$(best "$DTIME" $(echo "$T1 $T2" | awk '{ print $2 - $1 }'))
+    RUN=$((RUN + 1))
+  done
+
+  CSIZE=$(wc -c < $TMP.srz)
+  echo "$LEVEL $SIZE $CSIZE $CTIME $DTIME" | awk '{
+    printf("| %5i | %5.2f%% | %18.1f | %20.1f |\n", $1, 100.0*$3/$2,
+           $2/1048576.0/$4, $2/1048576.0/$5);
+  }'
+done
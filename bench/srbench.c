@@ -0,0 +1,895 @@
+/* srbench. Benchmark of the srcomp compression stages.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "srz.h"
+#include "mtf.h"
+#include "bitm.h"
+#include "split2b.h"
+#include "wseparator.h"
+#include "corpus.h"
+
+#define DEFAULT_CORPUS_SIZE (16*1024*1024)
+#define DEFAULT_REPETITIONS 5
+#define MAX_BLOCK_SIZES 16
+#define MAX_INPUTS 16
+#define MAX_NAME 256
+
+/* Maximum increase of the compression ratio allowed by the baseline */
+#define RATIO_TOLERANCE 0.0005
+
+/* Output formats */
+#define FORMAT_TEXT 0
+#define FORMAT_CSV  1
+#define FORMAT_JSON 2
+
+/* Benchmarked stages */
+#define STAGE_SEPARATE_WORDS 0
+#define STAGE_SEPARATE_BYTES 1
+#define STAGE_MTF_CODE       2
+#define STAGE_EG_WRITE       3
+#define STAGE_EG_READ        4
+#define STAGE_MTF_DECODE     5
+#define STAGE_JOIN_BYTES     6
+#define STAGE_JOIN_WORDS     7
+#define STAGE_COMPRESS       8
+#define STAGE_DECOMPRESS     9
+#define STAGES               10
+
+static const char *stage_names[STAGES] = {
+  "separate_words", "separate_bytes", "mtf_code", "eg_write", "eg_read",
+  "mtf_decode", "join_bytes", "join_words", "compress_block",
+  "decompress_block"
+};
+
+/**
+ * Benchmark input data.
+ */
+typedef struct {
+  const char *name;
+  unsigned char *data;
+  size_t length;
+} bench_input;
+
+/**
+ * Benchmark results of a stage (one value per repetition).
+ */
+typedef struct {
+  double *seconds;
+  double *cycles;
+} bench_result;
+
+/**
+ * Result of a stage saved in a baseline file.
+ */
+typedef struct {
+  char input[MAX_NAME];
+  int block_size;
+  char stage[MAX_NAME];
+  double mbps;
+  double ratio;
+} bench_baseline;
+
+/**
+ * Buffers used by the benchmark of a block.
+ */
+typedef struct {
+  unsigned short *src;
+  unsigned short *words;
+  unsigned char *bytes;
+  unsigned char *ranks;
+  ELEMENT *eg;
+  size_t eg_length;
+  unsigned char *ranks2;
+  unsigned char *bytes2;
+  unsigned short *words2;
+  unsigned short *out;
+  unsigned char *compressed;
+  unsigned char *work;
+} bench_buffers;
+
+/* ======================================================================== */
+/** 
+ * Usage.
+ */
+void usage() {
+  fprintf(stdout, "USAGE: srbench [options]\n");
+  fprintf(stdout, " -h           print this message.\n");
+  fprintf(stdout, " -i <file>    benchmark a file (can be repeated).\n");
+  fprintf(stdout, " -c <corpus>  benchmark a synthetic corpus: text, logs,"
+          " json, random\n");
+  fprintf(stdout, "              or all (can be repeated, default all).\n");
+  fprintf(stdout, " -s <size>    size of the synthetic corpora (in kilobytes,"
+          " default %i).\n", DEFAULT_CORPUS_SIZE / 1024);
+  fprintf(stdout, " -b <size>    block size (in kilobytes, can be repeated,"
+          " default 1024).\n");
+  fprintf(stdout, " -r <num>     number of repetitions (default %i).\n",
+          DEFAULT_REPETITIONS);
+  fprintf(stdout, " -p           use previous data to compress more.\n");
+  fprintf(stdout, " -m <ctx>     context used to group the words: byte, word,"
+          " hash3 or hash4.\n");
+  fprintf(stdout, " -g <bits>    number of groups (in bits) of the hashed"
+          " contexts.\n");
+  fprintf(stdout, " -f <format>  output format: text (default), csv or"
+          " json.\n");
+  fprintf(stdout, " -o <file>    write the results into a file.\n");
+  fprintf(stdout, " -B <file>    compare the results with a baseline (a json"
+          " file written\n");
+  fprintf(stdout, "              by srbench) and fail if the compression"
+          " ratio is worse.\n");
+  fprintf(stdout, " -T <pct>     also fail if a stage is <pct> percent slower"
+          " than the\n");
+  fprintf(stdout, "              baseline (only for a baseline written on"
+          " the same machine).\n");
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the current time.
+ * @return The current time (in seconds).
+ */
+static double get_time() {
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the processor cycle counter.
+ * @return The cycle counter (0 if it is not available).
+ */
+static double get_cycles() {
+#ifdef HAVE_RDTSC
+  return (double) __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* ======================================================================== */
+/** 
+ * Compares two numbers (for qsort).
+ * @param a First number.
+ * @param b Second number.
+ * @return The comparison result.
+ */
+static int compare_doubles(const void *a, const void *b) {
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+  
+  return (da > db) - (da < db);
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates a percentile.
+ * @param values The values (they are sorted).
+ * @param n The number of values.
+ * @param p The percentile (0-100).
+ * @return The percentile value.
+ */
+static double percentile(double *values, int n, double p) {
+  int i;
+  
+  qsort(values, n, sizeof(double), compare_doubles);
+  i = (int) (p * n / 100.0 + 0.999999) - 1;
+  if (i < 0) {
+    i = 0;
+  }
+  if (i >= n) {
+    i = n - 1;
+  }
+  
+  return values[i];
+}
+
+/* ======================================================================== */
+/** 
+ * Reads a whole file.
+ * @param name The file name.
+ * @param input The input to fill.
+ * @return 0 if everything goes OK.
+ */
+static int read_file(const char *name, bench_input *input) {
+  FILE *f;
+  long length;
+  
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Error opening input file: %s ", name);
+    perror(":");
+    return -1;
+  }
+  
+  fseek(f, 0, SEEK_END);
+  length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  
+  input->name = name;
+  input->length = (length > 0) ? length : 0;
+  input->data = (unsigned char *) malloc(input->length + 1);
+  if (input->data == NULL
+      || fread(input->data, 1, input->length, f) != input->length) {
+    perror("Error reading input file");
+    fclose(f);
+    return -1;
+  }
+  
+  fclose(f);
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Reads a baseline file (the json output of srbench, one result per line).
+ * @param name The file name.
+ * @param count The number of results read.
+ * @return The results (or NULL in case of error).
+ */
+static bench_baseline *read_baseline(const char *name, int *count) {
+  bench_baseline *baseline, *tmp, b;
+  char line[1024], *start;
+  int size = 64;
+  FILE *f;
+  
+  f = fopen(name, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error opening baseline file: %s ", name);
+    perror(":");
+    return NULL;
+  }
+  
+  baseline = (bench_baseline *) malloc(size * sizeof(bench_baseline));
+  if (baseline == NULL) {
+    perror("Error allocating memory\n");
+    fclose(f);
+    return NULL;
+  }
+  
+  *count = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    start = strstr(line, "{\"input\"");
+    if (start == NULL) {
+      continue;
+    }
+    if (sscanf(start, "{\"input\": \"%255[^\"]\", \"block_size\": %d, "
+               "\"stage\": \"%255[^\"]\", \"bytes\": %*u, "
+               "\"repetitions\": %*d, \"mbps_best\": %lf, "
+               "\"mbps_p50\": %*f, \"mbps_p90\": %*f, \"mbps_p99\": %*f, "
+               "\"cycles_per_byte\": %*f, \"ratio\": %lf",
+               b.input, &b.block_size, b.stage, &b.mbps, &b.ratio) != 5) {
+      fprintf(stderr, "Wrong baseline result: %s", line);
+      free(baseline);
+      fclose(f);
+      return NULL;
+    }
+    
+    if (*count == size) {
+      size <<= 1;
+      tmp = (bench_baseline *) realloc(baseline,
+                                       size * sizeof(bench_baseline));
+      if (tmp == NULL) {
+        perror("Error allocating memory\n");
+        free(baseline);
+        fclose(f);
+        return NULL;
+      }
+      baseline = tmp;
+    }
+    baseline[(*count)++] = b;
+  }
+  
+  fclose(f);
+  return baseline;
+}
+
+/* ======================================================================== */
+/** 
+ * Compares the results of an input and block size with the baseline.
+ * @param baseline The baseline results.
+ * @param count The number of baseline results.
+ * @param input The input data.
+ * @param block_size The block size (in kilobytes).
+ * @param results The results of every stage.
+ * @param repetitions The number of repetitions.
+ * @param ratio The compression ratio.
+ * @param tolerance The allowed speed loss (percentage, or a negative value
+ *                  to compare only the compression ratio).
+ * @return The number of regressions found.
+ */
+static int check_baseline(bench_baseline *baseline, int count,
+                          bench_input *input, int block_size,
+                          bench_result *results, int repetitions,
+                          double ratio, double tolerance) {
+  double mbps;
+  int i, s, regressions = 0;
+  
+  // Keep the order of the messages
+  fflush(stdout);
+  
+  for (s = 0; s < STAGES; s++) {
+    for (i = 0; i < count; i++) {
+      if (baseline[i].block_size == block_size
+          && strcmp(baseline[i].input, input->name) == 0
+          && strcmp(baseline[i].stage, stage_names[s]) == 0) {
+        break;
+      }
+    }
+    if (i == count) {
+      fprintf(stderr, "WARNING: %s %iK %s is not in the baseline\n",
+              input->name, block_size, stage_names[s]);
+      continue;
+    }
+    
+    // The fastest repetition is the least affected by the system noise
+    mbps = (input->length / 1048576.0)
+           / percentile(results[s].seconds, repetitions, 0);
+    if (tolerance >= 0 && mbps < baseline[i].mbps * (1 - tolerance / 100)) {
+      fprintf(stderr, "REGRESSION: %s %iK %s: %.1f MB/s (baseline %.1f MB/s,"
+              " %.1f%%)\n", input->name, block_size, stage_names[s], mbps,
+              baseline[i].mbps, (mbps / baseline[i].mbps - 1) * 100);
+      regressions++;
+    }
+    
+    // The ratio is the same for every stage
+    if (s == 0 && ratio > baseline[i].ratio + RATIO_TOLERANCE) {
+      fprintf(stderr, "REGRESSION: %s %iK ratio: %.4f (baseline %.4f)\n",
+              input->name, block_size, ratio, baseline[i].ratio);
+      regressions++;
+    }
+  }
+  
+  return regressions;
+}
+
+/* ======================================================================== */
+/** 
+ * Allocates the buffers for a block size.
+ * @param b The buffers.
+ * @param bs The block size (in bytes).
+ * @return 0 if everything goes OK.
+ */
+static int alloc_buffers(bench_buffers *b, size_t bs) {
+  size_t l = bs >> 1;
+  
+  memset(b, 0, sizeof(bench_buffers));
+  // Worst case Elias-Gamma: 17 bits per byte
+  b->eg_length = (bs * 17) / BITS_PER_ELEMENT + 2;
+  
+  b->src = (unsigned short *) malloc(bs);
+  b->words = (unsigned short *) malloc(bs);
+  b->bytes = (unsigned char *) malloc(bs);
+  b->ranks = (unsigned char *) malloc(bs);
+  b->eg = (ELEMENT *) malloc(b->eg_length * sizeof(ELEMENT));
+  b->ranks2 = (unsigned char *) malloc(bs);
+  b->bytes2 = (unsigned char *) malloc(bs);
+  b->words2 = (unsigned short *) malloc(bs);
+  b->out = (unsigned short *) malloc(bs);
+  b->compressed = (unsigned char *) malloc(compress_block_bound(l));
+  b->work = (unsigned char *) malloc(compress_block_bound(l));
+  
+  if (b->src == NULL || b->words == NULL || b->bytes == NULL
+      || b->ranks == NULL || b->eg == NULL || b->ranks2 == NULL
+      || b->bytes2 == NULL || b->words2 == NULL || b->out == NULL
+      || b->compressed == NULL || b->work == NULL) {
+    perror("Error allocating memory\n");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the buffers.
+ * @param b The buffers.
+ */
+static void free_buffers(bench_buffers *b) {
+  free(b->src);
+  free(b->words);
+  free(b->bytes);
+  free(b->ranks);
+  free(b->eg);
+  free(b->ranks2);
+  free(b->bytes2);
+  free(b->words2);
+  free(b->out);
+  free(b->compressed);
+  free(b->work);
+}
+
+/* ======================================================================== */
+/** 
+ * Runs every stage over a block (one repetition).
+ * @param b The buffers (b->src contains the block).
+ * @param l The number of words of the block.
+ * @param params The compression parameters.
+ * @param ctx The word separator context.
+ * @param seconds Time spent in every stage (accumulated).
+ * @param cycles Cycles spent in every stage (accumulated).
+ * @param compressed Compressed length (accumulated).
+ * @return 0 if the block is restored correctly.
+ */
+static int bench_block(bench_buffers *b, size_t l, const srz_params *params,
+                       ws_context *ctx, double *seconds, double *cycles,
+                       size_t *compressed) {
+  bitm_array *bitma;
+  mtf_status status;
+  unsigned char last_byte;
+  size_t i, n, cl;
+  double t[STAGES + 1], c[STAGES + 1], dt, dc;
+  int s;
+
+  n = l << 1;
+  bitma = bitm_wrap(b->eg, b->eg_length);
+  if (bitma == NULL) {
+    return -1;
+  }
+  
+  t[0] = get_time(); c[0] = get_cycles();
+  separate_words(b->src, b->words, l, params->use_previous_byte, ctx);
+  t[1] = get_time(); c[1] = get_cycles();
+  separate_bytes(b->words, b->bytes, l, params->sorting_byte);
+  t[2] = get_time(); c[2] = get_cycles();
+  mtf_reset(&status);
+  mtf_code(b->bytes, b->ranks, n, &status);
+  t[3] = get_time(); c[3] = get_cycles();
+  bitm_reset(bitma);
+  for (i = 0; i < n; i++) {
+    bitm_write_eg(bitma, b->ranks[i] + 1);
+  }
+  bitm_flush(bitma);
+  t[4] = get_time(); c[4] = get_cycles();
+  bitm_reset(bitma);
+  for (i = 0; i < n; i++) {
+    b->ranks2[i] = (unsigned char) (bitm_read_eg(bitma) - 1);
+  }
+  t[5] = get_time(); c[5] = get_cycles();
+  mtf_reset(&status);
+  mtf_decode(b->ranks2, b->bytes2, n, &status);
+  t[6] = get_time(); c[6] = get_cycles();
+  join_bytes(b->bytes2, b->words2, ((unsigned char *) b->words)[n - 1], l,
+             params->sorting_byte);
+  t[7] = get_time(); c[7] = get_cycles();
+  join_words(b->words2, b->out, b->src[l - 1], l, params->use_previous_byte,
+             ctx);
+  t[8] = get_time(); c[8] = get_cycles();
+  
+  bitm_unwrap(bitma);
+  if (memcmp(b->src, b->out, n) != 0) {
+    fprintf(stderr, "The stages didn't restore the data!\n");
+    return -1;
+  }
+  
+  // Whole block (the data that can't be compressed is stored)
+  cl = compress_block(b->src, b->compressed, l, &last_byte, params);
+  t[9] = get_time(); c[9] = get_cycles();
+  dt = t[9];
+  dc = c[9];
+  if (cl == (size_t) -1) {
+    fprintf(stderr, "Error compressing data block!\n");
+    return -1;
+  }
+  if (cl != SRZ_NOT_COMPRESSED) {
+    // (The copy between compress_block and decompress_block isn't
+    // measured)
+    memcpy(b->work, b->compressed, cl);
+    dt = get_time(); dc = get_cycles();
+    if (decompress_block(b->work, b->out, b->src[l - 1], last_byte, l,
+                         params) != n) {
+      fprintf(stderr, "Error decompressing data block!\n");
+      return -1;
+    }
+  }
+  else {
+    cl = n;
+    memcpy(b->out, b->src, n);
+  }
+  t[10] = get_time(); c[10] = get_cycles();
+  
+  if (memcmp(b->src, b->out, n) != 0) {
+    fprintf(stderr, "The block wasn't decompressed correctly!\n");
+    return -1;
+  }
+  
+  for (s = 0; s < STAGES - 1; s++) {
+    seconds[s] += t[s + 1] - t[s];
+    cycles[s] += c[s + 1] - c[s];
+  }
+  seconds[STAGES - 1] += t[STAGES] - dt;
+  cycles[STAGES - 1] += c[STAGES] - dc;
+  *compressed += cl;
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Benchmarks an input with a block size.
+ * @param input The input data.
+ * @param block_size The block size (in kilobytes).
+ * @param params The compression parameters.
+ * @param repetitions The number of repetitions.
+ * @param results The results of every stage.
+ * @param ratio The compression ratio (compressed / original).
+ * @return 0 if everything goes OK.
+ */
+static int bench_input_data(bench_input *input, int block_size,
+                            const srz_params *params, int repetitions,
+                            bench_result *results, double *ratio) {
+  bench_buffers b;
+  ws_context *ctx;
+  size_t bs, offset, read, l, compressed;
+  double seconds[STAGES], cycles[STAGES];
+  int r, s;
+  
+  bs = (size_t) block_size * 1024;
+  if (alloc_buffers(&b, bs) != 0) {
+    free_buffers(&b);
+    return -1;
+  }
+  
+  ctx = ws_alloc(params->context_mode, params->context_bits);
+  if (ctx == NULL) {
+    fprintf(stderr, "Wrong context parameters!\n");
+    free_buffers(&b);
+    return -1;
+  }
+  
+  for (r = 0; r < repetitions; r++) {
+    memset(seconds, 0, sizeof(seconds));
+    memset(cycles, 0, sizeof(cycles));
+    compressed = 0;
+    
+    for (offset = 0; offset < input->length; offset += read) {
+      read = input->length - offset;
+      if (read > bs) {
+        read = bs;
+      }
+      memcpy(b.src, input->data + offset, read);
+      if ((read & 1) == 1) {
+        ((unsigned char *) b.src)[read] = 0;
+      }
+      l = (read + 1) >> 1;
+      
+      if (bench_block(&b, l, params, ctx, seconds, cycles,
+                      &compressed) != 0) {
+        ws_free(ctx);
+        free_buffers(&b);
+        return -1;
+      }
+    }
+    
+    for (s = 0; s < STAGES; s++) {
+      results[s].seconds[r] = seconds[s];
+      results[s].cycles[r] = cycles[s];
+    }
+    *ratio = (input->length > 0) ? (double) compressed / input->length : 0;
+  }
+  
+  ws_free(ctx);
+  free_buffers(&b);
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Prints the results of an input and block size.
+ * @param out The output file.
+ * @param format The output format.
+ * @param first This is the first result printed.
+ * @param input The input data.
+ * @param block_size The block size (in kilobytes).
+ * @param results The results of every stage.
+ * @param repetitions The number of repetitions.
+ * @param ratio The compression ratio.
+ */
+static void print_results(FILE *out, int format, bool first,
+                          bench_input *input, int block_size,
+                          bench_result *results, int repetitions,
+                          double ratio) {
+  double mb, best, p50, p90, p99, cpb;
+  int s;
+  
+  mb = input->length / 1048576.0;
+  for (s = 0; s < STAGES; s++) {
+    best = percentile(results[s].seconds, repetitions, 0);
+    p50 = percentile(results[s].seconds, repetitions, 50);
+    p90 = percentile(results[s].seconds, repetitions, 90);
+    p99 = percentile(results[s].seconds, repetitions, 99);
+    cpb = (input->length > 0) ?
+          percentile(results[s].cycles, repetitions, 50) / input->length : 0;
+    
+    switch (format) {
+      case FORMAT_CSV:
+        fprintf(out, "%s,%i,%s,%lu,%i,%.2f,%.2f,%.2f,%.2f,%.2f,%.4f\n",
+                input->name, block_size, stage_names[s],
+                (unsigned long) input->length, repetitions, mb / best,
+                mb / p50, mb / p90, mb / p99, cpb, ratio);
+        break;
+      case FORMAT_JSON:
+        fprintf(out, "%s    {\"input\": \"%s\", \"block_size\": %i, "
+                "\"stage\": \"%s\", \"bytes\": %lu, \"repetitions\": %i, "
+                "\"mbps_best\": %.2f, \"mbps_p50\": %.2f, \"mbps_p90\": %.2f, "
+                "\"mbps_p99\": %.2f, \"cycles_per_byte\": %.2f, "
+                "\"ratio\": %.4f}",
+                (first && s == 0) ? "" : ",\n", input->name, block_size,
+                stage_names[s], (unsigned long) input->length, repetitions,
+                mb / best, mb / p50, mb / p90, mb / p99, cpb, ratio);
+        break;
+      default:
+        fprintf(out, "%-16s %8iK %-17s %9.1f %9.1f %9.1f %8.2f %7.2f%%\n",
+                input->name, block_size, stage_names[s], mb / p50, mb / p90,
+                mb / p99, cpb, ratio * 100);
+        break;
+    }
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Main program.
+ * @param argc Number of arguments.
+ * @param argv Arguments.
+ * @return 0 if everything goes OK.
+ */
+int main(int argc, char *argv[]) {
+  bench_input inputs[MAX_INPUTS];
+  bench_result results[STAGES];
+  int block_sizes[MAX_BLOCK_SIZES];
+  int ninputs = 0, nblocks = 0, repetitions = DEFAULT_REPETITIONS;
+  int format = FORMAT_TEXT;
+  size_t corpus_size = DEFAULT_CORPUS_SIZE;
+  int corpora[CORPUS_TYPES];
+  int ncorpora = 0;
+  srz_params params;
+  FILE *out = stdout;
+  bench_baseline *baseline = NULL;
+  int nbaseline = 0, regressions = 0;
+  double tolerance = -1;
+  double ratio;
+  int opt, i, j, s, c, ret = 0;
+  
+  srz_default_params(&params);
+  
+  while ((opt = getopt(argc, argv, "hi:c:s:b:r:pm:g:f:o:B:T:")) != -1) {
+    switch (opt) {
+      case 'h':
+        usage();
+        return 0;
+      case 'i':
+        if (ninputs >= MAX_INPUTS) {
+          fprintf(stderr, "Too many inputs!\n");
+          return -1;
+        }
+        if (read_file(optarg, &inputs[ninputs]) != 0) {
+          return -1;
+        }
+        ninputs++;
+        break;
+      case 'c':
+        if (strcmp(optarg, "all") == 0) {
+          for (c = 0; c < CORPUS_TYPES; c++) {
+            corpora[c] = c;
+          }
+          ncorpora = CORPUS_TYPES;
+          break;
+        }
+        c = corpus_type(optarg);
+        if (c < 0) {
+          fprintf(stderr, "Unknown corpus: %s\n", optarg);
+          return -1;
+        }
+        if (ncorpora < CORPUS_TYPES) {
+          corpora[ncorpora++] = c;
+        }
+        break;
+      case 's':
+        corpus_size = (size_t) atoi(optarg) * 1024;
+        if (corpus_size == 0) {
+          fprintf(stderr, "Wrong corpus size: %s\n", optarg);
+          return -1;
+        }
+        break;
+      case 'b':
+        if (nblocks >= MAX_BLOCK_SIZES) {
+          fprintf(stderr, "Too many block sizes!\n");
+          return -1;
+        }
+        block_sizes[nblocks] = atoi(optarg);
+        if (block_sizes[nblocks] < 1 || block_sizes[nblocks] > 65536) {
+          fprintf(stderr, "Wrong block size: %s (must be between 1K and"
+                  " 65536K)\n", optarg);
+          return -1;
+        }
+        nblocks++;
+        break;
+      case 'r':
+        repetitions = atoi(optarg);
+        if (repetitions < 1) {
+          fprintf(stderr, "Wrong number of repetitions: %s\n", optarg);
+          return -1;
+        }
+        break;
+      case 'p':
+        params.use_previous_byte = true;
+        break;
+      case 'm':
+        if (strcmp(optarg, "byte") == 0) {
+          params.context_mode = WS_CONTEXT_BYTE;
+        }
+        else if (strcmp(optarg, "word") == 0) {
+          params.context_mode = WS_CONTEXT_WORD;
+        }
+        else if (strcmp(optarg, "hash3") == 0) {
+          params.context_mode = WS_CONTEXT_HASH3;
+        }
+        else if (strcmp(optarg, "hash4") == 0) {
+          params.context_mode = WS_CONTEXT_HASH4;
+        }
+        else {
+          fprintf(stderr, "Wrong context: %s\n", optarg);
+          return -1;
+        }
+        break;
+      case 'g':
+        params.context_bits = atoi(optarg);
+        break;
+      case 'f':
+        if (strcmp(optarg, "text") == 0) {
+          format = FORMAT_TEXT;
+        }
+        else if (strcmp(optarg, "csv") == 0) {
+          format = FORMAT_CSV;
+        }
+        else if (strcmp(optarg, "json") == 0) {
+          format = FORMAT_JSON;
+        }
+        else {
+          fprintf(stderr, "Wrong format: %s\n", optarg);
+          return -1;
+        }
+        break;
+      case 'o':
+        if ( (out = fopen(optarg, "w")) == NULL) {
+          fprintf(stderr, "Error opening output file: %s ", optarg);
+          perror(":");
+          return -1;
+        }
+        break;
+      case 'B':
+        baseline = read_baseline(optarg, &nbaseline);
+        if (baseline == NULL) {
+          return -1;
+        }
+        break;
+      case 'T':
+        tolerance = atof(optarg);
+        if (tolerance < 0 || tolerance >= 100) {
+          fprintf(stderr, "Wrong tolerance: %s\n", optarg);
+          return -1;
+        }
+        break;
+      default:
+        usage();
+        return -1;
+    }
+  }
+  
+  // Default inputs: every synthetic corpus
+  if (ninputs == 0 && ncorpora == 0) {
+    for (c = 0; c < CORPUS_TYPES; c++) {
+      corpora[c] = c;
+    }
+    ncorpora = CORPUS_TYPES;
+  }
+  
+  for (c = 0; c < ncorpora && ninputs < MAX_INPUTS; c++) {
+    inputs[ninputs].name = corpus_name(corpora[c]);
+    inputs[ninputs].length = corpus_size;
+    inputs[ninputs].data = (unsigned char *) malloc(corpus_size);
+    if (inputs[ninputs].data == NULL) {
+      perror("Error allocating memory\n");
+      return -1;
+    }
+    corpus_generate(corpora[c], inputs[ninputs].data, corpus_size, c + 1);
+    ninputs++;
+  }
+  
+  if (nblocks == 0) {
+    block_sizes[nblocks++] = 1024;
+  }
+  
+  for (s = 0; s < STAGES; s++) {
+    results[s].seconds = (double *) malloc(repetitions * sizeof(double));
+    results[s].cycles = (double *) malloc(repetitions * sizeof(double));
+    if (results[s].seconds == NULL || results[s].cycles == NULL) {
+      perror("Error allocating memory\n");
+      return -1;
+    }
+  }
+  
+  // Print the header
+  switch (format) {
+    case FORMAT_CSV:
+      fprintf(out, "input,block_size,stage,bytes,repetitions,mbps_best,mbps_p50,"
+              "mbps_p90,mbps_p99,cycles_per_byte,ratio\n");
+      break;
+    case FORMAT_JSON:
+      fprintf(out, "{\n  \"compiler\": \"%s\",\n  \"results\": [\n",
+              __VERSION__);
+      break;
+    default:
+      fprintf(out, "%-16s %9s %-17s %9s %9s %9s %8s %8s\n", "input", "block",
+              "stage", "MB/s p50", "MB/s p90", "MB/s p99", "cyc/B",
+              "ratio");
+      break;
+  }
+  
+  // Run the benchmarks (the percentiles of the speed are calculated from
+  // the slowest repetitions)
+  for (i = 0; i < ninputs && ret == 0; i++) {
+    for (j = 0; j < nblocks && ret == 0; j++) {
+      ret = bench_input_data(&inputs[i], block_sizes[j], &params,
+                             repetitions, results, &ratio);
+      if (ret == 0) {
+        print_results(out, format, (i == 0 && j == 0), &inputs[i],
+                      block_sizes[j], results, repetitions, ratio);
+        if (baseline != NULL) {
+          regressions += check_baseline(baseline, nbaseline, &inputs[i],
+                                        block_sizes[j], results, repetitions,
+                                        ratio, tolerance);
+        }
+      }
+    }
+  }
+  
+  if (format == FORMAT_JSON) {
+    fprintf(out, "\n  ]\n}\n");
+  }
+  
+  if (regressions > 0) {
+    fprintf(stderr, "%i regressions found!\n", regressions);
+    ret = 1;
+  }
+  
+  // Release resources
+  free(baseline);
+  for (s = 0; s < STAGES; s++) {
+    free(results[s].seconds);
+    free(results[s].cycles);
+  }
+  for (i = 0; i < ninputs; i++) {
+    free(inputs[i].data);
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  
+  return ret;
+}
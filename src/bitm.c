@@ -19,10 +19,32 @@
 
 #ifdef USE_FAST_EG
 #include "fast_eg.h"
+
+/* Number of precalculated Elias-Gamma codes */
+#define FAST_EG_NUMBERS 256
 #endif
 
 #include <stdio.h>
 
+/* Stores an element (the index is increased even if it doesn't fit, so the
+   needed length is known) */
+#define _BITM_STORE(arr, value) do { \
+    if ((arr)->index < (arr)->length) { \
+      (arr)->data[(arr)->index] = (value); \
+    } \
+    (arr)->index++; \
+  } while (0)
+
+/* Loads the next element to read (the bounds are only checked here, once
+   per element, so the corrupted data can't be read out of the array) */
+#define _BITM_LOAD(arr) do { \
+    if ((arr)->index >= (arr)->length) { \
+      return -1; \
+    } \
+    (arr)->current = (arr)->data[(arr)->index++]; \
+    (arr)->bit = BITS_PER_ELEMENT; \
+  } while (0)
+
 unsigned int mask[] = { 0x00000000,
   0x00000001, 0x00000003, 0x00000007, 0x0000000F,
   0x0000001F, 0x0000003F, 0x0000007F, 0x000000FF,
@@ -131,7 +153,7 @@ void bitm_flush(bitm_array *arr) {
     return;
   }
   
-  arr->data[arr->index++] = (arr->current << (BITS_PER_ELEMENT - arr->bit));
+  _BITM_STORE(arr, (arr->current << (BITS_PER_ELEMENT - arr->bit)));
   arr->current = 0;
   arr->bit = 0;
 }
@@ -178,11 +200,27 @@ size_t bitm_get_index(bitm_array *arr) {
   return arr->index;
 }
 
+/* ======================================================================== */
+/** 
+ * Checks if the data array is full: the next elements will be discarded, so
+ * the writer can stop as soon as the data doesn't fit (the length of the
+ * array is its output budget).
+ * @param arr The bitm_array to use. 
+ * @return 1 if the array is full (otherwise 0).
+ */
+int bitm_is_full(bitm_array *arr) {
+  if (arr == NULL) {
+    return 1;
+  }
+  
+  return arr->index >= arr->length;
+}
+
 /* ======================================================================== */
 /** 
  * Reads the next bit from the data array.
  * @param arr The bitm_array to use. 
- * @return One bit of information. 
+ * @return One bit of information (-1 at the end of the data). 
  */
 int bitm_read_bit(bitm_array *arr) {
   if (arr == NULL || arr->data == NULL) {
@@ -190,8 +228,7 @@ int bitm_read_bit(bitm_array *arr) {
   }  
   
   if (arr->bit == 0) {
-    arr->current = arr->data[arr->index++];
-    arr->bit = BITS_PER_ELEMENT;
+    _BITM_LOAD(arr);
   }
   
   return (arr->current >> (--(arr->bit))) & 1;
@@ -209,7 +246,7 @@ void bitm_write_bit(bitm_array *arr, int b) {
   }
   
   if (arr->bit == BITS_PER_ELEMENT) {
-    arr->data[arr->index++] = arr->current;
+    _BITM_STORE(arr, arr->current);
     arr->bit = 0;
     arr->current = 0;
   }  
@@ -222,31 +259,36 @@ void bitm_write_bit(bitm_array *arr, int b) {
 /** 
  * Reads the next N bits from the data array.
  * @param arr The bitm_array to use. 
- * @param n The number of bits. 
+ * @param n The number of bits (up to BITS_PER_ELEMENT, but the value of
+ *          32 bits with the first one set is negative). 
  * @return N bits of information (-1 in case of error). 
  */
 int bitm_read_nbits(bitm_array *arr, int n) {
-  int b = 0;
+  unsigned int b = 0;
   if (arr == NULL || arr->data == NULL || n <= 0 || n > BITS_PER_ELEMENT) {
     return -1;
   }  
   
   if (arr->bit == 0) {
-    arr->current = arr->data[arr->index++];
-    arr->bit = BITS_PER_ELEMENT;
+    _BITM_LOAD(arr);
   }
   
   if (n > arr->bit) {
     b = (arr->current & mask[arr->bit]);
     n -= arr->bit;
 
-    arr->current = arr->data[arr->index++];
-    arr->bit = BITS_PER_ELEMENT;
+    _BITM_LOAD(arr);
+  }
+  
+  // (A whole element is not shifted: a shift by its size is undefined)
+  if (n == BITS_PER_ELEMENT) {
+    arr->bit = 0;
+    return (int) arr->current;
   }
   
   arr->bit -= n;
   b = ((b<<n) | ((arr->current >> arr->bit) & mask[n]));
-  return b;
+  return (int) b;
 }
 
 /* ======================================================================== */
@@ -263,7 +305,7 @@ void bitm_write_nbits(bitm_array *arr, int n, int b) {
   }
   
   if (arr->bit == BITS_PER_ELEMENT) {
-    arr->data[arr->index++] = arr->current;
+    _BITM_STORE(arr, arr->current);
     arr->bit = 0;
     arr->current = 0;
   }  
@@ -273,7 +315,7 @@ void bitm_write_nbits(bitm_array *arr, int n, int b) {
     n -= l;
     arr->current = ((arr->current<<l) | (b>>n));
       
-    arr->data[arr->index++] = arr->current;
+    _BITM_STORE(arr, arr->current);
     arr->bit = 0;
     arr->current = 0;
   }
@@ -329,9 +371,9 @@ void bitm_write_unary(bitm_array *arr, int n) {
 int bitm_read_eg(bitm_array *arr) {
   int e, r;  
 
-  /* Read the exponent in unary code */  
+  /* Read the exponent in unary code (an int can't have more bits) */  
   e = bitm_read_unary(arr);
-  if (e < 0) return -1;
+  if (e < 0 || e >= BITS_PER_ELEMENT - 1) return -1;
   r = 0;
   if (e>0) {
     /* Read the rest of the binary digits */
@@ -342,34 +384,15 @@ int bitm_read_eg(bitm_array *arr) {
   return (1<<e) | r;
 }
 
-#ifdef USE_FAST_EG
 /** 
- * Writes a possitive number into the data array using elias gamma coding.
+ * Writes a possitive number into the data array using elias gamma coding
+ * (calculating the code).
  * @see https://en.wikipedia.org/wiki/Elias_gamma_coding
  * @param arr The bitm_array to use. 
  * @param n The possitive number to write.    
  */
-void bitm_write_eg(bitm_array *arr, int n) {
-  if (n <=0) {
-    return;
-  }
-  
-  bitm_write_nbits(arr, fastEliasGamma[n-1][1], fastEliasGamma[n-1][0]);
-}
-
-#else
-
-/** 
- * Writes a possitive number into the data array using elias gamma coding.
- * @see https://en.wikipedia.org/wiki/Elias_gamma_coding
- * @param arr The bitm_array to use. 
- * @param n The possitive number to write.    
- */
-void bitm_write_eg(bitm_array *arr, int n) {
+static void _bitm_write_eg_calc(bitm_array *arr, int n) {
   int e, r, i, m;
-  if (n <=0) {
-    return;
-  }
   
  /* Calulate exponent and the remaining binary digits */
  e = 0;
@@ -395,4 +418,40 @@ void bitm_write_eg(bitm_array *arr, int n) {
  }
 }
 
-#endif
+#ifdef USE_FAST_EG
+/** 
+ * Writes a possitive number into the data array using elias gamma coding.
+ * @see https://en.wikipedia.org/wiki/Elias_gamma_coding
+ * @param arr The bitm_array to use. 
+ * @param n The possitive number to write.    
+ */
+void bitm_write_eg(bitm_array *arr, int n) {
+  if (n <=0) {
+    return;
+  }
+  
+  if (n > FAST_EG_NUMBERS) {
+    _bitm_write_eg_calc(arr, n);
+    return;
+  }
+  
+  bitm_write_nbits(arr, fastEliasGamma[n-1][1], fastEliasGamma[n-1][0]);
+}
+
+#else
+
+/** 
+ * Writes a possitive number into the data array using elias gamma coding.
+ * @see https://en.wikipedia.org/wiki/Elias_gamma_coding
+ * @param arr The bitm_array to use. 
+ * @param n The possitive number to write.    
+ */
+void bitm_write_eg(bitm_array *arr, int n) {
+  if (n <=0) {
+    return;
+  }
+  
+  _bitm_write_eg_calc(arr, n);
+}
+
+#endif
\ No newline at end of file
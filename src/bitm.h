@@ -22,6 +22,18 @@
 #define BITS_PER_ELEMENT 32
 typedef unsigned int ELEMENT;
 
+/**
+ * Elias-Gamma reader with its state inline (the state of several readers
+ * can be kept in registers, so their loads overlap).
+ */
+typedef struct {
+  const ELEMENT *data;
+  size_t length;
+  size_t index;             /* Next element to load. */
+  unsigned long long bits;  /* Next bits (from the most significant one). */
+  int count;                /* Number of bits in bits. */
+} bitm_reader;
+
 /**
  * Bit manipuation array.
  */
@@ -90,15 +102,26 @@ size_t bitm_get_length(bitm_array *arr);
 
 /** 
  * Gets the current index (in elements) for the data array.
+ * (The elements written after the end of the array are discarded but
+ * counted, so an index bigger than the length means that they didn't fit).
  * @param arr The bitm_array to use. 
  * @return Current index. 
  */
 size_t bitm_get_index(bitm_array *arr);
 
+/** 
+ * Checks if the data array is full: the next elements will be discarded, so
+ * the writer can stop as soon as the data doesn't fit (the length of the
+ * array is its output budget).
+ * @param arr The bitm_array to use. 
+ * @return 1 if the array is full (otherwise 0).
+ */
+int bitm_is_full(bitm_array *arr);
+
 /** 
  * Reads the next bit from the data array.
  * @param arr The bitm_array to use. 
- * @return One bit of information. 
+ * @return One bit of information (-1 at the end of the data). 
  */
 int bitm_read_bit(bitm_array *arr);
 
@@ -112,7 +135,8 @@ void bitm_write_bit(bitm_array *arr, int b);
 /** 
  * Reads the next N bits from the data array.
  * @param arr The bitm_array to use. 
- * @param n The number of bits. 
+ * @param n The number of bits (up to BITS_PER_ELEMENT, but the value of
+ *          32 bits with the first one set is negative). 
  * @return N bits of information (-1 in case of error).
  */
 int bitm_read_nbits(bitm_array *arr, int n);
@@ -157,4 +181,81 @@ int bitm_read_eg(bitm_array *arr);
  */
 void bitm_write_eg(bitm_array *arr, int n);
 
+/** 
+ * Initializes an Elias-Gamma reader.
+ * @param r The reader.
+ * @param data Data array to read.
+ * @param length Length (in elements) of the data array.
+ */
+static inline void bitm_reader_init(bitm_reader *r, const ELEMENT *data,
+                                    size_t length) {
+  r->data = data;
+  r->length = length;
+  r->index = 0;
+  r->bits = 0;
+  r->count = 0;
+}
+
+/** 
+ * Loads the next element into the bits of a reader if it has no more than
+ * 32 bits, so it has at least 32 bits (after the end of the data array
+ * zeroes are loaded).
+ * @param r The reader.
+ */
+static inline void bitm_reader_fill(bitm_reader *r) {
+  ELEMENT e;
+  
+  if (r->count <= BITS_PER_ELEMENT) {
+    e = (r->index < r->length) ? r->data[r->index] : 0;
+    r->index++;
+    r->bits |= (unsigned long long) e << (BITS_PER_ELEMENT - r->count);
+    r->count += BITS_PER_ELEMENT;
+  }
+}
+
+/** 
+ * Reads the next Elias-Gamma encoded number.
+ * @see https://en.wikipedia.org/wiki/Elias_gamma_coding 
+ * @param r The reader.
+ * @return A possitive number (or -1 in case of error). 
+ */
+static inline int bitm_reader_eg(bitm_reader *r) {
+  int e, n;
+  
+  bitm_reader_fill(r);
+  if (r->bits == 0) {
+    return -1;
+  }
+  
+  // (The exponent is the number of leading zeroes, an int can't have more
+  // bits)
+  e = __builtin_clzll(r->bits);
+  if (e >= BITS_PER_ELEMENT - 1) {
+    return -1;
+  }
+  n = 2*e + 1;
+  if (n > r->count) {
+    // Long codes: skip the zeroes before reading the digits
+    r->bits <<= e;
+    r->count -= e;
+    bitm_reader_fill(r);
+    n = e + 1;
+  }
+  
+  e = (int) (r->bits >> (64 - n));
+  r->bits <<= n;
+  r->count -= n;
+  return e;
+}
+
+/** 
+ * Checks if a reader read after the end of its data array.
+ * @param r The reader.
+ * @return 1 if the reader read the zeroes after the data (otherwise 0).
+ */
+static inline int bitm_reader_overrun(const bitm_reader *r) {
+  return r->index > r->length
+         && (r->index - r->length) * BITS_PER_ELEMENT > (size_t) r->count;
+}
+
 #endif
\ No newline at end of file
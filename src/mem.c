@@ -0,0 +1,161 @@
+/* Memory allocation functions for big data buffers.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "mem.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+/* ======================================================================== */
+/** 
+ * Rounds a size up to the huge page size.
+ * @param size Size (in bytes).
+ * @return The rounded size.
+ */
+static size_t _mem_huge_size(size_t size) {
+  return (size + MEM_HUGE_PAGE_SIZE - 1) & ~((size_t) MEM_HUGE_PAGE_SIZE - 1);
+}
+
+/* ======================================================================== */
+/** 
+ * Allocates a memory region aligned to the huge page size and advises
+ * the kernel to use transparent huge pages.
+ * @param length Length (in bytes, multiple of the huge page size).
+ * @return The memory region (or NULL in case of error).
+ */
+static void *_mem_alloc_thp(size_t length) {
+  unsigned char *ptr, *aligned;
+  size_t head, tail;
+  
+  ptr = mmap(NULL, length + MEM_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return NULL;
+  }
+  
+  // Release the unaligned head and tail
+  aligned = (unsigned char *) (((uintptr_t) ptr + MEM_HUGE_PAGE_SIZE - 1)
+                               & ~((uintptr_t) MEM_HUGE_PAGE_SIZE - 1));
+  head = aligned - ptr;
+  tail = MEM_HUGE_PAGE_SIZE - head;
+  if (head > 0) {
+    munmap(ptr, head);
+  }
+  if (tail > 0) {
+    munmap(aligned + length, tail);
+  }
+  
+#ifdef MADV_HUGEPAGE
+  madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+
+  return aligned;
+}
+
+/* ======================================================================== */
+/** 
+ * Allocates a data buffer. The big buffers are allocated in huge pages
+ * (or transparent huge pages if there aren't huge pages available).
+ * @param size Size (in bytes) of the buffer.
+ * @param node NUMA node where the memory must be allocated (or -1 to
+ *             allocate it in the node of the thread that touches it first).
+ * @return The buffer (or NULL in case of error).
+ */
+void *mem_alloc(size_t size, int node) {
+  void *ptr;
+  size_t length;
+  
+  if (size < MEM_HUGE_PAGE_SIZE) {
+    return malloc(size);
+  }
+  
+  length = _mem_huge_size(size);
+  ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (ptr == MAP_FAILED) {
+    ptr = _mem_alloc_thp(length);
+    if (ptr == NULL) {
+      return NULL;
+    }
+  }
+
+#ifdef HAVE_LIBNUMA
+  // The pages are not touched yet, so they will be allocated in the node
+  if (node >= 0 && numa_available() >= 0) {
+    numa_tonode_memory(ptr, length, node);
+  }
+#endif
+
+  return ptr;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases a data buffer.
+ * @param ptr The buffer to release.
+ * @param size Size (in bytes) of the buffer (the same used to allocate it).
+ */
+void mem_free(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+  
+  if (size < MEM_HUGE_PAGE_SIZE) {
+    free(ptr);
+  }
+  else {
+    munmap(ptr, _mem_huge_size(size));
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the number of NUMA nodes.
+ * @return The number of NUMA nodes (1 if NUMA is not available).
+ */
+int mem_numa_nodes() {
+#ifdef HAVE_LIBNUMA
+  int nodes;
+  
+  if (numa_available() >= 0) {
+    nodes = numa_num_configured_nodes();
+    if (nodes > 0) {
+      return nodes;
+    }
+  }
+#endif
+
+  return 1;
+}
+
+/* ======================================================================== */
+/** 
+ * Runs the calling thread in the processors of a NUMA node.
+ * @param node The NUMA node (or -1 to run in any processor).
+ */
+void mem_run_on_node(int node) {
+#ifdef HAVE_LIBNUMA
+  if (numa_available() >= 0) {
+    numa_run_on_node(node);
+  }
+#endif
+}
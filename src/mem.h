@@ -0,0 +1,53 @@
+/* Memory allocation functions for big data buffers.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdlib.h>
+
+/* Huge page size (buffers of this size or bigger use huge pages) */
+#define MEM_HUGE_PAGE_SIZE (2*1024*1024)
+
+/** 
+ * Allocates a data buffer. The big buffers are allocated in huge pages
+ * (or transparent huge pages if there aren't huge pages available).
+ * @param size Size (in bytes) of the buffer.
+ * @param node NUMA node where the memory must be allocated (or -1 to
+ *             allocate it in the node of the thread that touches it first).
+ * @return The buffer (or NULL in case of error).
+ */
+void *mem_alloc(size_t size, int node);
+
+/** 
+ * Releases a data buffer.
+ * @param ptr The buffer to release.
+ * @param size Size (in bytes) of the buffer (the same used to allocate it).
+ */
+void mem_free(void *ptr, size_t size);
+
+/** 
+ * Gets the number of NUMA nodes.
+ * @return The number of NUMA nodes (1 if NUMA is not available).
+ */
+int mem_numa_nodes();
+
+/** 
+ * Runs the calling thread in the processors of a NUMA node.
+ * @param node The NUMA node (or -1 to run in any processor).
+ */
+void mem_run_on_node(int node);
+
+#endif
@@ -15,6 +15,7 @@
 
 #include "mtf.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 /* ======================================================================== */
@@ -28,7 +29,29 @@ void mtf_reset(mtf_status *status) {
   for (i = 0; i<BYTE_SYMBOLS; i++) {
     status->distances[i] = i;
     status->symbols[i] = BYTE_SYMBOLS_1-i;
+    status->counts[i] = 0;
   }
+  status->increment = MTF_WFC_INCREMENT;
+  status->previous = 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Sets the initial order of the symbols of the MTF status. 
+ * @param mtf_status The status to initialize.
+ * @param order The symbols (every byte value once) from the front (rank 0)
+ *              to the back.
+ */
+void mtf_set_order(mtf_status *status, const unsigned char *order) {
+  int i;
+  
+  for (i = 0; i<BYTE_SYMBOLS; i++) {
+    status->distances[order[i]] = i;
+    status->symbols[BYTE_SYMBOLS_1-i] = order[i];
+    status->counts[i] = 0;
+  }
+  status->increment = MTF_WFC_INCREMENT;
+  status->previous = 0;
 }
 
 /* ======================================================================== */
@@ -154,4 +177,479 @@ void mtf_decode(unsigned char *src, unsigned char *dst, int length,
     dst[i] = status->symbols[p];
     _mtf_move_to_front_pos(p, status);
   }  
-}
\ No newline at end of file
+}
+
+/* ======================================================================== */
+/** 
+ * Moves a symbol of the symbols array (the decoder status) from a rank to
+ * a lower one.
+ * @param d The current rank of the symbol.
+ * @param r The new rank.
+ * @param status The MTF status.
+ */
+static inline void _mtf_move_rank(int d, int r, mtf_status *status) {
+  unsigned char *symbols = status->symbols;
+  int c, i;
+  
+  c = symbols[BYTE_SYMBOLS_1 - d];
+  for (i = BYTE_SYMBOLS_1 - d; i < BYTE_SYMBOLS_1 - r; i++) {
+    symbols[i] = symbols[i+1];
+  }
+  symbols[BYTE_SYMBOLS_1 - r] = c;
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the rank of a symbol (in the coder status).
+ * @param c The symbol.
+ * @param status The MTF status.
+ * @return The rank of the symbol.
+ */
+#ifdef __OPTIMIZE__
+/* Optimized version */
+static inline int _mtf_rank(int c, mtf_status *status) {
+  return status->distances[c];
+}
+#else
+/* Base version */
+static inline int _mtf_rank(int c, mtf_status *status) {
+  int pos;
+  
+  pos = BYTE_SYMBOLS_1;
+  while (pos>=0 && status->symbols[pos] != c) {
+    pos--;
+  }
+  
+  return BYTE_SYMBOLS_1 - pos;
+}
+#endif
+
+/* ======================================================================== */
+/** 
+ * Moves a symbol of the coder status from a rank to a lower one.
+ * @param c The symbol.
+ * @param d The current rank of the symbol.
+ * @param r The new rank.
+ * @param status The MTF status.
+ */
+#ifdef __OPTIMIZE__
+/* Optimized version (without branches, it can be vectorized) */
+static inline void _mtf_move_symbol(int c, int d, int r, mtf_status *status) {
+  unsigned char *distances = status->distances;
+  int i;
+  
+  for (i = 0; i<BYTE_SYMBOLS; i++) {
+    distances[i] += ((distances[i] >= r) & (distances[i] < d));
+  }
+  
+  distances[c] = r;
+}
+#else
+/* Base version */
+static inline void _mtf_move_symbol(int c, int d, int r, mtf_status *status) {
+  _mtf_move_rank(d, r, status);
+}
+#endif
+
+/* ======================================================================== */
+/** 
+ * Gets the new rank of a symbol for MTF-1 or MTF-2.
+ * @param d The current rank of the symbol.
+ * @param sticky The symbol of the rank 1 stays there if the previous rank
+ *               was 0 (MTF-2).
+ * @param status The MTF status.
+ * @return The new rank.
+ */
+static inline int _mtf1_target(int d, int sticky, mtf_status *status) {
+  if (d > 1) {
+    return 1;
+  }
+  
+  return (d == 1 && sticky && status->previous == 0) ? 1 : 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Codes the source data by using MTF-1 or MTF-2. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param sticky Use MTF-2.
+ * @param status The MTF coding status.
+ */
+static void _mtf1_code(unsigned char *src, unsigned char *dst, int length,
+                       int sticky, mtf_status *status) {
+  int i, c, d, r;
+  
+  for (i = 0; i<length; i++) {
+    c = src[i];
+    d = _mtf_rank(c, status);
+    r = _mtf1_target(d, sticky, status);
+    if (r < d) {
+      _mtf_move_symbol(c, d, r, status);
+    }
+    dst[i] = d;
+    status->previous = d;
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Decodes the source data by using MTF-1 or MTF-2. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param sticky Use MTF-2.
+ * @param status The MTF coding status.
+ */
+static void _mtf1_decode(unsigned char *src, unsigned char *dst, int length,
+                         int sticky, mtf_status *status) {
+  int i, d, r;
+  
+  for (i = 0; i<length; i++) {
+    d = src[i];
+    r = _mtf1_target(d, sticky, status);
+    dst[i] = status->symbols[BYTE_SYMBOLS_1 - d];
+    if (r < d) {
+      _mtf_move_rank(d, r, status);
+    }
+    status->previous = d;
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Codes the source data by using MTF-1. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf1_code(unsigned char *src, unsigned char *dst, int length,
+               mtf_status *status) {
+  _mtf1_code(src, dst, length, 0, status);
+}
+
+/* ======================================================================== */
+/** 
+ * Decodes the source data by using MTF-1. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf1_decode(unsigned char *src, unsigned char *dst, int length,
+                 mtf_status *status) {
+  _mtf1_decode(src, dst, length, 0, status);
+}
+
+/* ======================================================================== */
+/** 
+ * Codes the source data by using MTF-2. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf2_code(unsigned char *src, unsigned char *dst, int length,
+               mtf_status *status) {
+  _mtf1_code(src, dst, length, 1, status);
+}
+
+/* ======================================================================== */
+/** 
+ * Decodes the source data by using MTF-2. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf2_decode(unsigned char *src, unsigned char *dst, int length,
+                 mtf_status *status) {
+  _mtf1_decode(src, dst, length, 1, status);
+}
+
+/* ======================================================================== */
+/** 
+ * Counts a symbol and gets its new rank (the symbols with a bigger count
+ * go before it, so the list stays sorted by count).
+ * @param c The symbol.
+ * @param status The MTF status.
+ * @return The new rank.
+ */
+static inline int _wfc_count(int c, mtf_status *status) {
+  unsigned int *counts = status->counts;
+  unsigned int n;
+  int i, r;
+  
+  n = counts[c] + status->increment;
+  counts[c] = n;
+  
+  r = 0;
+  for (i = 0; i<BYTE_SYMBOLS; i++) {
+    r += (counts[i] > n);
+  }
+  
+  // The next symbols weigh more (the counts can't overflow: a count is
+  // less than 3 times the increment)
+  status->increment += status->increment >> MTF_WFC_SHIFT;
+  
+  // (Scaling every count down keeps the list sorted, but different counts
+  // can become equal)
+  if (status->increment > MTF_WFC_LIMIT) {
+    for (i = 0; i<BYTE_SYMBOLS; i++) {
+      counts[i] >>= MTF_WFC_SCALE;
+    }
+    status->increment >>= MTF_WFC_SCALE;
+  }
+  
+  return r;
+}
+
+/* ======================================================================== */
+/** 
+ * Codes the source data by using a weighted frequency count. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void wfc_code(unsigned char *src, unsigned char *dst, int length,
+              mtf_status *status) {
+  int i, c, d, r;
+  
+  for (i = 0; i<length; i++) {
+    c = src[i];
+    d = _mtf_rank(c, status);
+    r = _wfc_count(c, status);
+    if (r < d) {
+      _mtf_move_symbol(c, d, r, status);
+    }
+    dst[i] = d;
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Decodes the source data by using a weighted frequency count. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void wfc_decode(unsigned char *src, unsigned char *dst, int length,
+                mtf_status *status) {
+  int i, c, d, r;
+  
+  for (i = 0; i<length; i++) {
+    d = src[i];
+    c = status->symbols[BYTE_SYMBOLS_1 - d];
+    r = _wfc_count(c, status);
+    if (r < d) {
+      _mtf_move_rank(d, r, status);
+    }
+    dst[i] = c;
+  }
+}
+
+/* Rank transforms (indexed by MTF_TRANSFORM_*) */
+const mtf_transform mtf_transforms[MTF_TRANSFORMS] = {
+  { "mtf", mtf_code, mtf_decode },
+  { "mtf1", mtf1_code, mtf1_decode },
+  { "mtf2", mtf2_code, mtf2_decode },
+  { "wfc", wfc_code, wfc_decode }
+};
+
+/* ======================================================================== */
+/** 
+ * Allocates a word MTF status. 
+ * @return The status (it must be reset before using it) or NULL in case of
+ *         error.
+ */
+mtf16_status *mtf16_alloc() {
+  mtf16_status *status;
+  
+  status = (mtf16_status *) calloc(1, sizeof(mtf16_status));
+  if (status == NULL) {
+    return NULL;
+  }
+  
+  status->last = (int *) malloc(WORD_SYMBOLS * sizeof(int));
+  status->symbols = (unsigned short *) malloc(MTF16_TIMES
+                                              * sizeof(unsigned short));
+  status->tree = (int *) malloc((MTF16_TIMES + 1) * sizeof(int));
+  if (status->last == NULL || status->symbols == NULL
+      || status->tree == NULL) {
+    mtf16_free(status);
+    return NULL;
+  }
+  
+  return status;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases a word MTF status. 
+ * @param status The status to release.
+ */
+void mtf16_free(mtf16_status *status) {
+  if (status == NULL) {
+    return;
+  }
+  
+  free(status->last);
+  free(status->symbols);
+  free(status->tree);
+  free(status);
+}
+
+/* ======================================================================== */
+/** 
+ * Builds the Fenwick tree of the word MTF status (the times before
+ * WORD_SYMBOLS are the last use of a symbol).
+ * @param status The word MTF status.
+ */
+static void _mtf16_build_tree(mtf16_status *status) {
+  int *tree = status->tree;
+  int i, j;
+  
+  for (i = 1; i <= MTF16_TIMES; i++) {
+    tree[i] = (i <= WORD_SYMBOLS);
+  }
+  
+  // (Every node adds its value to the parent, in linear time)
+  for (i = 1; i <= MTF16_TIMES; i++) {
+    j = i + (i & -i);
+    if (j <= MTF16_TIMES) {
+      tree[j] += tree[i];
+    }
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Resets the word MTF status (the word 0 at the front). 
+ * @param status The status to reset.
+ */
+void mtf16_reset(mtf16_status *status) {
+  int t;
+  
+  for (t = 0; t < WORD_SYMBOLS; t++) {
+    status->symbols[t] = WORD_SYMBOLS - 1 - t;
+    status->last[WORD_SYMBOLS - 1 - t] = t;
+  }
+  
+  _mtf16_build_tree(status);
+  status->now = WORD_SYMBOLS;
+}
+
+/* ======================================================================== */
+/** 
+ * Renumbers the times of the symbols (from 0 to WORD_SYMBOLS-1, keeping
+ * the order) when there are no more free times.
+ * @param status The word MTF status.
+ */
+static void _mtf16_compact(mtf16_status *status) {
+  unsigned short *symbols = status->symbols;
+  int *last = status->last;
+  int t, n;
+  
+  for (t = 0, n = 0; t < status->now; t++) {
+    if (last[symbols[t]] == t) {
+      symbols[n] = symbols[t];
+      last[symbols[n]] = n;
+      n++;
+    }
+  }
+  
+  _mtf16_build_tree(status);
+  status->now = WORD_SYMBOLS;
+}
+
+/* ======================================================================== */
+/** 
+ * Moves to front a symbol (it is used now).
+ * @param s The symbol.
+ * @param status The word MTF status.
+ */
+static inline void _mtf16_move_to_front(int s, mtf16_status *status) {
+  int *tree = status->tree;
+  int i;
+  
+  if (status->now == MTF16_TIMES) {
+    _mtf16_compact(status);
+  }
+  
+  for (i = status->last[s] + 1; i <= MTF16_TIMES; i += (i & -i)) {
+    tree[i]--;
+  }
+  for (i = status->now + 1; i <= MTF16_TIMES; i += (i & -i)) {
+    tree[i]++;
+  }
+  
+  status->symbols[status->now] = s;
+  status->last[s] = status->now++;
+}
+
+/* ======================================================================== */
+/** 
+ * Codes an array of words by using Move-To-Front. 
+ * @param src The source array of words.
+ * @param dst The destination array of ranks (it can be the source array).
+ * @param length The number of words in the source array.
+ * @param status The word MTF coding status.
+ */
+void mtf16_code(unsigned short *src, unsigned short *dst, int length,
+                mtf16_status *status) {
+  int *tree = status->tree;
+  int i, j, s, rank;
+  
+  for (i = 0; i<length; i++) {
+    s = src[i];
+    
+    // The rank is the number of symbols used after the last use
+    rank = WORD_SYMBOLS;
+    for (j = status->last[s] + 1; j > 0; j -= (j & -j)) {
+      rank -= tree[j];
+    }
+    dst[i] = rank;
+    
+    if (rank != 0) {
+      _mtf16_move_to_front(s, status);
+    }
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Decodes an array of ranks by using Move-To-Front. 
+ * @param src The source array of ranks.
+ * @param dst The destination array of words (it can be the source array).
+ * @param length The number of words in the source array.
+ * @param status The word MTF coding status.
+ */
+void mtf16_decode(unsigned short *src, unsigned short *dst, int length,
+                  mtf16_status *status) {
+  int *tree = status->tree;
+  int i, k, t, step;
+  
+  for (i = 0; i<length; i++) {
+    if (src[i] == 0) {
+      dst[i] = status->symbols[status->now - 1];
+      continue;
+    }
+    
+    // Find the time with WORD_SYMBOLS - rank symbols up to it
+    k = WORD_SYMBOLS - src[i];
+    t = 0;
+    for (step = MTF16_TIMES; step > 0; step >>= 1) {
+      if (t + step <= MTF16_TIMES && tree[t + step] < k) {
+        t += step;
+        k -= tree[t];
+      }
+    }
+    
+    dst[i] = status->symbols[t];
+    _mtf16_move_to_front(dst[i], status);
+  }
+}
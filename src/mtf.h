@@ -19,14 +19,79 @@
 #define BYTE_SYMBOLS 256
 #define BYTE_SYMBOLS_1 255
 
+#define WORD_SYMBOLS 65536
+
+/* Recency times of the word MTF (the times are renumbered when they run
+   out) */
+#define MTF16_TIMES (2*WORD_SYMBOLS)
+
+/* Rank transforms */
+#define MTF_TRANSFORM_MTF  0  /* Move-To-Front. */
+#define MTF_TRANSFORM_MTF1 1  /* MTF-1: the symbols move to the rank 1 (or
+                                 to the front from the rank 1). */
+#define MTF_TRANSFORM_MTF2 2  /* MTF-2: like MTF-1, but the symbol of the
+                                 rank 1 only moves to the front if the
+                                 previous rank wasn't 0. */
+#define MTF_TRANSFORM_WFC  3  /* Weighted frequency count: the symbols are
+                                 sorted by a count whose increment grows
+                                 with every symbol (the recent symbols weigh
+                                 more). */
+#define MTF_TRANSFORMS     4
+
+/* Weighted frequency count of the symbols: the increment of a count grows
+   by 1/2^MTF_WFC_SHIFT with every symbol (so the weight of the old symbols
+   decays), and when it passes the limit every count is scaled down */
+#define MTF_WFC_INCREMENT 4096
+#define MTF_WFC_SHIFT 1
+#define MTF_WFC_LIMIT (1u<<28)
+#define MTF_WFC_SCALE 16
+
 /**
  * MTF data.
  */
 typedef struct { 
   unsigned char distances[BYTE_SYMBOLS];
   unsigned char symbols[BYTE_SYMBOLS];
+  unsigned int counts[BYTE_SYMBOLS];   /* Weighted counts (WFC). */
+  unsigned int increment;              /* Next increment of a count (WFC). */
+  unsigned char previous;              /* Previous rank (MTF-2). */
 } mtf_status;
 
+/**
+ * Codes or decodes an array of bytes with a rank transform.
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param status The coding status.
+ */
+typedef void (*mtf_function)(unsigned char *src, unsigned char *dst,
+                             int length, mtf_status *status);
+
+/**
+ * Rank transform (every transform keeps its data in a mtf_status).
+ */
+typedef struct {
+  const char *name;
+  mtf_function code;
+  mtf_function decode;
+} mtf_transform;
+
+/* Rank transforms (indexed by MTF_TRANSFORM_*) */
+extern const mtf_transform mtf_transforms[MTF_TRANSFORMS];
+
+/**
+ * Word (16-bit) MTF data. Every symbol has the time of its last use and a
+ * Fenwick tree counts the symbols used after a time (the rank), so the
+ * ranks are found and updated in logarithmic time.
+ */
+typedef struct {
+  int now;                 /* Next time (the front symbol has now-1). */
+  int *last;               /* Time of the last use of every symbol. */
+  unsigned short *symbols; /* Symbol used at every time. */
+  int *tree;               /* Fenwick tree (1 at the last time of every
+                              symbol). */
+} mtf16_status;
+
 
 /** 
  * Resets the MTF status. 
@@ -34,6 +99,14 @@ typedef struct {
  */
 void mtf_reset(mtf_status *status);
 
+/** 
+ * Sets the initial order of the symbols of the MTF status. 
+ * @param mtf_status The status to initialize.
+ * @param order The symbols (every byte value once) from the front (rank 0)
+ *              to the back.
+ */
+void mtf_set_order(mtf_status *status, const unsigned char *order);
+
 /** 
  * Codes the source data by using Move-To-Front. 
  * @param src The source array of data.
@@ -54,5 +127,104 @@ void mtf_code(unsigned char *src, unsigned char *dst, int length,
 void mtf_decode(unsigned char *src, unsigned char *dst, int length,
                     mtf_status *status);
 
+/** 
+ * Codes the source data by using MTF-1. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf1_code(unsigned char *src, unsigned char *dst, int length,
+               mtf_status *status);
+
+/** 
+ * Decodes the source data by using MTF-1. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf1_decode(unsigned char *src, unsigned char *dst, int length,
+                 mtf_status *status);
+
+/** 
+ * Codes the source data by using MTF-2. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf2_code(unsigned char *src, unsigned char *dst, int length,
+               mtf_status *status);
+
+/** 
+ * Decodes the source data by using MTF-2. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void mtf2_decode(unsigned char *src, unsigned char *dst, int length,
+                 mtf_status *status);
+
+/** 
+ * Codes the source data by using a weighted frequency count. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void wfc_code(unsigned char *src, unsigned char *dst, int length,
+              mtf_status *status);
+
+/** 
+ * Decodes the source data by using a weighted frequency count. 
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ * @param mtf_status The MTF coding status.
+ */
+void wfc_decode(unsigned char *src, unsigned char *dst, int length,
+                mtf_status *status);
+
+/** 
+ * Allocates a word MTF status. 
+ * @return The status (it must be reset before using it) or NULL in case of
+ *         error.
+ */
+mtf16_status *mtf16_alloc();
+
+/** 
+ * Releases a word MTF status. 
+ * @param status The status to release.
+ */
+void mtf16_free(mtf16_status *status);
+
+/** 
+ * Resets the word MTF status (the word 0 at the front). 
+ * @param status The status to reset.
+ */
+void mtf16_reset(mtf16_status *status);
+
+/** 
+ * Codes an array of words by using Move-To-Front. 
+ * @param src The source array of words.
+ * @param dst The destination array of ranks (it can be the source array).
+ * @param length The number of words in the source array.
+ * @param status The word MTF coding status.
+ */
+void mtf16_code(unsigned short *src, unsigned short *dst, int length,
+                mtf16_status *status);
+
+/** 
+ * Decodes an array of ranks by using Move-To-Front. 
+ * @param src The source array of ranks.
+ * @param dst The destination array of words (it can be the source array).
+ * @param length The number of words in the source array.
+ * @param status The word MTF coding status.
+ */
+void mtf16_decode(unsigned short *src, unsigned short *dst, int length,
+                  mtf16_status *status);
+
 
 #endif
\ No newline at end of file
@@ -23,12 +23,27 @@
 //#define DEBUG_COUNTS
 //#define DEBUG_INDEX
 
-/* 2-byte elements byte to sort by (could be 0 or 1) */
-#define SORTING_BYTE 0
-
 /* number of symbols */
 #define NSYMBOLS 256
 
+/* The loops are inline templates: every instance is specialized for a
+   sorting byte */
+#ifdef __GNUC__
+#define SPLIT_TEMPLATE static inline __attribute__((always_inline))
+#else
+#define SPLIT_TEMPLATE static inline
+#endif
+
+/* Calls the instance of a template for a sorting byte (the runtime
+   dispatch is done once per block) */
+#define SPLIT_SPECIALIZE(sorting_byte, call, ...)                        \
+  if (sorting_byte) {                                                    \
+    call(1, __VA_ARGS__);                                                \
+  }                                                                      \
+  else {                                                                 \
+    call(0, __VA_ARGS__);                                                \
+  }
+
 /* ======================================================================== */
 /** 
  * Count bytes in an array. 
@@ -60,14 +75,16 @@ void count_bytes(unsigned char *src, int len, int *count) {
  * @param src The source data whose bytes will be counted.
  * @param len The number of words in the source data.
  * @param count An array of 256*sizeof(int) bytes that will
- *              contain the counts of the higher byte.
+ *              contain the counts of the sorting byte.
+ * @param sorting_byte The byte of the words to count (0 or 1).
  */
-void count_word_bytes(unsigned short *src, int len, int *count) {
+void count_word_bytes(unsigned short *src, int len, int *count,
+                      int sorting_byte) {
   int i;
   unsigned char *src_s;
 
   memset(count, 0, NSYMBOLS*sizeof(int));
-  src_s = ((unsigned char *) src) + SORTING_BYTE;
+  src_s = ((unsigned char *) src) + sorting_byte;
 
   for (i = 0; i < len; i++) {
     count[ *src_s ]++;
@@ -107,16 +124,18 @@ void calculate_byte_indexes(int *count, int *index) {
 
 /* ======================================================================== */
 /** 
- * Separate bytes. 
- * @param src The source array of words (to be separated into groups).
+ * Separate bytes (template).
+ * @param sorting_byte The byte of the words to sort by.
+ * @param src The source array of words.
  * @param dst The destination array of bytes.
  * @param length The number of words in the source array.
+ * @param index_s The indexes of the groups.
  */
-void separate_bytes(unsigned short *src, unsigned char *dst, int length) {
+SPLIT_TEMPLATE void _separate_bytes(const int sorting_byte,
+                                    unsigned short *src, unsigned char *dst,
+                                    int length, int *index_s) {
   long i;
   unsigned char current_h, current_l;
-  int count_s[NSYMBOLS];
-  int index_s[NSYMBOLS];
   unsigned char *dst_h;
   unsigned char *dst_l;
   unsigned char *src_h;
@@ -127,101 +146,204 @@ void separate_bytes(unsigned short *src, unsigned char *dst, int length) {
   src_h = (unsigned char *) src;
   src_l = ((unsigned char *) src) + 1;  
   
-  // Count the bytes
-  count_word_bytes(src, length, count_s);
-  
-  // Calculate the indexes
-  calculate_byte_indexes(count_s, index_s);
-  
-  // Separate the bytes 
   for (i = 0; i < length; i++) {
     current_h = *src_h;
     current_l = *src_l;
     src_h += 2;
     src_l += 2;
 
-#if SORTING_BYTE == 0
-    /* Sort by highest byte */
+    if (sorting_byte == 0) {
+      /* Sort by highest byte */
 #ifdef DEBUG
-    fprintf(stdout, "dst_h[%06x] = %i\n", i, current_h);
-    fprintf(stdout, "dst_l[%06x] = %i\n", index_s[current_h], current_l);
+      fprintf(stdout, "dst_h[%06x] = %i\n", i, current_h);
+      fprintf(stdout, "dst_l[%06x] = %i\n", index_s[current_h], current_l);
 #endif	    
-    dst_h[i] = current_h;
-    dst_l[index_s[current_h]++] = current_l;
-    
-#else
-    /* Sort by lowest byte */    
+      dst_h[i] = current_h;
+      dst_l[index_s[current_h]++] = current_l;
+    }
+    else {
+      /* Sort by lowest byte */    
 #ifdef DEBUG
-    fprintf(stdout, "dst_h[%06x] = %i\n", index_s[current_l], current_h);
-    fprintf(stdout, "dst_l[%06x] = %i\n", i, current_l);
+      fprintf(stdout, "dst_h[%06x] = %i\n", index_s[current_l], current_h);
+      fprintf(stdout, "dst_l[%06x] = %i\n", i, current_l);
 #endif	    
-    dst_h[index_s[current_l]++] = current_h;
-    dst_l[i] = current_l;    
+      dst_h[index_s[current_l]++] = current_h;
+      dst_l[i] = current_l;    
+    }
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Separate bytes. 
+ * @param src The source array of words (to be separated into groups).
+ * @param dst The destination array of bytes.
+ * @param length The number of words in the source array.
+ * @param sorting_byte The byte of the words to sort by (0 or 1).
+ */
+void separate_bytes(unsigned short *src, unsigned char *dst, int length,
+                    int sorting_byte) {
+  int count_s[NSYMBOLS];
+  int index_s[NSYMBOLS];
+  
+  // Count the bytes
+  count_word_bytes(src, length, count_s, sorting_byte);
+  
+  // Calculate the indexes
+  calculate_byte_indexes(count_s, index_s);
+  
+  // Separate the bytes 
+  SPLIT_SPECIALIZE(sorting_byte, _separate_bytes, src, dst, length, index_s)
+}
+
+/* ======================================================================== */
+/** 
+ * Separate bytes in the same array (template).
+ * @param sorting_byte The byte of the words to sort by.
+ * @param data The array of words.
+ * @param tmp A temporary array of length bytes.
+ * @param length The number of words in the data array.
+ * @param index_s The indexes of the groups.
+ */
+SPLIT_TEMPLATE void _separate_bytes_inplace(const int sorting_byte,
+                                            unsigned short *data,
+                                            unsigned char *tmp, int length,
+                                            int *index_s) {
+  long i;
+  unsigned char *data_b;
+
+  data_b = (unsigned char *) data;
+  
+  if (sorting_byte == 0) {
+    /* Sort by highest byte */
+    
+    // Separate the lowest bytes into the temporary array
+    for (i = 0; i < length; i++) {
+      tmp[index_s[data_b[i<<1]]++] = data_b[(i<<1) + 1];
+    }
+    
+    // Move the highest bytes to the first half (in order)
+    for (i = 0; i < length; i++) {
+      data_b[i] = data_b[i<<1];
+    }
+    
+    memcpy(data_b + length, tmp, length);
+  }
+  else {
+    /* Sort by lowest byte */
+
+    // Separate the highest bytes into the temporary array
+    for (i = 0; i < length; i++) {
+      tmp[index_s[data_b[(i<<1) + 1]]++] = data_b[i<<1];
+    }
+    
+    // Move the lowest bytes to the second half (backwards not to overwrite
+    // the bytes that are not moved yet)
+    for (i = length - 1; i >= 0; i--) {
+      data_b[length + i] = data_b[(i<<1) + 1];
+    }
     
-#endif    
+    memcpy(data_b, tmp, length);
   }
+}
+
+/* ======================================================================== */
+/** 
+ * Separate bytes in the same array (the result is the same as the
+ * destination array of separate_bytes).
+ * @param data The array of words (to be separated into groups of bytes).
+ * @param tmp A temporary array of length bytes.
+ * @param length The number of words in the data array.
+ * @param sorting_byte The byte of the words to sort by (0 or 1).
+ */
+void separate_bytes_inplace(unsigned short *data, unsigned char *tmp,
+                            int length, int sorting_byte) {
+  int count_s[NSYMBOLS];
+  int index_s[NSYMBOLS];
 
+  // Count the bytes
+  count_word_bytes(data, length, count_s, sorting_byte);
+  
+  // Calculate the indexes
+  calculate_byte_indexes(count_s, index_s);
+  
+  SPLIT_SPECIALIZE(sorting_byte, _separate_bytes_inplace, data, tmp, length,
+                   index_s)
 }
 
 /* ======================================================================== */
 /** 
- * Join bytes. (Reverse the separate_bytes operation).
- * @param src The source array of bytes (to be joined from groups).
+ * Join bytes (template).
+ * @param sorting_byte The byte of the words to sort by.
+ * @param src The source array of bytes.
  * @param dst The destination array of words.
- * @param last Value of the last byte (before separation).
  * @param length The number of words in the source array.
+ * @param index_s The indexes of the groups.
  */
-void join_bytes(unsigned char *src, unsigned short *dst, unsigned char last,
-                int length) {
+SPLIT_TEMPLATE void _join_bytes(const int sorting_byte, unsigned char *src,
+                                unsigned short *dst, int length,
+                                int *index_s) {
   long i;
   unsigned char current_h, current_l;
-  int count_s[NSYMBOLS];
-  int index_s[NSYMBOLS];
   unsigned char *dst_h;
   unsigned char *dst_l;
   unsigned char *src_h;
   unsigned char *src_l;  
   
-  // Count the bytes
-  count_bytes(src + length*SORTING_BYTE, length, count_s);  
-  
-  // Calculate the indexes
-  calculate_byte_indexes(count_s, index_s);
-
-  // join the bytes
   dst_h = (unsigned char *) dst;
   dst_l = ((unsigned char *) dst) + 1;  
   src_h = src;
   src_l = src + length;
-  
 
   for (i = 0; i < length; i++) {
-#if SORTING_BYTE == 0
-    /* Sort by highest byte */
-    current_h = src_h[i];
-    current_l = src_l[index_s[current_h]++];
-    
+    if (sorting_byte == 0) {
+      /* Sort by highest byte */
+      current_h = src_h[i];
+      current_l = src_l[index_s[current_h]++];
+      
 #ifdef DEBUG
-    fprintf(stdout, "dst_h[%06x] = %i\n", i, current_h);
-    fprintf(stdout, "dst_l[%06x] = %i\n", index_s[current_h]-1, current_l);
+      fprintf(stdout, "dst_h[%06x] = %i\n", i, current_h);
+      fprintf(stdout, "dst_l[%06x] = %i\n", index_s[current_h]-1, current_l);
 #endif
-
-#else
-    /* Sort by lowest byte */
-    current_l = src_l[i];
-    current_h = src_h[index_s[current_l]++];
-    
+    }
+    else {
+      /* Sort by lowest byte */
+      current_l = src_l[i];
+      current_h = src_h[index_s[current_l]++];
+      
 #ifdef DEBUG
-    fprintf(stdout, "dst_h[%06x] = %i\n", index_s[current_l]-1, current_h);
-    fprintf(stdout, "dst_l[%06x] = %i\n", i, current_l);
-#endif
-    
+      fprintf(stdout, "dst_h[%06x] = %i\n", index_s[current_l]-1, current_h);
+      fprintf(stdout, "dst_l[%06x] = %i\n", i, current_l);
 #endif
+    }
 
     *dst_h = current_h;
     *dst_l = current_l;
     dst_h += 2;
     dst_l += 2;
   }
+}
+
+/* ======================================================================== */
+/** 
+ * Join bytes. (Reverse the separate_bytes operation).
+ * @param src The source array of bytes (to be joined from groups).
+ * @param dst The destination array of words.
+ * @param last Value of the last byte (before separation).
+ * @param length The number of words in the source array.
+ * @param sorting_byte The byte of the words to sort by (0 or 1).
+ */
+void join_bytes(unsigned char *src, unsigned short *dst, unsigned char last,
+                int length, int sorting_byte) {
+  int count_s[NSYMBOLS];
+  int index_s[NSYMBOLS];
+  
+  // Count the bytes (the sorting bytes are in order)
+  count_bytes(src + length*sorting_byte, length, count_s);  
+  
+  // Calculate the indexes
+  calculate_byte_indexes(count_s, index_s);
 
+  // join the bytes
+  SPLIT_SPECIALIZE(sorting_byte, _join_bytes, src, dst, length, index_s)
 }
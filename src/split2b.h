@@ -19,13 +19,30 @@
 
 #include <stdlib.h>
 
+/* Default byte of the words to sort by (0 or 1): the other byte is grouped
+   by it */
+#define SPLIT_DEFAULT_SORTING_BYTE 0
+
 /** 
  * Separate bytes. 
  * @param src The source array of words (to be separated into groups).
  * @param dst The destination array of bytes.
  * @param length The number of words in the source array.
+ * @param sorting_byte The byte of the words to sort by (0 or 1).
+ */
+void separate_bytes(unsigned short *src, unsigned char *dst, int length,
+                    int sorting_byte);
+
+/** 
+ * Separate bytes in the same array (the result is the same as the
+ * destination array of separate_bytes).
+ * @param data The array of words (to be separated into groups of bytes).
+ * @param tmp A temporary array of length bytes.
+ * @param length The number of words in the data array.
+ * @param sorting_byte The byte of the words to sort by (0 or 1).
  */
-void separate_bytes(unsigned short *src, unsigned char *dst, int length);
+void separate_bytes_inplace(unsigned short *data, unsigned char *tmp,
+                            int length, int sorting_byte);
 
 /** 
  * Join bytes. (Reverse the separate_bytes operation).
@@ -33,9 +50,10 @@ void separate_bytes(unsigned short *src, unsigned char *dst, int length);
  * @param dst The destination array of words.
  * @param last Value of the last byte (before separation).
  * @param length The number of words in the source array.
+ * @param sorting_byte The byte of the words to sort by (0 or 1).
  */
 void join_bytes(unsigned char *src, unsigned short *dst, unsigned char last,
-                int length);
+                int length, int sorting_byte);
 
 
 #endif
\ No newline at end of file
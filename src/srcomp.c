@@ -18,42 +18,113 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
-#include <libiberty/libiberty.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "srz.h"
+#include "wseparator.h"
+#include "mem.h"
 
 #define DEFAULT_BLOCK_SIZE 1
-#define INTERNAL_VERSION 1
-#define USE_CHECKSUM
-
-#ifdef USE_CHECKSUM
-#include <libiberty/libiberty.h>
-#endif
 
 #define BASE_BLOCK_SIZE 1024
+#define MAX_THREADS 256
+#define AUTO_BLOCK_SIZE -1
+#define AUTO_SAMPLE_SIZE (8*1024*1024)
+#define MAX_TRAIN_SIZE (64*1024*1024)
+
+/* Maximum size (in kilobytes) of a segment of linked blocks (every thread
+   reads a whole segment) */
+#define MAX_SEGMENT_SIZE (1024*1024)
+
+/* Maximum ratio between the decompressed and the compressed data (a bit of
+   the codes is at least one word) */
+#define MAX_RATIO 16
+
+/* Operation modes */
+#define MODE_DECOMPRESS 0
+#define MODE_COMPRESS   1
+#define MODE_TRAIN      2
+
+/**
+ * Input data (the data already read is consumed before the file).
+ */
+typedef struct {
+    FILE *file;
+    unsigned char *buffer;
+    size_t length;
+    size_t position;
+} sr_input;
 
 /**
- * File header.
+ * Block compression job (a segment of linked blocks, from a reset point to
+ * the next one).
  */
 typedef struct {
-    unsigned char magic_number[2];
-    unsigned char version;
-    unsigned char use_previous_byte;
-    unsigned short block_size;
-} sr_header;
+    unsigned short *src;
+    unsigned char *dst;
+    size_t read;
+    size_t block_size;
+    int blocks;
+    int node;
+    srz_params params;
+    srz_stats stats;
+    srz_context *context;
+    srz_block_header *block_headers;
+    int status;
+} sr_job;
 
 /**
- * Block header.
+ * Compression level preset.
  */
 typedef struct {
-    size_t length;
-    size_t compressed_length;
-#ifdef USE_CHECKSUM	
-    unsigned int checksum;
-#endif	
-    unsigned short last_word;
-    unsigned char last_byte;
-} sr_block_header;
+    int block_size;
+    bool use_previous_byte;
+    int context_mode;
+    int context_bits;
+    int threads;          /* 0 means one thread per online processor. */
+    int streams;
+    int transform;
+    int chunk_size;
+    bool split_bytes;
+    bool word_mtf;
+} sr_level;
+
+/**
+ * Block sizes (in kilobytes) tried by the automatic block size selection.
+ */
+static const int auto_block_sizes[] = { 64, 256, 1024, 4096 };
+
+/**
+ * Compression levels (from the fastest to the best compression), measured
+ * with bench/levels.sh in a single core. The word MTF of the levels 5 to 9
+ * is the slowest stage that still improves the ratio of text (the other
+ * rank transforms are slower and compress less than it). The bigger levels
+ * use less threads to limit the memory usage.
+ */
+static const sr_level levels[] = {
+  /* 1 */ {  1024, false, WS_CONTEXT_WORD,  WS_HASH_DEFAULT_BITS, 0,
+             1, MTF_TRANSFORM_MTF, 0, false, false },
+  /* 2 */ {  4096, true,  WS_CONTEXT_WORD,  WS_HASH_DEFAULT_BITS, 0,
+             1, MTF_TRANSFORM_MTF, 0, false, false },
+  /* 3 */ { 16384, true,  WS_CONTEXT_HASH3, 14,                   4,
+             1, MTF_TRANSFORM_MTF, 0, false, false },
+  /* 4 */ { 16384, true,  WS_CONTEXT_HASH3, 16,                   4,
+             1, MTF_TRANSFORM_MTF, 0, false, false },
+  /* 5 */ {  4096, false, WS_CONTEXT_WORD,  WS_HASH_DEFAULT_BITS, 0,
+             1, MTF_TRANSFORM_MTF, 0, false, true },
+  /* 6 */ {  4096, true,  WS_CONTEXT_WORD,  WS_HASH_DEFAULT_BITS, 0,
+             1, MTF_TRANSFORM_MTF, 0, false, true },
+  /* 7 */ { 16384, true,  WS_CONTEXT_WORD,  WS_HASH_DEFAULT_BITS, 4,
+             1, MTF_TRANSFORM_MTF, 0, false, true },
+  /* 8 */ { 32768, true,  WS_CONTEXT_HASH3, 15,                   2,
+             1, MTF_TRANSFORM_MTF, 0, false, true },
+  /* 9 */ { 65536, true,  WS_CONTEXT_HASH3, 16,                   1,
+             1, MTF_TRANSFORM_MTF, 0, false, true },
+};
 
 /* ======================================================================== */
 /** 
@@ -63,130 +134,509 @@ void usage() {
   fprintf(stdout, "USAGE: srcomp [c|d] -i <input_file> -o <output_file> \n");
   fprintf(stdout, " -h           print this message.\n");
   fprintf(stdout, " -c           compress.\n");
+  fprintf(stdout, " -1 .. -9     compression level (fastest .. best).\n");
   fprintf(stdout, " -d           decompress.\n");
   fprintf(stdout, " -p           use previous data to compress more.\n");    
   fprintf(stdout, " -i <file>    specify the input file.\n");
   fprintf(stdout, " -o <file>    specify the output file.\n");    
-  fprintf(stdout, " -b <size>    specify the block size (in kilobytes).\n");
+  fprintf(stdout, " -b <size>    specify the block size (in kilobytes) or"
+          " auto.\n");
+  fprintf(stdout, " --target-mbps <speed>\n");
+  fprintf(stdout, "              specify the target compression speed (in"
+          " MB/s) of -b auto\n");
+  fprintf(stdout, "              (only with -b auto).\n");
+  fprintf(stdout, " -m <ctx>     specify the context used to group the words:\n");
+  fprintf(stdout, "              byte, word (default), hash3 or hash4.\n");
+  fprintf(stdout, " -g <bits>    specify the number of groups (in bits) of the\n");
+  fprintf(stdout, "              hashed contexts (%i-%i, default %i).\n",
+          WS_HASH_MIN_BITS, WS_HASH_MAX_BITS, WS_HASH_DEFAULT_BITS);
+  fprintf(stdout, " -t <num>     specify the number of threads (0 = one per"
+          " processor).\n");
+  fprintf(stdout, " -L <num>     link the blocks (their state is kept) with a"
+          " reset point\n");
+  fprintf(stdout, "              every <num> blocks (0 = independent"
+          " blocks, up to %iM\n", MAX_SEGMENT_SIZE / 1024);
+  fprintf(stdout, "              between reset points).\n");
+  fprintf(stdout, " --streams <num>\n");
+  fprintf(stdout, "              split the codes of every block into <num>"
+          " interleaved streams\n");
+  fprintf(stdout, "              (1-%i, faster decompression).\n",
+          SRZ_MAX_STREAMS);
+  fprintf(stdout, " --split-bytes\n");
+  fprintf(stdout, "              code the high and low bytes of the words"
+          " separately.\n");
+  fprintf(stdout, " --transform <name>\n");
+  fprintf(stdout, "              specify the rank transform of the bytes:"
+          " mtf (default),\n");
+  fprintf(stdout, "              mtf1, mtf2 or wfc.\n");
+  fprintf(stdout, " --sorting-byte <num>\n");
+  fprintf(stdout, "              specify the byte of the words that groups the"
+          " other one\n");
+  fprintf(stdout, "              (0 = first byte (default), 1 = second"
+          " byte).\n");
+  fprintf(stdout, " --chunk-size <size>\n");
+  fprintf(stdout, "              code the bytes of every block in independent"
+          " chunks of <size>\n");
+  fprintf(stdout, "              kilobytes (1-%i, 0 = the whole block).\n",
+          SRZ_MAX_CHUNK_SIZE);
+  fprintf(stdout, " --min-savings <percent>\n");
+  fprintf(stdout, "              store the blocks that don't save at least"
+          " <percent> of their\n");
+  fprintf(stdout, "              size (0-99, their coding stops as soon as"
+          " they can't).\n");
+  fprintf(stdout, " --output-buffer <size>\n");
+  fprintf(stdout, "              decompress every block through an output"
+          " buffer of <size>\n");
+  fprintf(stdout, "              kilobytes (0 = the whole block"
+          " (default)). Only the\n");
+  fprintf(stdout, "              output is bounded: the compressed block"
+          " and the decoded\n");
+  fprintf(stdout, "              words still take the block size.\n");
+  fprintf(stdout, " --word-mtf   code the words with a 16-bit MTF (wide"
+          " characters).\n");
+  fprintf(stdout, " --train      train a dictionary with the input data"
+          " (with -p, -m, -g).\n");
+  fprintf(stdout, " -D <file>    use a trained dictionary (it sets -p, -m"
+          " and -g).\n");
+  fprintf(stdout, " --stats      print the time spent in every stage"
+          " (if enabled at build time).\n");
   fprintf(stdout, "\n");
   fprintf(stdout, "Version " VERSION "\n");
   fprintf(stdout, "Copyright (C) 2022 Abraham Macias Paredes.\n");  
   fprintf(stdout, "GNU General Public License v3.\n");  
 }
 
+/* ======================================================================== */
+/** 
+ * Reads data from the input.
+ * @param input The input data.
+ * @param dst The destination array.
+ * @param length The number of bytes to read.
+ * @return The number of bytes read.
+ */
+size_t read_input(sr_input *input, void *dst, size_t length) {
+  size_t read = 0;
+  
+  // Consume the data already read
+  if (input->position < input->length) {
+    read = input->length - input->position;
+    if (read > length) {
+      read = length;
+    }
+    memcpy(dst, input->buffer + input->position, read);
+    input->position += read;
+  }
+  
+  if (read < length) {
+    read += fread(((unsigned char *) dst) + read, 1, length - read,
+                  input->file);
+  }
+  
+  return read;
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the current time.
+ * @return The current time (in seconds).
+ */
+double get_time() {
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ======================================================================== */
+/** 
+ * Chooses the block size by compressing a sample of the input with every
+ * candidate block size. The sample is kept in the input to be compressed.
+ * @param input The input data.
+ * @param params The compression parameters.
+ * @param target_mbps The minimum compression speed (in MB/s) or 0 to
+ *                    choose the best compression.
+ * @param threads Number of blocks compressed at the same time.
+ * @return The block size (in kilobytes) or a negative number in case of
+ *         an error.
+ */
+int choose_block_size(sr_input *input, const srz_params *params,
+                      double target_mbps, int threads) {
+  int ncandidates = sizeof(auto_block_sizes) / sizeof(int);
+  int best, fastest, bs, c, l, padding;
+  double start, speed, fastest_speed;
+#ifdef DEBUG
+  double best_speed = 0;
+#endif
+  size_t offset, read, cl, total, best_total;
+  unsigned short *src;
+  unsigned char *dst, last_byte;
+  srz_params sample_params;
+  
+  // The sample compression is not profiled
+  sample_params = *params;
+  sample_params.stats = NULL;
+  sample_params.state = NULL;
+  
+  // Read the sample
+  input->buffer = (unsigned char *) malloc(AUTO_SAMPLE_SIZE);
+  if (input->buffer == NULL) {
+    perror("Error allocating memory\n");
+    return -1;
+  }
+  input->length = fread(input->buffer, 1, AUTO_SAMPLE_SIZE, input->file);
+  input->position = 0;
+  
+  if (input->length == 0) {
+    return DEFAULT_BLOCK_SIZE;
+  }
+  
+  // A small input fits in a single block
+  if (input->length < auto_block_sizes[0] * BASE_BLOCK_SIZE) {
+    return (input->length + BASE_BLOCK_SIZE - 1) / BASE_BLOCK_SIZE;
+  }
+  
+  bs = auto_block_sizes[ncandidates-1] * BASE_BLOCK_SIZE;
+  src = (unsigned short *) malloc(bs);
+  dst = (unsigned char *) malloc(compress_block_bound(bs>>1));
+  if (src == NULL || dst == NULL) {
+    perror("Error allocating memory\n");
+    free(src);
+    free(dst);
+    return -1;
+  }
+
+  best = -1;
+  best_total = 0;
+  fastest = -1;
+  fastest_speed = 0;
+  for (c = 0; c < ncandidates; c++) {
+    // The sample must fill at least one block (but one candidate is
+    // always tried)
+    bs = auto_block_sizes[c] * BASE_BLOCK_SIZE;
+    if (c > 0 && bs > input->length) {
+      break;
+    }
+    
+    total = 0;
+    start = get_time();
+    for (offset = 0; offset < input->length; offset += read) {
+      read = input->length - offset;
+      if (read > bs) {
+        read = bs;
+      }
+      memcpy(src, input->buffer + offset, read);
+      
+      padding = 0;
+      if ( (read & 1) == 1 ) {
+        padding = 1;
+        ((unsigned char *)src)[read] = 0;
+      }
+      l = ((read+padding) >> 1);
+
+      cl = compress_block(src, dst, l, &last_byte, &sample_params);
+      // (A block that can't be sampled counts as stored)
+      total += (cl == SRZ_NOT_COMPRESSED || cl == (size_t) -1) ? read : cl;
+    }
+    
+    speed = (input->length / 1048576.0) / (get_time() - start + 1e-9);
+    speed *= threads;
+    
+    // Best compression (that is fast enough)
+    if ((target_mbps <= 0 || speed >= target_mbps)
+        && (best < 0 || total < best_total)) {
+      best = c;
+      best_total = total;
+#ifdef DEBUG
+      best_speed = speed;
+#endif
+    }
+    
+    if (fastest < 0 || speed > fastest_speed) {
+      fastest = c;
+      fastest_speed = speed;
+    }
+  }
+  
+  free(src);
+  free(dst);
+  
+#ifdef DEBUG
+  if (best >= 0) {
+    fprintf(stderr, "Block size: %iK (%.1f MB/s)\n", auto_block_sizes[best],
+            best_speed);
+  }
+#endif
+  
+  // If none of them is fast enough choose the fastest one
+  if (best < 0) {
+    best = fastest;
+  }
+  
+  return auto_block_sizes[best];
+}
+
+/* ======================================================================== */
+/** 
+ * Compresses the data blocks of a job.
+ * @param job The block compression job.
+ * @return 0 if everything goes OK.
+ */
+int compress_job(sr_job *job) {
+  size_t offset, read, bs, cbs;
+  int b;
+
+  bs = job->block_size;
+  cbs = compress_block_bound(bs>>1);
+  
+  // Every segment starts at a reset point
+  srz_state_reset(job->params.state);
+  
+  for (b = 0, offset = 0; offset < job->read; b++, offset += read) {
+    read = job->read - offset;
+    if (read > bs) {
+      read = bs;
+    }
+    
+    if (srz_compress_frame_block(job->src + (offset>>1), read,
+                                 job->dst + b*cbs, &job->block_headers[b],
+                                 &job->params) != 0) {
+      return -1;
+    }
+  }
+  
+  job->blocks = b;
+  job->status = 0;
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Compression thread.
+ * @param arg The block compression job.
+ * @return NULL.
+ */
+void *compress_thread(void *arg) {
+  sr_job *job = (sr_job *) arg;
+  
+  // Run near the memory of the job
+  if (job->node >= 0) {
+    mem_run_on_node(job->node);
+  }
+  
+  compress_job(job);
+  return NULL;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the compression jobs.
+ * @param jobs The block compression jobs.
+ * @param threads The number of jobs.
+ * @param bs The block size (in bytes).
+ * @param link The number of blocks of every job.
+ */
+void free_jobs(sr_job *jobs, int threads, int bs, int link) {
+  int t;
+  
+  for (t = 0; t < threads; t++) {
+    mem_free(jobs[t].src, (size_t) bs * link);
+    mem_free(jobs[t].dst, compress_block_bound(bs>>1) * link);
+    free(jobs[t].block_headers);
+    srz_context_free(jobs[t].context);
+  }
+  free(jobs);
+}
+
 /* ======================================================================== */
 /** 
  * Compress the input file into the output file.
- * @param infile Input file.
+ * @param input Input data.
  * @param outfile Output file.
- * @param block_size Block size (in megabytes).
- * @param use_previous_byte Use the data to compress more.
+ * @param block_size Block size (in kilobytes).
+ * @param params The compression parameters.
+ * @param threads Number of segments compressed at the same time.
+ * @param link Number of linked blocks between reset points (0 or 1 for
+ *             independent blocks).
  * @return 0 if everything goes OK.
  */
-int compress_data(FILE *infile, FILE *outfile, int block_size,
-                  bool use_previous_byte) {
-  sr_header header;
-  sr_block_header block_header;
-  size_t cl, read;
-  int bs, l, padding;
-  unsigned short *src;
-  unsigned char *dst;
+int compress_data(sr_input *input, FILE *outfile, int block_size,
+                  const srz_params *params, int threads, int link) {
+  srz_header header;
+  sr_job *jobs;
+  pthread_t *tids;
+  size_t cl, cbs;
+  long header_position;
+  int bs, t, n, b, nodes, link_blocks;
+  bool eof;
+
+  // Every job compresses a segment of linked blocks
+  link_blocks = link;
+  if (link < 1) {
+    link = 1;
+  }
 
   // Allocate memory
   bs = block_size * BASE_BLOCK_SIZE;
-  src = (unsigned short *) malloc(bs);
-  if (src == NULL) {
+  cbs = compress_block_bound(bs>>1);
+  jobs = (sr_job *) calloc(threads, sizeof(sr_job));
+  if (jobs == NULL) {
     perror("Error allocating memory\n");
     return -1;
   }
+  
+  // The jobs are spread among the NUMA nodes (with their memory)
+  nodes = mem_numa_nodes();
+  for (t = 0; t < threads; t++) {
+    // Every job has its own profiling counters
+    jobs[t].params = *params;
+    if (params->stats != NULL) {
+      jobs[t].params.stats = &jobs[t].stats;
+    }
+    jobs[t].node = (threads > 1 && nodes > 1) ? (t % nodes) : -1;
+    jobs[t].block_size = bs;
+    jobs[t].src = (unsigned short *) mem_alloc((size_t) bs * link,
+                                               jobs[t].node);
+    jobs[t].dst = (unsigned char *) mem_alloc(cbs * link, jobs[t].node);
+    jobs[t].block_headers = (srz_block_header *) calloc(link,
+                                                       sizeof(srz_block_header));
+    jobs[t].context = srz_context_alloc(bs);
+    if (jobs[t].src == NULL || jobs[t].dst == NULL
+        || jobs[t].block_headers == NULL || jobs[t].context == NULL) {
+      perror("Error allocating memory\n");
+      free_jobs(jobs, threads, bs, link);
+      return -1;
+    }
     
-  dst = (unsigned char *) malloc(bs<<1);  // dst array size = bs*2
-  if (dst == NULL) {
+    // The work buffers (and the state of the linked blocks) are reused
+    jobs[t].params.context = jobs[t].context;
+    if (link > 1) {
+      jobs[t].params.state = jobs[t].context->state;
+    }
+  }
+  
+  tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  if (tids == NULL) {
     perror("Error allocating memory\n");
-    free(src);
+    free_jobs(jobs, threads, bs, link);
     return -1;
   }
 
   // Write the file header
-  memset(&header, 0, sizeof(header));
-  header.magic_number[0] = 'S';
-  header.magic_number[1] = 'R';
-  header.version = INTERNAL_VERSION;
-  header.use_previous_byte = use_previous_byte;
-  header.block_size = block_size;
+  srz_init_header(&header, block_size, params);
+  header.link_blocks = link_blocks;
 
+  // (The content size is written at the end if the output is seekable)
+  header_position = ftell(outfile);
   if (fwrite(&header, sizeof(header), 1, outfile) != 1) {
     perror("Error writing file header");
-    free(src);
-    free(dst);
+    free(tids);
+    free_jobs(jobs, threads, bs, link);
     return -1;
   }
 
-  // Code each block
-  read = fread(src, 1, bs, infile);
-  while (read > 0) {
-    // If the number of bytes read is odd we need 1 byte of padding
-    padding = 0;
-    if ( (read & 1) == 1 ) {
-      padding = 1;
-      ((unsigned char *)src)[read + 1] = 0;
+  // Code the blocks (one segment per thread at a time)
+  header.content_size = 0;
+  eof = false;
+  while (!eof) {
+    // Read the next segments to compress
+    for (n = 0; n < threads; n++) {
+      jobs[n].read = read_input(input, jobs[n].src, (size_t) bs * link);
+      jobs[n].blocks = 0;
+      if (jobs[n].read < (size_t) bs * link) {
+        eof = true;
+        if (jobs[n].read > 0) {
+          n++;
+        }
+        break;
+      }
     }
-    l = ((read+padding) >> 1);
-    
-    // Compress block
-    block_header.length = read;
-#ifdef USE_CHECKSUM	  
-    block_header.checksum = xcrc32((unsigned char *) src, read, 0x80000000);
-#endif	  
-    block_header.last_word = src[l-1];
-    
-    cl = compress_block(src, dst, l, &block_header.last_byte, use_previous_byte);
-
-    if (cl < 0) {
-      fprintf(stderr, "Error compressing data block!\n");
-      free(src);
-      free(dst);      
-      return -1;        
-    }    
     
-    // If the data can't be compressed, just store it
-    if (cl >= read) {
-      memcpy(dst, src, read);
-      cl = read;
+    if (ferror(input->file))  {
+      perror("Error reading input data");
+      free(tids);
+      free_jobs(jobs, threads, bs, link);
+      return -1;
     }
     
-    block_header.compressed_length = cl;
+    // Compress the blocks
+    for (t = 0; t < n; t++) {
+      jobs[t].status = -1;
+    }
     
-    // Write block header
-    if (fwrite(&block_header, sizeof(block_header), 1, outfile) != 1) {
-      perror("Error writing block header");
-      free(src);
-      free(dst);      
-      return -1;
+    if (n == 1) {
+      compress_job(&jobs[0]);
+    }
+    else {
+      for (t = 0; t < n; t++) {
+        if (pthread_create(&tids[t], NULL, compress_thread, &jobs[t]) != 0) {
+          // Compress it in this thread
+          tids[t] = pthread_self();
+          compress_job(&jobs[t]);
+        }
+      }
+      
+      for (t = 0; t < n; t++) {
+        if (!pthread_equal(tids[t], pthread_self())) {
+          pthread_join(tids[t], NULL);
+        }
+      }
     }
     
-    // Write compressed block
-    if (fwrite(dst, 1, cl, outfile) != cl) {
-      perror("Error writing data to output file");
-      free(src);
-      free(dst);      
-      return -1;
-    }    
+    // Write the blocks in order
+    for (t = 0; t < n; t++) {
+      if (jobs[t].status != 0) {
+        free(tids);
+        free_jobs(jobs, threads, bs, link);
+        return -1;
+      }
+      
+      for (b = 0; b < jobs[t].blocks; b++) {
+        // Write block header
+        if (fwrite(&jobs[t].block_headers[b], sizeof(srz_block_header), 1,
+                   outfile) != 1) {
+          perror("Error writing block header");
+          free(tids);
+          free_jobs(jobs, threads, bs, link);
+          return -1;
+        }
+        
+        // Write compressed block
+        cl = jobs[t].block_headers[b].compressed_length;
+        if (fwrite(jobs[t].dst + b*cbs, 1, cl, outfile) != cl) {
+          perror("Error writing data to output file");
+          free(tids);
+          free_jobs(jobs, threads, bs, link);
+          return -1;
+        }
+        
+        header.content_size += jobs[t].block_headers[b].length;
+        header.block_count++;
+      }
+    }
+  }
   
-    // read next block to compress
-    read = fread(src, 1, bs, infile);
+  // Rewrite the file header with the content size
+  if (header_position >= 0
+      && fseek(outfile, header_position, SEEK_SET) == 0) {
+    if (fwrite(&header, sizeof(header), 1, outfile) != 1
+        || fseek(outfile, 0, SEEK_END) != 0) {
+      perror("Error writing file header");
+      free(tids);
+      free_jobs(jobs, threads, bs, link);
+      return -1;
+    }
   }
   
-  if (read < 0)  {
-    perror("Error reading input data");
-    free(src);
-    free(dst);
-    return -1;
+  // Add the profiling counters of the jobs
+  if (params->stats != NULL) {
+    for (t = 0; t < threads; t++) {
+      srz_stats_merge(params->stats, &jobs[t].stats);
+    }
   }
   
   // Release memory
-  free(src);
-  free(dst);
+  free(tids);
+  free_jobs(jobs, threads, bs, link);
     
   return 0;
 }
@@ -194,56 +644,129 @@ int compress_data(FILE *infile, FILE *outfile, int block_size,
 
 /* ======================================================================== */
 /** 
- * Decompress the input file into the output file.
- * @param infile Input file.
+ * Reserves the space of the decompressed data in the output file (if it is
+ * a regular file), so it isn't fragmented. The size of the header is not
+ * trusted: it must fit in its blocks and in the size of the input file.
+ * @param infile Input file (after the file header).
  * @param outfile Output file.
- * @return 0 if everything goes OK.
+ * @param header The file header (already checked).
+ * @return true if the space was reserved.
  */
-int decompress_data(FILE *infile, FILE *outfile) {
-  sr_header header;
-  sr_block_header block_header;
-  size_t decompressed_length, read;
-  int bs, l, cl;
-  unsigned char *src;
-  unsigned short *dst;
-  int block_size;
-  bool use_previous_byte;
+bool preallocate_output(FILE *infile, FILE *outfile,
+                        const srz_header *header) {
+#ifdef HAVE_POSIX_FALLOCATE
+  struct stat st;
+  unsigned long long size;
+  long position;
+  int fd;
+  
+  size = header->content_size;
+  if (size == SRZ_UNKNOWN_SIZE || size == 0 || header->block_count == 0
+      || (size - 1) / header->block_count
+         >= (unsigned long long) header->block_size * BASE_BLOCK_SIZE) {
+    return false;
+  }
+  
+  // (The compressed data of a pipe can't be measured)
+  position = ftell(infile);
+  if (position < 0 || fstat(fileno(infile), &st) != 0
+      || !S_ISREG(st.st_mode) || st.st_size < position
+      || size / MAX_RATIO > (unsigned long long) (st.st_size - position)) {
+    return false;
+  }
+  
+  fd = fileno(outfile);
+  position = ftell(outfile);
+  if (position < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  
+  // (It is only an optimization, so the errors are ignored)
+  return posix_fallocate(fd, position, size) == 0;
+#else
+  return false;
+#endif
+}
 
-  // Read the file header
-  if (fread(&header, sizeof(header), 1, infile) != 1) {
-    perror("Error reading file header");
-    return -1;
+/* ======================================================================== */
+/** 
+ * Releases the space reserved in the output file after the data that was
+ * written.
+ * @param outfile Output file.
+ */
+void truncate_output(FILE *outfile) {
+  long position;
+  
+  fflush(outfile);
+  position = ftell(outfile);
+  if (position >= 0 && ftruncate(fileno(outfile), position) != 0) {
+    perror("Error truncating output file");
   }
+}
 
-  // Check the magic number
-  if (header.magic_number[0] != 'S' || header.magic_number[1] != 'R') {
-    fprintf(stderr, "Bad magic number!\n");
+/* ======================================================================== */
+/** 
+ * Writes a piece of a decompressed block into the output file.
+ * @param data The piece of data.
+ * @param length The number of bytes of the piece.
+ * @param opaque The output file.
+ * @return 0 if everything goes OK.
+ */
+int write_output(const void *data, size_t length, void *opaque) {
+  if (fwrite(data, 1, length, (FILE *) opaque) != length) {
+    perror("Error writing data to output file");
     return -1;
   }
+  return 0;
+}
 
-  // Check the version
-  if (header.version != INTERNAL_VERSION) {
-    fprintf(stderr, "Wrong version!\n");
-    return -1;
-  }    
-  
-  use_previous_byte = header.use_previous_byte;
-  block_size = header.block_size;      
-    
-  // Allocate memory
-  bs = block_size * BASE_BLOCK_SIZE;
-  src = (unsigned char *) malloc(bs<<1); // source array size = bs*2
-  if (src == NULL) {
+/* ======================================================================== */
+/** 
+ * Decompress the blocks of the input file into the output file.
+ * @param infile Input file (after the file header).
+ * @param outfile Output file.
+ * @param header The file header (already checked).
+ * @param params The decompression parameters.
+ * @param output_buffer The size (in kilobytes) of the output buffer of the
+ *                      blocks (0 = the whole block).
+ * @return 0 if everything goes OK.
+ */
+int decompress_blocks(FILE *infile, FILE *outfile, const srz_header *header,
+                      srz_params *params, int output_buffer) {
+  srz_block_header block_header;
+  srz_context *context;
+  unsigned short *buffer;
+  unsigned long long blocks, total;
+  size_t read, cl, bs, bl;
+
+  // Allocate memory (the buffers are reused by every block)
+  bs = header->block_size * BASE_BLOCK_SIZE;
+  context = srz_context_alloc(bs);
+  if (context == NULL) {
     perror("Error allocating memory\n");
     return -1;
   }
-    
-  dst = (unsigned short *) malloc(bs);
-  if (dst == NULL) {
-    perror("Error allocating memory\n");
-    free(src);
-    return -1;
+  params->context = context;
+  
+  // The blocks are written in pieces through a small output buffer (only
+  // the output is bounded, the other work buffers still take a block)
+  buffer = NULL;
+  bl = ((size_t) output_buffer * 1024) >> 1;
+  if (bl > 0 && bl < (bs >> 1)) {
+    buffer = (unsigned short *) malloc(bl * sizeof(unsigned short));
+    if (buffer == NULL) {
+      perror("Error allocating memory\n");
+      srz_context_free(context);
+      return -1;
+    }
   }
+  
+  // The linked blocks keep the state of the previous one
+  if (header->link_blocks > 1) {
+    params->state = context->state;
+  }
+  blocks = 0;
+  total = 0;
 
   // Read the block header
   read = fread(&block_header, sizeof(block_header), 1, infile);
@@ -251,71 +774,159 @@ int decompress_data(FILE *infile, FILE *outfile) {
   while (read > 0) {
     cl = block_header.compressed_length;    
     
+    // Check the block header (the data must fit in the buffers)
+    if (block_header.length < 1 || block_header.length > bs
+        || block_header.compressed_length > block_header.length) {
+      fprintf(stderr, "Wrong block header!\n");
+      free(buffer);
+      srz_context_free(context);
+      return -1;
+    }
+    
     // Read input data
-    if (fread(src, 1, cl, infile) != cl) {
+    if (fread(context->data, 1, cl, infile) != cl) {
       perror("Error reading input data");
-      free(src);
-      free(dst);      
+      free(buffer);
+      srz_context_free(context);
       return -1;
     }
     
-    if (cl == block_header.length) {
-      // The data is not compressed
-      memcpy(dst, src, block_header.length);
+    // Every segment of linked blocks starts at a reset point
+    if (header->link_blocks > 1 && (blocks % header->link_blocks) == 0) {
+      srz_state_reset(params->state);
     }
-    else {
-    // Decompress the data
-      l = (block_header.length >> 1) + (block_header.length & 1);
-      decompressed_length = decompress_block(src, dst, block_header.last_word,
-                       block_header.last_byte, l, use_previous_byte);  
-
-      if (decompressed_length < 0) {
-        fprintf(stderr, "Error decompressing data block!\n");
-        free(src);
-        free(dst);      
-        return -1;        
+    
+    // Decompress the data (and check the checksum) and write it into the
+    // output file
+    if (buffer != NULL) {
+      if (srz_decompress_frame_block_stream(context->data, buffer, bl,
+                                            &block_header, params,
+                                            write_output, outfile) != 0) {
+        free(buffer);
+        srz_context_free(context);
+        return -1;
       }
     }
-    
-
-    
-#ifdef USE_CHECKSUM	  
-    // Check the checksum
-    if (block_header.checksum != xcrc32(
-          (unsigned char *) dst, block_header.length, 0x80000000)) {
-      fprintf(stderr, "Bad checksum!\n");
-      free(src);
-      free(dst);      
-      return -1;        
-    }
-#endif	  
-      
-    // Write the decompressed block data into the output file
-    if (fwrite(dst, 1, block_header.length, outfile) != block_header.length) {
-      perror("Error writing data to output file");
-      free(src);
-      free(dst);       
-      return -1;
+    else {
+      if (srz_decompress_frame_block(context->data, context->block,
+                                     &block_header, params) != 0
+          || write_output(context->block, block_header.length,
+                          outfile) != 0) {
+        free(buffer);
+        srz_context_free(context);
+        return -1;
+      }
     }
+    total += block_header.length;
   
     // Read the next block header
+    blocks++;
     read = fread(&block_header, sizeof(block_header), 1, infile);    
   }
   
-  if (read < 0) {
+  if (ferror(infile)) {
     perror("Error reading block header");
-    free(src);
-    free(dst);    
+    free(buffer);
+    srz_context_free(context);
     return -1;
   }
 
   // Release memory
-  free(src);
-  free(dst);
+  free(buffer);
+  srz_context_free(context);
+  
+  // Check the content size (the file can be truncated)
+  if (header->content_size != SRZ_UNKNOWN_SIZE
+      && (total != header->content_size || blocks != header->block_count)) {
+    fprintf(stderr, "Wrong content size!\n");
+    return -1;
+  }
     
   return 0;
 }
 
+/* ======================================================================== */
+/** 
+ * Decompress the input file into the output file.
+ * @param infile Input file.
+ * @param outfile Output file.
+ * @param stats Profiling counters (or NULL).
+ * @param dict The dictionary (or NULL).
+ * @param output_buffer The size (in kilobytes) of the output buffer of the
+ *                      blocks (0 = the whole block).
+ * @return 0 if everything goes OK.
+ */
+int decompress_data(FILE *infile, FILE *outfile, srz_stats *stats,
+                    const srz_dict *dict, int output_buffer) {
+  srz_header header;
+  srz_params params;
+  bool reserved;
+  int ret;
+
+  // Read the file header
+  if (fread(&header, sizeof(header), 1, infile) != 1) {
+    perror("Error reading file header");
+    return -1;
+  }
+  
+  // Check the file header (the file can be corrupted)
+  srz_default_params(&params);
+  params.stats = stats;
+  if (srz_check_header(&header, dict, &params) != 0) {
+    return -1;
+  }
+  
+  // Reserve the space of the output file (and release the space of the
+  // data that isn't written if the decompression fails)
+  reserved = preallocate_output(infile, outfile, &header);
+  ret = decompress_blocks(infile, outfile, &header, &params, output_buffer);
+  if (ret != 0 && reserved) {
+    truncate_output(outfile);
+  }
+  
+  return ret;
+}
+
+/* ======================================================================== */
+/** 
+ * Trains a dictionary with the input data.
+ * @param infile Input file (the sample data).
+ * @param outfile Output file (the dictionary).
+ * @param params The compression parameters.
+ * @return 0 if everything goes OK.
+ */
+int train_dictionary(FILE *infile, FILE *outfile, const srz_params *params) {
+  unsigned char *sample;
+  srz_dict *dict;
+  size_t length;
+  int ret;
+  
+  sample = (unsigned char *) malloc(MAX_TRAIN_SIZE);
+  if (sample == NULL) {
+    perror("Error allocating memory\n");
+    return -1;
+  }
+  
+  // (Only the beginning of a big input is used)
+  length = fread(sample, 1, MAX_TRAIN_SIZE, infile);
+  if (ferror(infile)) {
+    perror("Error reading input data");
+    free(sample);
+    return -1;
+  }
+  
+  dict = srz_train(sample, length, params);
+  free(sample);
+  if (dict == NULL) {
+    return -1;
+  }
+  
+  ret = srz_dict_save(dict, outfile);
+  srz_dict_free(dict);
+  
+  return ret;
+}
+
 /* ======================================================================== */
 /** 
  * Main program.
@@ -325,28 +936,81 @@ int decompress_data(FILE *infile, FILE *outfile) {
  */
 int main(int argc, char *argv[]) {
   int compress = -1;
-  int block_size = DEFAULT_BLOCK_SIZE;
-  bool use_previous_byte = false;
+  int block_size = 0;
+  int threads = -1;
+  int level = 0;
+  int context_mode = -1;
+  int context_bits = 0;
+  int streams = 0;
+  int transform = -1;
+  int chunk_size = -1;
+  int link = 0;
+  int output_buffer = 0;
+  double target_mbps = 0;
+  bool print_stats = false;
+  srz_dict *dict = NULL;
+  FILE *dictfile;
+  srz_stats stats;
+  srz_params params;
+  sr_input input;
   FILE *infile, *outfile;
-  int opt;
+  int opt, ret;
+  static const struct option long_options[] = {
+    { "target-mbps", required_argument, NULL, 'T' },
+    { "stats", no_argument, NULL, 'S' },
+    { "train", no_argument, NULL, 'R' },
+    { "dict", required_argument, NULL, 'D' },
+    { "link", required_argument, NULL, 'L' },
+    { "streams", required_argument, NULL, 'N' },
+    { "split-bytes", no_argument, NULL, 'B' },
+    { "word-mtf", no_argument, NULL, 'W' },
+    { "transform", required_argument, NULL, 'F' },
+    { "sorting-byte", required_argument, NULL, 'Y' },
+    { "chunk-size", required_argument, NULL, 'K' },
+    { "output-buffer", required_argument, NULL, 'O' },
+    { "min-savings", required_argument, NULL, 'M' },
+    { NULL, 0, NULL, 0 }
+  };
 
   infile = stdin;
   outfile = stdout;
+  srz_default_params(&params);
 
   // Check the arguments
-  while ((opt = getopt(argc, argv, "hcdpi:o:b:")) != -1) {
+  while ((opt = getopt_long(argc, argv, "hcdp123456789i:o:b:m:g:t:D:L:",
+                            long_options, NULL)) != -1) {
     switch (opt) {
+      case '1': case '2': case '3': case '4': case '5':
+      case '6': case '7': case '8': case '9':
+        level = opt - '0';
+        break;
       case 'h':
         usage();
         return 0;
       case 'c':
-        compress = 1;
+        compress = MODE_COMPRESS;
         break;
       case 'd':
-        compress = 0;
+        compress = MODE_DECOMPRESS;
+        break;
+      case 'R':
+        compress = MODE_TRAIN;
+        break;
+      case 'D':
+        if ( (dictfile = fopen(optarg, "rb")) == NULL) {
+          fprintf(stderr, "Error opening dictionary file: %s ", optarg);
+          perror(":");
+          return -1;
+        }
+        srz_dict_free(dict);
+        dict = srz_dict_load(dictfile);
+        fclose(dictfile);
+        if (dict == NULL) {
+          return -1;
+        }
         break;
       case 'p':
-        use_previous_byte = true;
+        params.use_previous_byte = true;
         break;
       case 'i':
         if ( (infile = fopen(optarg, "rb")) == NULL) {
@@ -363,6 +1027,10 @@ int main(int argc, char *argv[]) {
         }
         break;            
       case 'b':
+        if (strcmp(optarg, "auto") == 0) {
+          block_size = AUTO_BLOCK_SIZE;
+          break;
+        }
         block_size = atoi(optarg);
         if (block_size < 1 || block_size > 65536) {
           fprintf(stderr, "Wrong block size: %s (must be between 1K and 65536K)\n",
@@ -370,6 +1038,125 @@ int main(int argc, char *argv[]) {
           return -1;
         }
         break;
+      case 'm':
+        if (strcmp(optarg, "byte") == 0) {
+          context_mode = WS_CONTEXT_BYTE;
+        }
+        else if (strcmp(optarg, "word") == 0) {
+          context_mode = WS_CONTEXT_WORD;
+        }
+        else if (strcmp(optarg, "hash3") == 0) {
+          context_mode = WS_CONTEXT_HASH3;
+        }
+        else if (strcmp(optarg, "hash4") == 0) {
+          context_mode = WS_CONTEXT_HASH4;
+        }
+        else {
+          fprintf(stderr, "Wrong context: %s (must be byte, word, hash3"
+                  " or hash4)\n", optarg);
+          return -1;
+        }
+        break;
+      case 'g':
+        context_bits = atoi(optarg);
+        if (context_bits < WS_HASH_MIN_BITS
+            || context_bits > WS_HASH_MAX_BITS) {
+          fprintf(stderr, "Wrong number of groups: %s (must be between %i"
+                  " and %i bits)\n", optarg, WS_HASH_MIN_BITS,
+                  WS_HASH_MAX_BITS);
+          return -1;
+        }
+        break;
+      case 'T':
+        target_mbps = atof(optarg);
+        if (target_mbps <= 0) {
+          fprintf(stderr, "Wrong target speed: %s (must be greater than 0)\n",
+                  optarg);
+          return -1;
+        }
+        break;
+      case 'S':
+        if (!srz_stats_enabled()) {
+          fprintf(stderr, "The profiling counters are not available (build"
+                  " with ./configure --enable-stats)\n");
+          return -1;
+        }
+        print_stats = true;
+        break;
+      case 'L':
+        link = atoi(optarg);
+        if (link < 0 || link > SRZ_MAX_LINK_BLOCKS) {
+          fprintf(stderr, "Wrong number of linked blocks: %s (must be between"
+                  " 0 and %i)\n", optarg, SRZ_MAX_LINK_BLOCKS);
+          return -1;
+        }
+        break;
+      case 'N':
+        streams = atoi(optarg);
+        if (streams < 1 || streams > SRZ_MAX_STREAMS) {
+          fprintf(stderr, "Wrong number of streams: %s (must be between 1"
+                  " and %i)\n", optarg, SRZ_MAX_STREAMS);
+          return -1;
+        }
+        break;
+      case 'B':
+        params.split_bytes = true;
+        break;
+      case 'W':
+        params.word_mtf = true;
+        break;
+      case 'F':
+        for (transform = 0; transform < MTF_TRANSFORMS; transform++) {
+          if (strcmp(optarg, mtf_transforms[transform].name) == 0) {
+            break;
+          }
+        }
+        if (transform == MTF_TRANSFORMS) {
+          fprintf(stderr, "Wrong rank transform: %s (must be mtf, mtf1, mtf2"
+                  " or wfc)\n", optarg);
+          return -1;
+        }
+        break;
+      case 'Y':
+        params.sorting_byte = atoi(optarg);
+        if (params.sorting_byte < 0 || params.sorting_byte > 1) {
+          fprintf(stderr, "Wrong sorting byte: %s (must be 0 or 1)\n",
+                  optarg);
+          return -1;
+        }
+        break;
+      case 'K':
+        chunk_size = atoi(optarg);
+        if (chunk_size < 0 || chunk_size > SRZ_MAX_CHUNK_SIZE) {
+          fprintf(stderr, "Wrong chunk size: %s (must be between 0 and %i)\n",
+                  optarg, SRZ_MAX_CHUNK_SIZE);
+          return -1;
+        }
+        break;
+      case 'M':
+        params.min_savings = atoi(optarg);
+        if (params.min_savings < 0 || params.min_savings > 99) {
+          fprintf(stderr, "Wrong minimum savings: %s (must be between 0"
+                  " and 99)\n", optarg);
+          return -1;
+        }
+        break;
+      case 'O':
+        output_buffer = atoi(optarg);
+        if (output_buffer < 0 || output_buffer > 65536) {
+          fprintf(stderr, "Wrong output buffer size: %s (must be between 0"
+                  " and 65536)\n", optarg);
+          return -1;
+        }
+        break;
+      case 't':
+        threads = atoi(optarg);
+        if (threads < 0 || threads > MAX_THREADS) {
+          fprintf(stderr, "Wrong number of threads: %s (must be between 0"
+                  " and %i)\n", optarg, MAX_THREADS);
+          return -1;
+        }
+        break;
       default:
         fprintf(stderr, "Unknown option: %c\n", opt);
         usage();
@@ -383,11 +1170,128 @@ int main(int argc, char *argv[]) {
     usage();
     return -1;  
   }
+  
+  // (The target speed is only used to choose the block size)
+  if (target_mbps > 0 && block_size != AUTO_BLOCK_SIZE) {
+    fprintf(stderr, "The target speed (--target-mbps) needs -b auto\n");
+    return -1;
+  }
+
+  // The explicit options take precedence over the compression level
+  if (level > 0) {
+    if (block_size == 0) {
+      block_size = levels[level-1].block_size;
+    }
+    if (levels[level-1].use_previous_byte) {
+      params.use_previous_byte = true;
+    }
+    if (context_mode < 0) {
+      context_mode = levels[level-1].context_mode;
+      if (context_bits == 0) {
+        context_bits = levels[level-1].context_bits;
+      }
+    }
+    if (threads < 0) {
+      threads = levels[level-1].threads;
+    }
+    // (The byte stages given explicitly replace the word MTF of the level)
+    if (levels[level-1].word_mtf && transform < 0 && chunk_size < 0
+        && !params.split_bytes) {
+      params.word_mtf = true;
+    }
+    if (levels[level-1].split_bytes && !params.word_mtf) {
+      params.split_bytes = true;
+    }
+    if (streams == 0) {
+      streams = levels[level-1].streams;
+    }
+    if (transform < 0) {
+      transform = levels[level-1].transform;
+    }
+    if (chunk_size < 0) {
+      chunk_size = levels[level-1].chunk_size;
+    }
+  }
+  
+  if (block_size == 0) {
+    block_size = DEFAULT_BLOCK_SIZE;
+  }
+  if (context_mode >= 0) {
+    params.context_mode = context_mode;
+  }
+  if (context_bits > 0) {
+    params.context_bits = context_bits;
+  }
+  if (streams > 0) {
+    params.streams = streams;
+  }
+  if (transform >= 0) {
+    params.transform = transform;
+  }
+  if (chunk_size >= 0) {
+    params.chunk_size = chunk_size;
+  }
+  if (threads < 0) {
+    threads = 1;
+  }
+  if (threads == 0) {
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+      threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+    }
+  }
+
+  if (print_stats) {
+    srz_stats_reset(&stats);
+    params.stats = &stats;
+  }
+  
+  // The dictionary can only be used with its own parameters
+  if (dict != NULL) {
+    params.use_previous_byte = dict->use_previous_byte;
+    params.context_mode = dict->context_mode;
+    params.context_bits = dict->context_bits;
+    params.dict = dict;
+  }
 
-  if (compress) {
-    return compress_data(infile, outfile, block_size, use_previous_byte);
+  if (compress == MODE_TRAIN) {
+    ret = train_dictionary(infile, outfile, &params);
+  }
+  else if (compress == MODE_COMPRESS) {
+    memset(&input, 0, sizeof(input));
+    input.file = infile;
+    
+    if (block_size == AUTO_BLOCK_SIZE) {
+      block_size = choose_block_size(&input, &params, target_mbps, threads);
+      if (block_size < 0) {
+        free(input.buffer);
+        return -1;
+      }
+    }
+    
+    if ((long long) block_size * link > MAX_SEGMENT_SIZE) {
+      fprintf(stderr, "Too many linked blocks: %i blocks of %iK (a segment"
+              " can't be bigger than %iM)\n", link, block_size,
+              MAX_SEGMENT_SIZE / 1024);
+      free(input.buffer);
+      return -1;
+    }
+    
+    ret = compress_data(&input, outfile, block_size, &params, threads, link);
+    free(input.buffer);
   }
   else {
-    return decompress_data(infile, outfile);
+    ret = decompress_data(infile, outfile, params.stats, dict,
+                          output_buffer);
   }
+  
+  if (print_stats && ret == 0) {
+    srz_stats_print(stderr, &stats);
+  }
+  
+  srz_dict_free(dict);
+  return ret;
 }
@@ -18,143 +18,2448 @@
 #include "bitm.h"
 #include "split2b.h"
 #include "wseparator.h"
+#include "mem.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <libiberty/libiberty.h>
+
+/* The profiling counters are compiled out unless SRZ_STATS is defined */
+#ifdef SRZ_STATS
+#define STATS_TIMER(t) double t = 0;
+#define STATS_START(params, t) \
+  if ((params)->stats != NULL) { \
+    t = _srz_get_time(); \
+  }
+#define STATS_STAGE(params, stage, t, nbytes) \
+  if ((params)->stats != NULL) { \
+    double now = _srz_get_time(); \
+    (params)->stats->seconds[stage] += now - t; \
+    (params)->stats->bytes[stage] += nbytes; \
+    t = now; \
+  }
+#define STATS_ADD(params, counter, n) \
+  if ((params)->stats != NULL) { \
+    (params)->stats->counter += n; \
+  }
+#else
+#define STATS_TIMER(t)
+#define STATS_START(params, t)
+#define STATS_STAGE(params, stage, t, nbytes)
+#define STATS_ADD(params, counter, n)
+#endif
+
+/* Dictionary file */
+#define DICT_VERSION 1
+
+/* Elements of the table of a block coded as several parts (the length of
+   the group sizes and of every part) */
+#define SRZ_PARTS_TABLE(parts) ((parts) + 1)
+
+/* Flag of the parts of a block that are stored without coding */
+#define SRZ_RAW_PART 0x80000000U
+
+/* Number of symbols coded between two checks of the output budget */
+#define SRZ_BUDGET_CHECK 4096
+
+/* FNV-1a hash (dictionary identifiers) */
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+/**
+ * Dictionary file header.
+ */
+typedef struct {
+  unsigned char magic_number[2];
+  unsigned char version;
+  unsigned char use_previous_byte;
+  unsigned char context_mode;
+  unsigned char context_bits;
+  unsigned short previous;
+  unsigned short previous2;
+  unsigned int groups;
+  unsigned int id;
+} dict_header;
+
+static const char *stage_names[SRZ_STAGES] = {
+  "separate_words", "separate_bytes", "mtf_code", "eg_code", "eg_decode",
+  "mtf_decode", "join_bytes", "join_words"
+};
+
+#ifdef SRZ_STATS
+/* ======================================================================== */
+/** 
+ * Gets the current time.
+ * @return The current time (in seconds).
+ */
+static double _srz_get_time() {
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ======================================================================== */
+/** 
+ * Adds the MTF ranks of a block to the histogram.
+ * @param stats The profiling counters.
+ * @param ranks The MTF ranks.
+ * @param length The number of ranks.
+ */
+static void _srz_stats_ranks(srz_stats *stats, unsigned char *ranks,
+                             size_t length) {
+  size_t i;
+  
+  for (i = 0; i < length; i++) {
+    stats->mtf_ranks[ranks[i]]++;
+  }
+}
+#endif
+
+/* ======================================================================== */
+/** 
+ * Sets the default compression parameters.
+ * @param params The parameters to initialize.
+ */
+void srz_default_params(srz_params *params) {
+  memset(params, 0, sizeof(srz_params));
+  params->use_previous_byte = false;
+  params->context_mode = WS_CONTEXT_WORD;
+  params->context_bits = WS_HASH_DEFAULT_BITS;
+  params->streams = 1;
+  params->split_bytes = false;
+  params->word_mtf = false;
+  params->transform = MTF_TRANSFORM_MTF;
+  params->sorting_byte = SPLIT_DEFAULT_SORTING_BYTE;
+  params->chunk_size = 0;
+  params->min_savings = 0;
+  params->stats = NULL;
+  params->dict = NULL;
+  params->state = NULL;
+}
+
+/* ======================================================================== */
+/** 
+ * Checks if the library records the profiling counters.
+ * @return true if the library was built with SRZ_STATS.
+ */
+bool srz_stats_enabled() {
+#ifdef SRZ_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* ======================================================================== */
+/** 
+ * Resets the profiling counters.
+ * @param stats The counters to reset.
+ */
+void srz_stats_reset(srz_stats *stats) {
+  memset(stats, 0, sizeof(srz_stats));
+}
+
+/* ======================================================================== */
+/** 
+ * Adds some profiling counters to other ones.
+ * @param dst The counters to update.
+ * @param src The counters to add.
+ */
+void srz_stats_merge(srz_stats *dst, const srz_stats *src) {
+  int i;
+  
+  for (i = 0; i < SRZ_STAGES; i++) {
+    dst->seconds[i] += src->seconds[i];
+    dst->bytes[i] += src->bytes[i];
+  }
+  for (i = 0; i < SRZ_MTF_RANKS; i++) {
+    dst->mtf_ranks[i] += src->mtf_ranks[i];
+  }
+  dst->eg_bits += src->eg_bits;
+  dst->eg_symbols += src->eg_symbols;
+  dst->blocks += src->blocks;
+  dst->stored_blocks += src->stored_blocks;
+  dst->checksum_seconds += src->checksum_seconds;
+  dst->checksum_bytes += src->checksum_bytes;
+}
+
+/* ======================================================================== */
+/** 
+ * Prints a summary of the profiling counters.
+ * @param out The output file.
+ * @param stats The counters to print.
+ */
+void srz_stats_print(FILE *out, const srz_stats *stats) {
+  double total, mb;
+  size_t ranks, low;
+  int i;
+  
+  total = stats->checksum_seconds;
+  for (i = 0; i < SRZ_STAGES; i++) {
+    total += stats->seconds[i];
+  }
+  if (total <= 0) {
+    total = 1e-9;
+  }
+  
+  fprintf(out, "%-16s %10s %12s %10s %7s\n", "stage", "seconds", "bytes",
+          "MB/s", "time");
+  for (i = 0; i <= SRZ_STAGES; i++) {
+    const char *name = (i < SRZ_STAGES) ? stage_names[i] : "checksum";
+    double seconds = (i < SRZ_STAGES) ? stats->seconds[i] :
+                     stats->checksum_seconds;
+    size_t bytes = (i < SRZ_STAGES) ? stats->bytes[i] :
+                   stats->checksum_bytes;
+    
+    if (bytes == 0) {
+      continue;
+    }
+    mb = bytes / 1048576.0;
+    fprintf(out, "%-16s %10.4f %12lu %10.1f %6.1f%%\n", name, seconds,
+            (unsigned long) bytes, mb / (seconds + 1e-9),
+            seconds * 100 / total);
+  }
+  
+  fprintf(out, "blocks: %lu (%lu stored)\n", (unsigned long) stats->blocks,
+          (unsigned long) stats->stored_blocks);
+  
+  if (stats->eg_symbols > 0) {
+    fprintf(out, "Elias-Gamma: %.3f bits per symbol\n",
+            (double) stats->eg_bits / stats->eg_symbols);
+  }
+  
+  ranks = 0;
+  for (i = 0; i < SRZ_MTF_RANKS; i++) {
+    ranks += stats->mtf_ranks[i];
+  }
+  if (ranks > 0) {
+    // The small ranks are the most frequent ones
+    fprintf(out, "MTF ranks:");
+    low = 0;
+    for (i = 0; i < 8; i++) {
+      fprintf(out, " %i:%.1f%%", i, stats->mtf_ranks[i] * 100.0 / ranks);
+      low += stats->mtf_ranks[i];
+    }
+    fprintf(out, " >=8:%.1f%%\n", (ranks - low) * 100.0 / ranks);
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the number of groups (in bits) of the hashed contexts of a
+ * data block (they never use more groups than words in the block). The
+ * other modes don't use it.
+ * @param params The compression parameters.
+ * @param length The number of words in the block.
+ * @return The number of groups (in bits).
+ */
+static int _srz_ws_bits(const srz_params *params, size_t length) {
+  int bits;
+  
+  bits = params->context_bits;
+  if (!ws_stores_counts(params->context_mode)
+      || bits < WS_HASH_MIN_BITS || bits > WS_HASH_MAX_BITS) {
+    return bits;
+  }
+  while (bits > WS_HASH_MIN_BITS && ((size_t) 1 << bits) > length) {
+    bits--;
+  }
+  
+  return bits;
+}
+
+/* ======================================================================== */
+/** 
+ * Allocates the word separator context for a data block.
+ * @param params The compression parameters.
+ * @param length The number of words in the block.
+ * @return A ws_context structure (or NULL in case of error).
+ */
+static ws_context *_srz_ws_alloc(const srz_params *params, size_t length) {
+  return ws_alloc(params->context_mode, _srz_ws_bits(params, length));
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the word MTF status of a block: the status of the previous linked
+ * block (it is updated in place), the one of the work buffers or a new one.
+ * @param params The compression parameters.
+ * @return The word MTF status (or NULL in case of error).
+ */
+static mtf16_status *_srz_mtf16_get(const srz_params *params) {
+  srz_state *state = params->state;
+  srz_context *context = params->context;
+  mtf16_status *status;
+  
+  if (state != NULL) {
+    if (state->mtf16 == NULL) {
+      state->mtf16 = mtf16_alloc();
+      if (state->mtf16 != NULL) {
+        mtf16_reset(state->mtf16);
+      }
+    }
+    else if (!state->valid) {
+      mtf16_reset(state->mtf16);
+    }
+    return state->mtf16;
+  }
+  
+  if (context != NULL) {
+    if (context->mtf16 == NULL) {
+      context->mtf16 = mtf16_alloc();
+    }
+    status = context->mtf16;
+  }
+  else {
+    status = mtf16_alloc();
+  }
+  
+  if (status != NULL) {
+    mtf16_reset(status);
+  }
+  
+  return status;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the word MTF status of a block (if it was allocated for it).
+ * @param params The compression parameters.
+ * @param status The word MTF status.
+ */
+static void _srz_mtf16_release(const srz_params *params,
+                               mtf16_status *status) {
+  if (params->state == NULL
+      && (params->context == NULL || params->context->mtf16 != status)) {
+    mtf16_free(status);
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the word separator context of a block (the one of the work buffers
+ * if it has the same groups).
+ * @param params The compression parameters.
+ * @param length The number of words in the block.
+ * @return A ws_context structure (or NULL in case of error).
+ */
+static ws_context *_srz_ws_get(const srz_params *params, size_t length) {
+  srz_context *context = params->context;
+  ws_context *ctx;
+  int bits;
+  
+  if (context == NULL) {
+    return _srz_ws_alloc(params, length);
+  }
+  
+  bits = _srz_ws_bits(params, length);
+  ctx = context->ws;
+  if (ctx == NULL || ctx->mode != params->context_mode
+      || (ws_stores_counts(ctx->mode) && ctx->bits != bits)) {
+    ws_free(ctx);
+    context->ws = ws_alloc(params->context_mode, bits);
+  }
+  
+  return context->ws;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the word separator context of a block (unless it belongs to the
+ * work buffers).
+ * @param params The compression parameters.
+ * @param ctx The word separator context.
+ */
+static void _srz_ws_release(const srz_params *params, ws_context *ctx) {
+  if (params->context == NULL || params->context->ws != ctx) {
+    ws_free(ctx);
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the temporary array of a block (the one of the work buffers if it
+ * is big enough).
+ * @param params The compression parameters.
+ * @param length The number of words in the block.
+ * @return The temporary array (or NULL in case of error).
+ */
+static unsigned short *_srz_tmp_get(const srz_params *params, size_t length) {
+  if (params->context != NULL && (length<<1) <= params->context->block_size) {
+    return params->context->words;
+  }
+  
+  return (unsigned short *) mem_alloc(length<<1, -1);
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the temporary array of a block (unless it belongs to the work
+ * buffers).
+ * @param params The compression parameters.
+ * @param tmp The temporary array.
+ * @param length The number of words in the block.
+ */
+static void _srz_tmp_release(const srz_params *params, unsigned short *tmp,
+                             size_t length) {
+  if (params->context == NULL || params->context->words != tmp) {
+    mem_free(tmp, length<<1);
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the hash of some data.
+ * @param hash The hash of the previous data.
+ * @param data The data.
+ * @param length The length (in bytes) of the data.
+ * @return The hash.
+ */
+static unsigned int _srz_hash(unsigned int hash, const void *data,
+                              size_t length) {
+  const unsigned char *bytes = (const unsigned char *) data;
+  size_t i;
+  
+  for (i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  
+  return hash;
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the identifier of a dictionary.
+ * @param dict The dictionary.
+ * @return The identifier (never 0).
+ */
+static unsigned int _srz_dict_id(const srz_dict *dict) {
+  unsigned int hash = FNV_OFFSET;
+  unsigned char params[3];
+  
+  params[0] = dict->use_previous_byte;
+  params[1] = dict->context_mode;
+  params[2] = dict->context_bits;
+  hash = _srz_hash(hash, params, sizeof(params));
+  hash = _srz_hash(hash, dict->mtf_order, SRZ_MTF_RANKS);
+  hash = _srz_hash(hash, &dict->previous, sizeof(unsigned short));
+  hash = _srz_hash(hash, &dict->previous2, sizeof(unsigned short));
+  if (dict->groups > 0) {
+    hash = _srz_hash(hash, dict->median, dict->groups);
+  }
+  
+  return (hash != 0) ? hash : 1;
+}
+
+/* ======================================================================== */
+/** 
+ * Sets the initial state of a block (from the previous block or the
+ * dictionary).
+ * @param params The compression parameters.
+ * @param ctx The word separator context.
+ * @param status The MTF status (of the high and low bytes).
+ */
+static void _srz_prime(const srz_params *params, ws_context *ctx,
+                       mtf_status *status) {
+  const srz_dict *dict = params->dict;
+  srz_state *state = params->state;
+  
+  if (state != NULL && state->valid) {
+    memcpy(status, state->mtf, sizeof(state->mtf));
+    ws_prime(ctx, params->use_previous_byte ? state->median : NULL,
+             state->groups, state->previous, state->previous2);
+    return;
+  }
+  
+  mtf_reset(&status[0]);
+  mtf_reset(&status[1]);
+  ws_prime(ctx, NULL, 0, 0, 0);
+  if (dict == NULL) {
+    return;
+  }
+  
+  mtf_set_order(&status[0], dict->mtf_order);
+  mtf_set_order(&status[1], dict->mtf_order);
+  
+  // (The median table is only valid for the same groups)
+  ws_prime(ctx, (params->use_previous_byte && dict->context_mode == ctx->mode)
+                ? dict->median : NULL,
+           dict->groups, dict->previous, dict->previous2);
+}
+
+/* ======================================================================== */
+/** 
+ * Saves the state at the end of a block (for the next linked block).
+ * @param params The compression parameters.
+ * @param ctx The word separator context (after the block).
+ * @param status The MTF status of the high and low bytes (after the
+ *               block).
+ * @param previous The last word of the block.
+ * @param previous2 The word before the last one.
+ * @return 0 if everything goes OK.
+ */
+static int _srz_save_state(const srz_params *params, ws_context *ctx,
+                           mtf_status *status, unsigned short previous,
+                           unsigned short previous2) {
+  srz_state *state = params->state;
+  unsigned char *median;
+  
+  if (state == NULL) {
+    return 0;
+  }
+  
+  state->valid = false;
+  if (params->use_previous_byte) {
+    if (state->groups != ctx->groups) {
+      median = (unsigned char *) realloc(state->median, ctx->groups);
+      if (median == NULL) {
+        perror("Error allocating memory\n");
+        return -1;
+      }
+      state->median = median;
+      state->groups = ctx->groups;
+    }
+    ws_get_median(ctx, state->median);
+  }
+  
+  memcpy(state->mtf, status, sizeof(state->mtf));
+  state->previous = previous;
+  state->previous2 = previous2;
+  state->valid = true;
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Gets the size of the decompressed data of a file.
+ * @param src The beginning of the file (at least the file header).
+ * @param length The number of bytes of src.
+ * @param size The size of the decompressed data (or SRZ_UNKNOWN_SIZE if the
+ *             file doesn't store it, like the files written to a pipe).
+ * @return 0 if everything goes OK (-1 if src isn't a valid file header).
+ */
+int srz_get_decompressed_size(const void *src, size_t length,
+                              unsigned long long *size) {
+  srz_header header;
+  
+  if (src == NULL || length < sizeof(header)) {
+    return -1;
+  }
+  
+  memcpy(&header, src, sizeof(header));
+  if (header.magic_number[0] != 'S' || header.magic_number[1] != 'R'
+      || header.version != SRZ_VERSION) {
+    return -1;
+  }
+  
+  *size = header.content_size;
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Allocates the state of linked blocks (the next block is independent).
+ * @return The state (or NULL in case of error).
+ */
+srz_state *srz_state_alloc() {
+  return (srz_state *) calloc(1, sizeof(srz_state));
+}
+
+/* ======================================================================== */
+/** 
+ * Resets the state of linked blocks (the next block will be independent,
+ * a reset point).
+ * @param state The state to reset.
+ */
+void srz_state_reset(srz_state *state) {
+  if (state == NULL) {
+    return;
+  }
+  
+  state->valid = false;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the state of linked blocks.
+ * @param state The state to release.
+ */
+void srz_state_free(srz_state *state) {
+  if (state == NULL) {
+    return;
+  }
+  
+  free(state->median);
+  mtf16_free(state->mtf16);
+  free(state);
+}
+
+/* ======================================================================== */
+/** 
+ * Trains a dictionary with some sample data.
+ * @param sample The sample data.
+ * @param length The length (in bytes) of the sample data.
+ * @param params The compression parameters (the dictionary can only be used
+ *               with the same parameters).
+ * @return The dictionary (or NULL in case of error).
+ */
+srz_dict *srz_train(const unsigned char *sample, size_t length,
+                    const srz_params *params) {
+  srz_dict *dict;
+  ws_context *ctx;
+  unsigned short *words, *tmp;
+  size_t count[SRZ_MTF_RANKS], l, i;
+  int j, k, s;
+  
+  // (The last byte of an odd sample is discarded)
+  l = length >> 1;
+  if (l < 2) {
+    fprintf(stderr, "The sample data is too small!\n");
+    return NULL;
+  }
+  
+  dict = (srz_dict *) calloc(1, sizeof(srz_dict));
+  ctx = ws_alloc(params->context_mode, params->context_bits);
+  words = (unsigned short *) mem_alloc(l<<1, -1);
+  tmp = (unsigned short *) mem_alloc(l<<1, -1);
+  if (dict == NULL || ctx == NULL || words == NULL || tmp == NULL) {
+    perror("Error allocating memory\n");
+    free(dict);
+    ws_free(ctx);
+    mem_free(words, l<<1);
+    mem_free(tmp, l<<1);
+    return NULL;
+  }
+  
+  memcpy(words, sample, l<<1);
+  dict->use_previous_byte = params->use_previous_byte;
+  dict->context_mode = params->context_mode;
+  dict->context_bits = params->context_bits;
+  dict->previous = words[l-1];
+  dict->previous2 = words[l-2];
+  
+  // The median table left by the sample
+  separate_words(words, tmp, l, params->use_previous_byte, ctx);
+  if (params->use_previous_byte) {
+    dict->groups = ctx->groups;
+    dict->median = (unsigned char *) malloc(ctx->groups);
+    if (dict->median == NULL) {
+      perror("Error allocating memory\n");
+      srz_dict_free(dict);
+      dict = NULL;
+    }
+    else {
+      ws_get_median(ctx, dict->median);
+    }
+  }
+  
+  if (dict != NULL) {
+    // The most frequent bytes (after the separation) are in front
+    separate_bytes_inplace(tmp, (unsigned char *) words, l,
+                           params->sorting_byte);
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < (l<<1); i++) {
+      count[((unsigned char *) tmp)[i]]++;
+    }
+    for (j = 0; j < SRZ_MTF_RANKS; j++) {
+      dict->mtf_order[j] = j;
+    }
+    for (j = 1; j < SRZ_MTF_RANKS; j++) {
+      s = dict->mtf_order[j];
+      for (k = j; k > 0 && count[dict->mtf_order[k-1]] < count[s]; k--) {
+        dict->mtf_order[k] = dict->mtf_order[k-1];
+      }
+      dict->mtf_order[k] = s;
+    }
+    dict->id = _srz_dict_id(dict);
+  }
+  
+  ws_free(ctx);
+  mem_free(words, l<<1);
+  mem_free(tmp, l<<1);
+  return dict;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases a dictionary.
+ * @param dict The dictionary to release.
+ */
+void srz_dict_free(srz_dict *dict) {
+  if (dict == NULL) {
+    return;
+  }
+  
+  free(dict->median);
+  free(dict);
+}
+
+/* ======================================================================== */
+/** 
+ * Writes a dictionary into a file.
+ * @param dict The dictionary.
+ * @param file The output file.
+ * @return 0 if everything goes OK.
+ */
+int srz_dict_save(const srz_dict *dict, FILE *file) {
+  dict_header header;
+  
+  memset(&header, 0, sizeof(header));
+  header.magic_number[0] = 'S';
+  header.magic_number[1] = 'D';
+  header.version = DICT_VERSION;
+  header.use_previous_byte = dict->use_previous_byte;
+  header.context_mode = dict->context_mode;
+  header.context_bits = dict->context_bits;
+  header.previous = dict->previous;
+  header.previous2 = dict->previous2;
+  header.groups = dict->groups;
+  header.id = dict->id;
+  
+  if (fwrite(&header, sizeof(header), 1, file) != 1
+      || fwrite(dict->mtf_order, SRZ_MTF_RANKS, 1, file) != 1
+      || (dict->groups > 0
+          && fwrite(dict->median, dict->groups, 1, file) != 1)) {
+    perror("Error writing dictionary");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Reads a dictionary from a file.
+ * @param file The input file.
+ * @return The dictionary (or NULL in case of error).
+ */
+srz_dict *srz_dict_load(FILE *file) {
+  dict_header header;
+  srz_dict *dict;
+  ws_context *ctx;
+  
+  if (fread(&header, sizeof(header), 1, file) != 1) {
+    perror("Error reading dictionary");
+    return NULL;
+  }
+  
+  if (header.magic_number[0] != 'S' || header.magic_number[1] != 'D'
+      || header.version != DICT_VERSION) {
+    fprintf(stderr, "Wrong dictionary!\n");
+    return NULL;
+  }
+  
+  // The median table must match the groups of the context
+  ctx = ws_alloc(header.context_mode, header.context_bits);
+  if (ctx == NULL || (header.groups != 0 && header.groups != ctx->groups)) {
+    fprintf(stderr, "Wrong dictionary!\n");
+    ws_free(ctx);
+    return NULL;
+  }
+  ws_free(ctx);
+  
+  dict = (srz_dict *) calloc(1, sizeof(srz_dict));
+  if (dict == NULL) {
+    perror("Error allocating memory\n");
+    return NULL;
+  }
+  dict->use_previous_byte = header.use_previous_byte;
+  dict->context_mode = header.context_mode;
+  dict->context_bits = header.context_bits;
+  dict->previous = header.previous;
+  dict->previous2 = header.previous2;
+  dict->groups = header.groups;
+  
+  if (dict->groups > 0) {
+    dict->median = (unsigned char *) malloc(dict->groups);
+    if (dict->median == NULL) {
+      perror("Error allocating memory\n");
+      srz_dict_free(dict);
+      return NULL;
+    }
+  }
+  
+  if (fread(dict->mtf_order, SRZ_MTF_RANKS, 1, file) != 1
+      || (dict->groups > 0
+          && fread(dict->median, dict->groups, 1, file) != 1)) {
+    perror("Error reading dictionary");
+    srz_dict_free(dict);
+    return NULL;
+  }
+  
+  // (The identifier also detects corrupted dictionaries)
+  dict->id = _srz_dict_id(dict);
+  if (dict->id != header.id) {
+    fprintf(stderr, "Corrupted dictionary!\n");
+    srz_dict_free(dict);
+    return NULL;
+  }
+  
+  return dict;
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the size of the destination array of compress_block (the data
+ * that can't be compressed into less bytes than its own size is stored).
+ * @param length The number of words in the source array.
+ * @return The size (in bytes) of the destination array.
+ */
+size_t compress_block_bound(size_t length) {
+  return ((length<<1) / sizeof(ELEMENT) + 1) * sizeof(ELEMENT);
+}
+
+/* ======================================================================== */
+/** 
+ * Writes the Elias-Gamma codes of the MTF symbols of a block. With several
+ * streams the symbol i is written into the stream i % streams (the streams
+ * are written one after the other, after a table with their lengths), so
+ * they can be decoded at the same time. The size of the destination array
+ * is the output budget: the coding stops as soon as the codes don't fit.
+ * @param symbols The MTF symbols (bytes or words).
+ * @param n The number of symbols.
+ * @param wide The symbols are words (word MTF ranks).
+ * @param ctx The word separator context (with the group sizes) or NULL if
+ *            the group sizes are not written.
+ * @param dst The destination array.
+ * @param size The size (in bytes) of the destination array.
+ * @param streams The number of streams.
+ * @return The compressed length (in elements). A length bigger than the
+ *         destination array means that the codes didn't fit.
+ */
+static size_t _srz_eg_write(const void *symbols, size_t n, bool wide,
+                            ws_context *ctx, unsigned char *dst, size_t size,
+                            int streams) {
+  const unsigned char *bytes = (const unsigned char *) symbols;
+  const unsigned short *words = (const unsigned short *) symbols;
+  ELEMENT *table = (ELEMENT *) dst;
+  bitm_array *bitma;
+  size_t capacity, position, i, end, step;
+  int g, k;
+  
+  capacity = size / sizeof(ELEMENT);
+  position = (streams > 1) ? streams : 0;
+  if (position >= capacity) {
+    return capacity + 1;
+  }
+  
+  for (k = 0; k < streams; k++) {
+    // (The bits that don't fit are not written but counted)
+    bitma = bitm_wrap(table + position, capacity - position);
+    if (bitma == NULL) {
+      return capacity + 1;
+    }
+    bitm_reset(bitma);
+    
+    if (k == 0 && ctx != NULL && ws_stores_counts(ctx->mode)) {
+      // The size of every group is needed to join the words
+      for (g = 0; g<ctx->groups; g++) {
+        bitm_write_eg(bitma, ctx->count[g] + 1);
+      }
+    }
+    
+    // (The budget is checked every SRZ_BUDGET_CHECK symbols)
+    step = (size_t) SRZ_BUDGET_CHECK * streams;
+    for (i = k; i < n && !bitm_is_full(bitma); ) {
+      end = (n - i > step) ? i + step : n;
+      if (wide) {
+        for (; i < end; i += streams) {
+          bitm_write_eg(bitma, words[i] + 1);
+        }
+      }
+      else {
+        for (; i < end; i += streams) {
+          bitm_write_eg(bitma, bytes[i] + 1);
+        }
+      }
+    }
+    
+    bitm_flush(bitma);
+    if (streams > 1 && position + bitm_get_index(bitma) <= capacity) {
+      table[k] = bitm_get_index(bitma);
+    }
+    position += bitm_get_index(bitma);
+    bitm_unwrap(bitma);
+    
+    if (position >= capacity) {
+      return capacity + 1;
+    }
+  }
+  
+  return position;
+}
+
+/* ======================================================================== */
+/** 
+ * Reads the Elias-Gamma codes of the bytes of several interleaved streams
+ * (the state of every reader is copied into local variables, so with a
+ * constant number of streams it is kept in registers and the CPU decodes
+ * the streams at the same time).
+ * @param readers The readers of the streams.
+ * @param bytes The destination array of MTF symbols.
+ * @param n The number of symbols.
+ * @param streams The number of streams.
+ * @return The bitwise OR of the symbols (negative if a code is wrong).
+ */
+static inline __attribute__((always_inline))
+int _srz_eg_read_bytes(bitm_reader *readers, unsigned char *bytes, size_t n,
+                       int streams) {
+  bitm_reader r[SRZ_MAX_STREAMS];
+  size_t i;
+  int k, c, corrupted;
+  
+#pragma GCC unroll 8
+  for (k = 0; k < streams; k++) {
+    r[k] = readers[k];
+  }
+  
+  corrupted = 0;
+  for (i = 0; i + streams <= n; i += streams) {
+#pragma GCC unroll 8
+    for (k = 0; k < streams; k++) {
+      c = bitm_reader_eg(&r[k]) - 1;
+      corrupted |= c;
+      bytes[i + k] = (unsigned char) c;
+    }
+  }
+  
+#pragma GCC unroll 8
+  for (k = 0; k < streams; k++) {
+    readers[k] = r[k];
+  }
+  
+  // (The last symbols are read from the array, so the local readers are
+  // only indexed with constants)
+  for (k = 0; i < n; i++, k++) {
+    c = bitm_reader_eg(&readers[k]) - 1;
+    corrupted |= c;
+    bytes[i] = (unsigned char) c;
+  }
+  return corrupted;
+}
+
+/* ======================================================================== */
+/** 
+ * Reads the Elias-Gamma codes of the MTF symbols of a block (the readers of
+ * the streams are independent, so the CPU can decode them at the same time).
+ * @param src The compressed data.
+ * @param size The size (in bytes) of the compressed data array.
+ * @param symbols The destination array of MTF symbols (bytes or words).
+ * @param n The number of symbols.
+ * @param wide The symbols are words (word MTF ranks).
+ * @param ctx The word separator context (the group sizes are read) or NULL
+ *            if they are not stored.
+ * @param length The number of words in the block.
+ * @param streams The number of streams.
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+static int _srz_eg_read(unsigned char *src, size_t size, void *symbols,
+                        size_t n, bool wide, ws_context *ctx, size_t length,
+                        int streams) {
+  unsigned char *bytes = (unsigned char *) symbols;
+  unsigned short *words = (unsigned short *) symbols;
+  ELEMENT *table = (ELEMENT *) src;
+  bitm_reader readers[SRZ_MAX_STREAMS];
+  size_t capacity, position, total, i;
+  int g, k, c, corrupted;
+  
+  capacity = size / sizeof(ELEMENT);
+  position = (streams > 1) ? streams : 0;
+  if (streams < 1 || streams > SRZ_MAX_STREAMS || position >= capacity) {
+    fprintf(stderr, "Corrupted data!\n");
+    return -1;
+  }
+  
+  corrupted = 0;
+  for (k = 0; k < streams; k++) {
+    total = (streams > 1) ? table[k] : capacity;
+    if (total < 1 || total > capacity - position) {
+      corrupted = -1;
+      break;
+    }
+    bitm_reader_init(&readers[k], table + position, total);
+    position += total;
+  }
+  
+  if (corrupted == 0 && ctx != NULL && ws_stores_counts(ctx->mode)) {
+    // Read the size of every group
+    total = 0;
+    for (g = 0; g<ctx->groups && total <= length; g++) {
+      c = bitm_reader_eg(&readers[0]);
+      if (c < 1) {
+        break;
+      }
+      ctx->count[g] = c - 1;
+      total += ctx->count[g];
+    }
+    
+    if (g != ctx->groups || total != length
+        || bitm_reader_overrun(&readers[0])) {
+      fprintf(stderr, "Wrong group sizes!\n");
+      return -1;
+    }
+  }
+  
+  // Read Elias-Gamma data (a wrong symbol is out of the 1-256 range, or
+  // 1-65536 for words)
+  if (corrupted == 0 && wide) {
+    for (i = 0, k = 0; i < n; i++) {
+      c = bitm_reader_eg(&readers[k]) - 1;
+      corrupted |= c;
+      words[i] = (unsigned short) c;
+      if (++k == streams) {
+        k = 0;
+      }
+    }
+  }
+  else if (corrupted == 0) {
+    // (The usual numbers of streams are constants)
+    switch (streams) {
+      case 1:
+        corrupted = _srz_eg_read_bytes(readers, bytes, n, 1);
+        break;
+      case 2:
+        corrupted = _srz_eg_read_bytes(readers, bytes, n, 2);
+        break;
+      case 4:
+        corrupted = _srz_eg_read_bytes(readers, bytes, n, 4);
+        break;
+      case 8:
+        corrupted = _srz_eg_read_bytes(readers, bytes, n, 8);
+        break;
+      default:
+        corrupted = _srz_eg_read_bytes(readers, bytes, n, streams);
+        break;
+    }
+  }
+  
+  // (The readers read zeroes after the end of their data)
+  for (k = 0; k < streams && corrupted == 0; k++) {
+    if (bitm_reader_overrun(&readers[k])) {
+      corrupted = -1;
+    }
+  }
+  
+  if (corrupted < 0
+      || corrupted > (wide ? WORD_SYMBOLS : BYTE_SYMBOLS) - 1) {
+    fprintf(stderr, "Corrupted data!\n");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Writes the MTF symbols of a block as separate parts (the high and low
+ * bytes or the entropy chunks). Every part is coded with Elias-Gamma or
+ * stored if the codes are bigger. The parts are stored after a table with
+ * the group sizes length, and the length and the SRZ_RAW_PART flag of every
+ * part.
+ * @param symbols The MTF symbols.
+ * @param n The number of symbols.
+ * @param part_length The number of symbols of every part (the last one can
+ *                    be shorter).
+ * @param ctx The word separator context (with the group sizes).
+ * @param dst The destination array.
+ * @param size The size (in bytes) of the destination array.
+ * @param streams The number of Elias-Gamma streams of every part.
+ * @return The compressed length (in elements). A length bigger than the
+ *         destination array means that the parts didn't fit.
+ */
+static size_t _srz_parts_write(const unsigned char *symbols, size_t n,
+                               size_t part_length, ws_context *ctx,
+                               unsigned char *dst, size_t size, int streams) {
+  ELEMENT *table = (ELEMENT *) dst;
+  size_t capacity, position, parts, first, length, raw, cl, h;
+  
+  capacity = size / sizeof(ELEMENT);
+  parts = (n + part_length - 1) / part_length;
+  position = SRZ_PARTS_TABLE(parts);
+  if (position >= capacity) {
+    return capacity + 1;
+  }
+  
+  // The size of every group is needed to join the words
+  table[0] = 0;
+  if (ws_stores_counts(ctx->mode)) {
+    cl = _srz_eg_write(NULL, 0, false, ctx,
+                       (unsigned char *) (table + position),
+                       (capacity - position) * sizeof(ELEMENT), 1);
+    if (cl > capacity - position) {
+      return capacity + 1;
+    }
+    table[0] = cl;
+    position += cl;
+  }
+  
+  for (h = 0; h < parts; h++) {
+    first = h * part_length;
+    length = (n - first < part_length) ? n - first : part_length;
+    raw = (length + sizeof(ELEMENT) - 1) / sizeof(ELEMENT);
+    cl = _srz_eg_write(symbols + first, length, false, NULL,
+                       (unsigned char *) (table + position),
+                       (capacity - position) * sizeof(ELEMENT), streams);
+    
+    // (The symbols are stored if the codes don't save space)
+    if (cl >= raw) {
+      if (raw > capacity - position) {
+        return capacity + 1;
+      }
+      table[position + raw - 1] = 0;
+      memcpy(table + position, symbols + first, length);
+      table[h + 1] = raw | SRZ_RAW_PART;
+      cl = raw;
+    }
+    else if (cl > capacity - position) {
+      return capacity + 1;
+    }
+    else {
+      table[h + 1] = cl;
+    }
+    position += cl;
+  }
+  
+  return position;
+}
+
+/* ======================================================================== */
+/** 
+ * Reads the MTF symbols of a block coded as separate parts (written by
+ * _srz_parts_write).
+ * @param src The compressed data.
+ * @param size The size (in bytes) of the compressed data array.
+ * @param symbols The destination array of MTF symbols.
+ * @param n The number of symbols.
+ * @param part_length The number of symbols of every part.
+ * @param ctx The word separator context (the group sizes are read).
+ * @param length The number of words in the block.
+ * @param streams The number of Elias-Gamma streams of every part.
+ * @param transform The rank transform to decode every part just after it
+ *                  is read, while it is in the cache (NULL to return the
+ *                  ranks).
+ * @param status The initial rank transform status of every part (it will
+ *               contain the status after the last part).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+static int _srz_parts_read(unsigned char *src, size_t size,
+                           unsigned char *symbols, size_t n,
+                           size_t part_length, ws_context *ctx,
+                           size_t length, int streams,
+                           const mtf_transform *transform,
+                           mtf_status *status) {
+  ELEMENT *table = (ELEMENT *) src;
+  mtf_status part_status;
+  size_t capacity, position, parts, first, part, raw, cl, h;
+  
+  capacity = size / sizeof(ELEMENT);
+  parts = (n + part_length - 1) / part_length;
+  position = SRZ_PARTS_TABLE(parts);
+  if (position >= capacity
+      || (table[0] > 0) != (ws_stores_counts(ctx->mode) != 0)
+      || table[0] > capacity - position) {
+    fprintf(stderr, "Corrupted data!\n");
+    return -1;
+  }
+  
+  // Read the size of every group
+  if (table[0] > 0) {
+    if (_srz_eg_read((unsigned char *) (table + position),
+                     table[0] * sizeof(ELEMENT), NULL, 0, false, ctx,
+                     length, 1) != 0) {
+      return -1;
+    }
+    position += table[0];
+  }
+  
+  for (h = 0; h < parts; h++) {
+    first = h * part_length;
+    part = (n - first < part_length) ? n - first : part_length;
+    raw = (part + sizeof(ELEMENT) - 1) / sizeof(ELEMENT);
+    cl = table[h + 1] & ~SRZ_RAW_PART;
+    if (cl < 1 || cl > capacity - position
+        || ((table[h + 1] & SRZ_RAW_PART) != 0 && cl != raw)) {
+      fprintf(stderr, "Corrupted data!\n");
+      return -1;
+    }
+    
+    if ((table[h + 1] & SRZ_RAW_PART) != 0) {
+      memcpy(symbols + first, table + position, part);
+    }
+    else if (_srz_eg_read((unsigned char *) (table + position),
+                          cl * sizeof(ELEMENT), symbols + first, part,
+                          false, NULL, length, streams) != 0) {
+      return -1;
+    }
+    position += cl;
+    
+    // (Every part starts from the same status, so it can be decoded alone)
+    if (transform != NULL) {
+      memcpy(&part_status, status, sizeof(mtf_status));
+      transform->decode(symbols + first, symbols + first, part, &part_status);
+    }
+  }
+  if (transform != NULL) {
+    memcpy(status, &part_status, sizeof(mtf_status));
+  }
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Counts the bits of the Elias-Gamma codes of some MTF symbols (the codes of
+ * a block can't be shorter).
+ * @param symbols The MTF symbols (bytes or words).
+ * @param n The number of symbols.
+ * @param wide The symbols are words (word MTF ranks).
+ * @return The number of bits.
+ */
+static size_t _srz_eg_bits(const void *symbols, size_t n, bool wide) {
+  const unsigned char *bytes = (const unsigned char *) symbols;
+  const unsigned short *words = (const unsigned short *) symbols;
+  size_t bits, i;
+  
+  // (The code of v has 2 * floor(log2(v)) + 1 bits)
+  bits = n;
+  if (wide) {
+    for (i = 0; i < n; i++) {
+      bits += (31 - __builtin_clz(words[i] + 1)) << 1;
+    }
+  }
+  else {
+    for (i = 0; i < n; i++) {
+      bits += (31 - __builtin_clz(bytes[i] + 1)) << 1;
+    }
+  }
+  
+  return bits;
+}
+
+/* ======================================================================== */
+/** 
+ * Codes an array of bytes with a rank transform, SRZ_BUDGET_CHECK symbols at
+ * a time, and stops as soon as their Elias-Gamma codes don't fit in the
+ * output budget.
+ * @param transform The rank transform.
+ * @param symbols The array of bytes (coded in place).
+ * @param n The number of bytes.
+ * @param raw The array is a part that can be stored (it never takes more
+ *            than a byte per symbol).
+ * @param status The coding status.
+ * @param bits The bits of the codes of the block (updated).
+ * @param max_bits The output budget (in bits).
+ * @return true if the codes still fit in the budget.
+ */
+static bool _srz_code_ranks(const mtf_transform *transform,
+                            unsigned char *symbols, size_t n, bool raw,
+                            mtf_status *status, size_t *bits,
+                            size_t max_bits) {
+  size_t i, piece, part_bits;
+  
+  // (A part that fits even if it is stored isn't counted, it takes at
+  // least a bit per symbol)
+  if (raw && *bits + (n<<3) < max_bits) {
+    transform->code(symbols, symbols, n, status);
+    *bits += n;
+    return true;
+  }
+  
+  part_bits = 0;
+  for (i = 0; i < n && *bits + part_bits < max_bits; i += piece) {
+    piece = (n - i < SRZ_BUDGET_CHECK) ? n - i : SRZ_BUDGET_CHECK;
+    transform->code(symbols + i, symbols + i, piece, status);
+    part_bits += _srz_eg_bits(symbols + i, piece, false);
+    if (raw && part_bits > (n<<3)) {
+      part_bits = n<<3;
+    }
+  }
+  *bits += part_bits;
+  
+  return *bits < max_bits;
+}
+
+/* ======================================================================== */
+/** 
+ * Compress a data block (from an array of words or a list of fragments). 
+ * @param src The source array of words (or NULL to use the fragments).
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the block in the fragments.
+ * @param dst The destination array of bytes (its size must be
+ *            compress_block_bound(length) bytes).
+ * @param length The number of words in the block.
+ * @param last_word Value of the last word (only set for the fragments).
+ * @param last_byte Value of the last byte (before second separation). 
+ * @param params The compression parameters.
+ * @return The compressed data length (in bytes, smaller than the source
+ *         array), SRZ_NOT_COMPRESSED if the data can't be compressed (or
+ *         doesn't save params->min_savings percent) or (size_t) -1 in case
+ *         of an error.
+ */
+static size_t _srz_compress(unsigned short *src, const struct iovec *iov,
+                            int iovcnt, size_t offset, unsigned char *dst,
+                            size_t length, unsigned short *last_word,
+                            unsigned char *last_byte,
+                            const srz_params *params) {
+  size_t compressed_length, budget, bits, max_bits, chunk, piece, i;
+  bool fits;
+  mtf_status status[2], chunk_status;
+  mtf16_status *mtf16;
+  const mtf_transform *transform;
+  ws_context *ctx;
+  unsigned short *tmp;
+  unsigned char *tmp_b;
+  unsigned short last[2];
+  STATS_TIMER(t)
+  
+  // Allocate resources
+  tmp = _srz_tmp_get(params, length);
+  if (tmp == NULL) {
+    perror("Error allocating memory\n");
+    return -1;
+  }
+  tmp_b = (unsigned char *) tmp;
+  
+  ctx = _srz_ws_get(params, length);
+  if (ctx == NULL) {
+    perror("Error allocating memory\n");
+    _srz_tmp_release(params, tmp, length);
+    return -1;
+  }
+  
+  _srz_prime(params, ctx, status);
+  
+  // Separate words
+  STATS_START(params, t)
+  if (src != NULL) {
+    separate_words(src, tmp, length, params->use_previous_byte, ctx);
+    last[0] = src[length - 1];
+    last[1] = (length > 1) ? src[length - 2] : ctx->previous;
+  }
+  else {
+    separate_words_iov(iov, iovcnt, offset, tmp, length,
+                       params->use_previous_byte, ctx, last);
+    *last_word = last[0];
+  }
+  *last_byte = tmp_b[(length<<1) - 1];
+  STATS_STAGE(params, SRZ_STAGE_SEPARATE_WORDS, t, length<<1)
+  
+  // Output budget (the data that doesn't save the minimum is stored). Every
+  // symbol takes at least one bit, so the rank transform can stop as soon
+  // as the codes of its ranks don't fit
+  budget = length<<1;
+  if (params->min_savings > 0 && params->min_savings < 100) {
+    budget = (length<<1) * (100 - params->min_savings) / 100;
+  }
+  max_bits = budget << 3;
+  bits = 0;
+  fits = ((params->word_mtf ? length : length<<1) < max_bits);
+  
+  if (fits && params->word_mtf) {
+    // Word MTF coding (the bytes of the words are not separated)
+    mtf16 = _srz_mtf16_get(params);
+    if (mtf16 == NULL) {
+      perror("Error allocating memory\n");
+      _srz_tmp_release(params, tmp, length);
+      _srz_ws_release(params, ctx);
+      return -1;
+    }
+    for (i = 0; i < length && bits < max_bits; i += piece) {
+      piece = (length - i < SRZ_BUDGET_CHECK) ? length - i : SRZ_BUDGET_CHECK;
+      mtf16_code(tmp + i, tmp + i, piece, mtf16);
+      bits += _srz_eg_bits(tmp + i, piece, true);
+    }
+    fits = (bits < max_bits);
+    _srz_mtf16_release(params, mtf16);
+    STATS_STAGE(params, SRZ_STAGE_MTF_CODE, t, length<<1)
+  }
+  else if (fits) {
+    // Separate bytes (the destination array is free yet)
+    separate_bytes_inplace(tmp, dst, length, params->sorting_byte);
+    STATS_STAGE(params, SRZ_STAGE_SEPARATE_BYTES, t, length<<1)
+    
+    // Rank transform (MTF by default)
+    transform = &mtf_transforms[params->transform];
+    if (params->split_bytes) {
+      fits = _srz_code_ranks(transform, tmp_b, length, true, &status[0],
+                             &bits, max_bits)
+             && _srz_code_ranks(transform, tmp_b + length, length, true,
+                                &status[1], &bits, max_bits);
+    }
+    else if (params->chunk_size > 0) {
+      // (Every chunk starts from the status of the block)
+      chunk = (size_t) params->chunk_size << 10;
+      for (i = 0; i < (length<<1) && fits; i += chunk) {
+        memcpy(&chunk_status, &status[0], sizeof(mtf_status));
+        fits = _srz_code_ranks(transform, tmp_b + i,
+                               ((length<<1) - i < chunk) ? (length<<1) - i
+                                                         : chunk,
+                               true, &chunk_status, &bits, max_bits);
+      }
+      memcpy(&status[0], &chunk_status, sizeof(mtf_status));
+    }
+    else {
+      fits = _srz_code_ranks(transform, tmp_b, length<<1, false, &status[0],
+                             &bits, max_bits);
+    }
+#ifdef SRZ_STATS
+    if (params->stats != NULL && fits) {
+      _srz_stats_ranks(params->stats, tmp_b, length<<1);
+    }
+#endif
+    STATS_STAGE(params, SRZ_STAGE_MTF_CODE, t, length<<1)
+  }
+  
+  if (!fits) {
+    // (The block is stored, so its state is not kept)
+    STATS_ADD(params, blocks, 1)
+    STATS_ADD(params, stored_blocks, 1)
+    _srz_tmp_release(params, tmp, length);
+    _srz_ws_release(params, ctx);
+    return SRZ_NOT_COMPRESSED;
+  }
+  
+  // Elias-Gamma coding (it stops as soon as the codes don't fit in the
+  // output budget)
+  if (params->word_mtf) {
+    compressed_length = _srz_eg_write(tmp, length, true, ctx, dst, budget,
+                                      params->streams);
+  }
+  else if (params->split_bytes) {
+    compressed_length = _srz_parts_write(tmp_b, length<<1, length, ctx, dst,
+                                         budget, params->streams);
+  }
+  else if (params->chunk_size > 0) {
+    compressed_length = _srz_parts_write(tmp_b, length<<1,
+                                         (size_t) params->chunk_size << 10,
+                                         ctx, dst, budget, params->streams);
+  }
+  else {
+    compressed_length = _srz_eg_write(tmp_b, length<<1, false, ctx, dst,
+                                      budget, params->streams);
+  }
+  STATS_STAGE(params, SRZ_STAGE_EG_CODE, t, length<<1)
+  STATS_ADD(params, blocks, 1)
+  if (compressed_length >= budget / sizeof(ELEMENT)) {
+    compressed_length = SRZ_NOT_COMPRESSED;
+    STATS_ADD(params, stored_blocks, 1)
+  }
+  else {
+    STATS_ADD(params, eg_bits, compressed_length * BITS_PER_ELEMENT)
+    STATS_ADD(params, eg_symbols, params->word_mtf ? length : length<<1)
+    
+    // Keep the state for the next block (if the blocks are linked)
+    compressed_length <<= 2;
+    if (_srz_save_state(params, ctx, status, last[0], last[1]) != 0) {
+      compressed_length = (size_t) -1;
+    }
+  }
+  
+  // Free resources
+  _srz_tmp_release(params, tmp, length);
+  _srz_ws_release(params, ctx);
+  
+  return compressed_length;
+}
+
 
 /* ======================================================================== */
 /** 
  * Compress a data block. 
  * @param src The source array of words (to be compressed).
- * @param dst The destination array of bytes (its size must be double the
- *            source array size).
+ * @param dst The destination array of bytes (its size must be
+ *            compress_block_bound(length) bytes).
  * @param length The number of words in the source array.
  * @param last_byte Value of the last byte (before second separation). 
- * @param use_previous_byte Use the median value of the previous byte
- *                          to achieve a better sorting.
- * @return The compressed data length (in bytes) or negative number
- *         in case of an error.  
+ * @param params The compression parameters.
+ * @return The compressed data length (in bytes, smaller than the source
+ *         array), SRZ_NOT_COMPRESSED if the data can't be compressed (or
+ *         doesn't save params->min_savings percent) or (size_t) -1 in case
+ *         of an error.
  */
 size_t compress_block(unsigned short *src, unsigned char *dst, size_t length,
-                    unsigned char *last_byte, bool use_previous_byte) {
-  bitm_array *bitma;
-  size_t compressed_length;
-  mtf_status status;
-  unsigned short *tmp0, *tmp1;
-  size_t l, i;
+                    unsigned char *last_byte, const srz_params *params) {
+  return _srz_compress(src, NULL, 0, 0, dst, length, NULL, last_byte, params);
+}
+
+/* ======================================================================== */
+/** 
+ * Compress a data block read from a list of fragments (a word can straddle
+ * two fragments).
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the block in the fragments.
+ * @param dst The destination array of bytes (its size must be
+ *            compress_block_bound(length) bytes).
+ * @param length The number of words in the block (the last byte is padded
+ *               with a 0 if the fragments end in the middle of a word).
+ * @param last_word Value of the last word (before separation).
+ * @param last_byte Value of the last byte (before second separation). 
+ * @param params The compression parameters.
+ * @return The compressed data length (in bytes, smaller than the source
+ *         data), SRZ_NOT_COMPRESSED if the data can't be compressed (or
+ *         doesn't save params->min_savings percent) or (size_t) -1 in case
+ *         of an error.
+ */
+size_t compress_block_iov(const struct iovec *iov, int iovcnt, size_t offset,
+                          unsigned char *dst, size_t length,
+                          unsigned short *last_word, unsigned char *last_byte,
+                          const srz_params *params) {
+  return _srz_compress(NULL, iov, iovcnt, offset, dst, length, last_word,
+                       last_byte, params);
+}
+
+/* ======================================================================== */
+/** 
+ * Decompress a data block (into an array or through a sink).
+ * @param src The source array of bytes (to be decopressed). Its size must be
+ *            compress_block_bound(length) bytes because it is used as
+ *            temporary data.
+ * @param dst The destination array of words (the whole block or the
+ *            pieces given to the sink).
+ * @param dst_length The number of words of the destination array.
+ * @param last_word Value of the last word (before separation).
+ * @param last_byte Value of the last byte (before second separation).
+ * @param length The number of words of the block.
+ * @param params The compression parameters (the same used to compress).
+ * @param sink The function that receives the pieces (or NULL).
+ * @param opaque The pointer given to the sink.
+ * @return The decompressed data length (in bytes) or negative number
+ *         in case of an error.   
+ */
+static size_t _srz_decompress(unsigned char *src, unsigned short *dst,
+                              size_t dst_length, unsigned short last_word,
+                              unsigned char last_byte, size_t length,
+                              const srz_params *params, srz_sink sink,
+                              void *opaque) {
+  mtf_status status[2];
+  mtf16_status *mtf16;
+  const mtf_transform *transform;
+  ws_context *ctx;
+  unsigned short *tmp;
+  unsigned char *tmp_b;
+  size_t total, i, n;
+  bool chunked;
+  STATS_TIMER(t)
   
   // Allocate resources
-  tmp0 = (unsigned short *) malloc(length<<1);
-  if (tmp0 == NULL) {
+  tmp = _srz_tmp_get(params, length);
+  if (tmp == NULL) {
     perror("Error allocating memory\n");
     return -1;
   }
-
-  tmp1 = (unsigned short *) malloc(length<<1);
-  if (tmp1 == NULL) {
+  tmp_b = (unsigned char *) tmp;
+  
+  ctx = _srz_ws_get(params, length);
+  if (ctx == NULL) {
     perror("Error allocating memory\n");
-    free(tmp0);
+    _srz_tmp_release(params, tmp, length);
     return -1;
-  }  
-  
-  // destination array size = 2 x source array size
-  l = (length>>1);
-  bitma = bitm_wrap((ELEMENT *)dst, l); 
-  
-  mtf_reset(&status);
+  }
   
-  // Separate words
-  separate_words(src, tmp0, length, use_previous_byte);
-  *last_byte = ((unsigned char *) tmp0)[(length<<1) - 1];
+  _srz_prime(params, ctx, status);
+  STATS_START(params, t)
+
+  // Read the group sizes and the Elias-Gamma data (the chunks are also
+  // rank decoded)
+  transform = &mtf_transforms[params->transform];
+  chunked = (!params->word_mtf && !params->split_bytes
+             && params->chunk_size > 0);
+  if ((params->word_mtf)
+      ? _srz_eg_read(src, compress_block_bound(length), tmp, length, true,
+                     ctx, length, params->streams) != 0
+      : (params->split_bytes)
+      ? _srz_parts_read(src, compress_block_bound(length), tmp_b, length<<1,
+                        length, ctx, length, params->streams, NULL,
+                        NULL) != 0
+      : (chunked)
+      ? _srz_parts_read(src, compress_block_bound(length), tmp_b, length<<1,
+                        (size_t) params->chunk_size << 10, ctx, length,
+                        params->streams, transform, &status[0]) != 0
+      : _srz_eg_read(src, compress_block_bound(length), tmp_b, length<<1,
+                     false, ctx, length, params->streams) != 0) {
+    _srz_tmp_release(params, tmp, length);
+    _srz_ws_release(params, ctx);
+    return -1;
+  }
+  STATS_STAGE(params, SRZ_STAGE_EG_DECODE, t, length<<1)
   
-  // Separate bytes
-  separate_bytes(tmp0, (unsigned char *) tmp1, length);
+  if (params->word_mtf) {
+    // Word MTF decode (the source array is not needed anymore)
+    mtf16 = _srz_mtf16_get(params);
+    if (mtf16 == NULL) {
+      perror("Error allocating memory\n");
+      _srz_tmp_release(params, tmp, length);
+      _srz_ws_release(params, ctx);
+      return -1;
+    }
+    mtf16_decode(tmp, (unsigned short *) src, length, mtf16);
+    _srz_mtf16_release(params, mtf16);
+    STATS_STAGE(params, SRZ_STAGE_MTF_DECODE, t, length<<1)
+  }
+  else {
+    // Rank transform decode
+    if (params->split_bytes) {
+      transform->decode(tmp_b, tmp_b, length, &status[0]);
+      transform->decode(tmp_b + length, tmp_b + length, length, &status[1]);
+    }
+    else if (!chunked) {
+      transform->decode(tmp_b, tmp_b, (length<<1), &status[0]);
+    }
+    STATS_STAGE(params, SRZ_STAGE_MTF_DECODE, t, length<<1)
+    
+    // Join bytes (the source array is not needed anymore)
+    join_bytes(tmp_b, (unsigned short *) src, last_byte, length,
+               params->sorting_byte);
+    STATS_STAGE(params, SRZ_STAGE_JOIN_BYTES, t, length<<1)
+  }
   
-  // MTF coding
-  mtf_code((unsigned char *) tmp1, (unsigned char *) tmp0, (length << 1),
-           &status);
+  // Join words (in pieces of the destination array, every piece is given
+  // to the sink as soon as it is joined)
+  total = (length<<1);
+  if (join_words_begin((unsigned short *) src, last_word, length,
+                       params->use_previous_byte, ctx) != 0) {
+    fprintf(stderr, "Corrupted data!\n");
+    total = (size_t) -1;
+  }
+  for (i = 0; i < length && total != (size_t) -1; i += n) {
+    n = (length - i < dst_length) ? length - i : dst_length;
+    if (join_words_next((unsigned short *) src, (sink != NULL) ? dst : dst + i,
+                        n, params->use_previous_byte, ctx) != 0) {
+      fprintf(stderr, "Corrupted data!\n");
+      total = (size_t) -1;
+    }
+    else if (sink != NULL && sink(dst, n<<1, opaque) != 0) {
+      total = (size_t) -1;
+    }
+  }
+  if (total == (size_t) -1) {
+    _srz_tmp_release(params, tmp, length);
+    _srz_ws_release(params, ctx);
+    return -1;
+  }
+  STATS_STAGE(params, SRZ_STAGE_JOIN_WORDS, t, length<<1)
+  STATS_ADD(params, blocks, 1)
   
-  // Elias-Gamma coding
-  bitm_reset(bitma);
-    
-  for (i = 0; i<(length<<1); i++) {
-    bitm_write_eg(bitma, ((unsigned char *)tmp0)[i] + 1);
+  // Keep the state for the next block (if the blocks are linked, the
+  // context has the last joined words)
+  if (_srz_save_state(params, ctx, status, ctx->previous,
+                      ctx->previous2) != 0) {
+    total = (size_t) -1;
   }
-    
-  bitm_flush(bitma);
-  compressed_length = bitm_get_index(bitma);  
   
   // Free resources
-  free(tmp0);
-  free(tmp1);
-  bitm_unwrap(bitma);
+  _srz_tmp_release(params, tmp, length);
+  _srz_ws_release(params, ctx);
   
-  return (compressed_length<<2);
+  return total;
 }
 
-
 /* ======================================================================== */
 /** 
  * Decompress a data block.
- * @param src The source array of bytes (to be decopressed).
+ * @param src The source array of bytes (to be decopressed). Its size must be
+ *            compress_block_bound(length) bytes because it is used as
+ *            temporary data.
  * @param dst The destination array of words.
  * @param last_word Value of the last word (before separation).
  * @param last_byte Value of the last byte (before second separation).
  * @param length The number of words in the destination array.
- * @param use_previous_byte Use the median value of the previous byte
- *                          to achieve a better sorting.
+ * @param params The compression parameters (the same used to compress).
  * @return The decompressed data length (in bytes) or negative number
  *         in case of an error.   
  */
 size_t decompress_block(unsigned char *src, unsigned short *dst,
                       unsigned short last_word, unsigned char last_byte,
-                      size_t length, bool use_previous_byte) {
+                      size_t length, const srz_params *params) {
+  return _srz_decompress(src, dst, length, last_word, last_byte, length,
+                         params, NULL, NULL);
+}
 
-  bitm_array *bitma;
-  mtf_status status;
-  unsigned short *tmp0, *tmp1;
-  size_t l, i;
+/* ======================================================================== */
+/** 
+ * Decompress a data block through a sink: the words are given to the sink
+ * in pieces as soon as they are joined, so the whole block is never in the
+ * output buffer.
+ * @param src The source array of bytes (to be decopressed). Its size must be
+ *            compress_block_bound(length) bytes because it is used as
+ *            temporary data.
+ * @param buffer The output buffer of the pieces.
+ * @param buffer_length The number of words of the output buffer.
+ * @param last_word Value of the last word (before separation).
+ * @param last_byte Value of the last byte (before second separation).
+ * @param length The number of words of the block.
+ * @param params The compression parameters (the same used to compress).
+ * @param sink The function that receives the pieces.
+ * @param opaque The pointer given to the sink.
+ * @return The decompressed data length (in bytes) or negative number
+ *         in case of an error.   
+ */
+size_t decompress_block_stream(unsigned char *src, unsigned short *buffer,
+                               size_t buffer_length, unsigned short last_word,
+                               unsigned char last_byte, size_t length,
+                               const srz_params *params, srz_sink sink,
+                               void *opaque) {
+  if (buffer_length < 1) {
+    return -1;
+  }
+  return _srz_decompress(src, buffer, buffer_length, last_word, last_byte,
+                         length, params, sink, opaque);
+}
+
+/* ======================================================================== */
+/** 
+ * Allocates the work buffers of the blocks.
+ * @param block_size The maximum block size (in bytes).
+ * @return The work buffers (or NULL in case of error).
+ */
+srz_context *srz_context_alloc(size_t block_size) {
+  srz_context *context;
   
-  // Allocate resources
-  tmp0 = (unsigned short *) malloc(length<<1);
-  if (tmp0 == NULL) {
-    perror("Error allocating memory\n");
+  // (The odd blocks need a padding byte)
+  block_size += (block_size & 1);
+  if (block_size == 0) {
+    return NULL;
+  }
+  
+  context = (srz_context *) calloc(1, sizeof(srz_context));
+  if (context == NULL) {
+    return NULL;
+  }
+  
+  context->block_size = block_size;
+  context->words = (unsigned short *) mem_alloc(block_size, -1);
+  context->block = (unsigned short *) mem_alloc(block_size, -1);
+  context->data = (unsigned char *) mem_alloc(
+                                 compress_block_bound(block_size>>1), -1);
+  context->state = srz_state_alloc();
+  if (context->words == NULL || context->block == NULL
+      || context->data == NULL || context->state == NULL) {
+    srz_context_free(context);
+    return NULL;
+  }
+  
+  return context;
+}
+
+/* ======================================================================== */
+/** 
+ * Releases the work buffers of the blocks.
+ * @param context The work buffers to release.
+ */
+void srz_context_free(srz_context *context) {
+  if (context == NULL) {
+    return;
+  }
+  
+  mem_free(context->words, context->block_size);
+  mem_free(context->block, context->block_size);
+  mem_free(context->data, compress_block_bound(context->block_size>>1));
+  ws_free(context->ws);
+  mtf16_free(context->mtf16);
+  srz_state_free(context->state);
+  free(context);
+}
+
+/* ======================================================================== */
+/** 
+ * Initializes a file header.
+ * @param header The file header.
+ * @param block_size The block size (in kilobytes).
+ * @param params The compression parameters.
+ */
+void srz_init_header(srz_header *header, int block_size,
+                     const srz_params *params) {
+  memset(header, 0, sizeof(srz_header));
+  header->magic_number[0] = 'S';
+  header->magic_number[1] = 'R';
+  header->version = SRZ_VERSION;
+  header->use_previous_byte = params->use_previous_byte;
+  header->block_size = block_size;
+  header->context_mode = params->context_mode;
+  // (The number of groups is only used by the hashed contexts)
+  header->context_bits = ws_stores_counts(params->context_mode)
+                         ? params->context_bits : WS_HASH_DEFAULT_BITS;
+  header->streams = params->streams;
+  header->split_bytes = params->split_bytes;
+  header->word_mtf = params->word_mtf;
+  header->sorting_byte = params->sorting_byte;
+  header->chunk_size = params->chunk_size;
+  header->dict_id = (params->dict != NULL) ? params->dict->id : 0;
+  header->content_size = SRZ_UNKNOWN_SIZE;
+}
+
+/* ======================================================================== */
+/** 
+ * Checks a file header (the file can be corrupted) and sets the
+ * decompression parameters.
+ * @param header The file header.
+ * @param dict The dictionary (or NULL).
+ * @param params The decompression parameters.
+ * @return 0 if everything goes OK.
+ */
+int srz_check_header(const srz_header *header, const srz_dict *dict,
+                     srz_params *params) {
+  // Check the magic number
+  if (header->magic_number[0] != 'S' || header->magic_number[1] != 'R') {
+    fprintf(stderr, "Bad magic number!\n");
     return -1;
   }
 
-  tmp1 = (unsigned short *) malloc(length<<1);
-  if (tmp1 == NULL) {
-    perror("Error allocating memory\n");
-    free(tmp0);
+  // Check the version
+  if (header->version != SRZ_VERSION) {
+    fprintf(stderr, "Wrong version!\n");
+    return -1;
+  }    
+  
+  params->use_previous_byte = header->use_previous_byte;
+  params->context_mode = header->context_mode;
+  params->context_bits = header->context_bits;
+  params->streams = header->streams;
+  params->split_bytes = header->split_bytes;
+  params->word_mtf = header->word_mtf;
+  params->sorting_byte = header->sorting_byte;
+  params->chunk_size = header->chunk_size;
+  params->dict = NULL;
+  
+  // Check the dictionary
+  if (header->dict_id != 0) {
+    if (dict == NULL) {
+      fprintf(stderr, "The file needs a dictionary (-D)!\n");
+      return -1;
+    }
+    if (dict->id != header->dict_id) {
+      fprintf(stderr, "Wrong dictionary!\n");
+      return -1;
+    }
+    params->dict = dict;
+  }
+  
+  // Check the parameters
+  if (header->block_size < 1 || header->block_size > SRZ_MAX_BLOCK_SIZE) {
+    fprintf(stderr, "Wrong block size!\n");
+    return -1;
+  }
+  // (The number of groups is checked for every mode, the header of the
+  // other modes has the default one)
+  if (params->context_mode < WS_CONTEXT_BYTE
+      || params->context_mode > WS_CONTEXT_HASH4
+      || params->context_bits < WS_HASH_MIN_BITS
+      || params->context_bits > WS_HASH_MAX_BITS) {
+    fprintf(stderr, "Wrong context!\n");
+    return -1;
+  }
+  if (header->streams < 1 || header->streams > SRZ_MAX_STREAMS) {
+    fprintf(stderr, "Wrong number of streams!\n");
+    return -1;
+  }
+  if (header->sorting_byte > 1) {
+    fprintf(stderr, "Wrong sorting byte!\n");
+    return -1;
+  }
+  if (header->chunk_size > SRZ_MAX_CHUNK_SIZE) {
+    fprintf(stderr, "Wrong chunk size!\n");
+    return -1;
+  }
+  if (header->link_blocks > SRZ_MAX_LINK_BLOCKS) {
+    fprintf(stderr, "Wrong number of linked blocks!\n");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Skips the fragments before a position.
+ * @param iov The fragments.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes). It will contain the position in
+ *               the returned fragment.
+ * @return The index of the fragment of the position.
+ */
+static int _srz_iov_skip(const struct iovec *iov, int iovcnt,
+                         size_t *offset) {
+  int i;
+  
+  for (i = 0; i < iovcnt && *offset >= iov[i].iov_len; i++) {
+    *offset -= iov[i].iov_len;
+  }
+  
+  return i;
+}
+
+/* ======================================================================== */
+/** 
+ * Copies a part of a list of fragments into an array.
+ * @param iov The fragments.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the data to copy.
+ * @param dst The destination array.
+ * @param length The number of bytes to copy.
+ */
+static void _srz_iov_copy(const struct iovec *iov, int iovcnt, size_t offset,
+                          unsigned char *dst, size_t length) {
+  size_t n;
+  int i;
+  
+  for (i = _srz_iov_skip(iov, iovcnt, &offset); i < iovcnt && length > 0;
+       i++, offset = 0) {
+    n = iov[i].iov_len - offset;
+    if (n > length) {
+      n = length;
+    }
+    memcpy(dst, (const unsigned char *) iov[i].iov_base + offset, n);
+    dst += n;
+    length -= n;
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the checksum of a block read from a list of fragments.
+ * @param iov The fragments.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the block.
+ * @param length The number of bytes of the block.
+ * @param params The compression parameters.
+ * @return The checksum.
+ */
+static unsigned int _srz_checksum_iov(const struct iovec *iov, int iovcnt,
+                                      size_t offset, size_t length,
+                                      const srz_params *params) {
+  unsigned int checksum;
+  size_t n;
+  int i;
+#ifdef SRZ_STATS
+  double start = 0;
+  
+  if (params->stats != NULL) {
+    start = _srz_get_time();
+  }
+#endif
+  
+  // (The CRC of the fragments is calculated with the CRC of the previous
+  // ones as the initial value)
+  checksum = 0x80000000;
+  for (i = _srz_iov_skip(iov, iovcnt, &offset), n = length;
+       i < iovcnt && n > 0; i++, offset = 0) {
+    if (iov[i].iov_len - offset < n) {
+      checksum = xcrc32((const unsigned char *) iov[i].iov_base + offset,
+                        iov[i].iov_len - offset, checksum);
+      n -= iov[i].iov_len - offset;
+    }
+    else {
+      checksum = xcrc32((const unsigned char *) iov[i].iov_base + offset, n,
+                        checksum);
+      n = 0;
+    }
+  }
+  
+#ifdef SRZ_STATS
+  if (params->stats != NULL) {
+    params->stats->checksum_seconds += _srz_get_time() - start;
+    params->stats->checksum_bytes += length;
+  }
+#endif
+  return checksum;
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the checksum of a block.
+ * @param data The data of the block.
+ * @param length The number of bytes of the block.
+ * @param params The compression parameters.
+ * @return The checksum.
+ */
+static unsigned int _srz_checksum(const void *data, size_t length,
+                                  const srz_params *params) {
+  struct iovec iov;
+  
+  iov.iov_base = (void *) data;
+  iov.iov_len = length;
+  return _srz_checksum_iov(&iov, 1, 0, length, params);
+}
+
+/* ======================================================================== */
+/** 
+ * Compresses a block of a file (the data that can't be compressed is
+ * stored).
+ * @param src The source data (with room for a padding byte if the length
+ *            is odd).
+ * @param length The number of bytes of the source data.
+ * @param dst The destination array (compress_block_bound bytes of the words
+ *            of the block).
+ * @param block_header The block header to fill.
+ * @param params The compression parameters.
+ * @return 0 if everything goes OK.
+ */
+int srz_compress_frame_block(unsigned short *src, size_t length,
+                             unsigned char *dst,
+                             srz_block_header *block_header,
+                             const srz_params *params) {
+  size_t l, cl;
+  
+  // If the number of bytes is odd we need 1 byte of padding
+  if ((length & 1) == 1) {
+    ((unsigned char *) src)[length] = 0;
+  }
+  l = ((length + 1) >> 1);
+  
+  memset(block_header, 0, sizeof(srz_block_header));
+  block_header->length = length;
+  block_header->checksum = _srz_checksum(src, length, params);
+  block_header->last_word = src[l-1];
+  block_header->transform = params->transform;
+  
+  cl = compress_block(src, dst, l, &block_header->last_byte, params);
+  if (cl == (size_t) -1) {
+    fprintf(stderr, "Error compressing data block!\n");
     return -1;
-  }  
+  }
   
-  // source array size = 2 x destination array size
-  l = (length>>1);
-  bitma = bitm_wrap((ELEMENT *)src, l); 
+  // If the data can't be compressed, just store it (the decompressor
+  // doesn't see the state of a stored block, so the next one is a reset
+  // point)
+  if (cl == SRZ_NOT_COMPRESSED) {
+    memcpy(dst, src, length);
+    cl = length;
+    srz_state_reset(params->state);
+  }
+  
+  block_header->compressed_length = cl;
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Decompresses a block of a file and checks its checksum.
+ * @param src The compressed data (compress_block_bound bytes of the words
+ *            of the block, it is used as temporary data).
+ * @param dst The destination array (the words of the block).
+ * @param block_header The block header (already checked).
+ * @param params The decompression parameters.
+ * @return 0 if everything goes OK.
+ */
+int srz_decompress_frame_block(unsigned char *src, unsigned short *dst,
+                               const srz_block_header *block_header,
+                               const srz_params *params) {
+  srz_params block_params;
+  size_t l;
+  
+  if (block_header->compressed_length == block_header->length) {
+    // The data is not compressed (and the next block is a reset point)
+    memcpy(dst, src, block_header->length);
+    srz_state_reset(params->state);
+    STATS_ADD(params, blocks, 1)
+    STATS_ADD(params, stored_blocks, 1)
+  }
+  else {
+    // Decompress the data (with the rank transform of the block)
+    if (block_header->transform >= MTF_TRANSFORMS) {
+      fprintf(stderr, "Wrong rank transform!\n");
+      return -1;
+    }
+    block_params = *params;
+    block_params.transform = block_header->transform;
+    
+    l = (block_header->length >> 1) + (block_header->length & 1);
+    if (decompress_block(src, dst, block_header->last_word,
+                         block_header->last_byte, l,
+                         &block_params) != (l<<1)) {
+      fprintf(stderr, "Error decompressing data block!\n");
+      return -1;
+    }
+  }
+  
+  // Check the checksum
+  if (_srz_checksum(dst, block_header->length, params)
+      != block_header->checksum) {
+    fprintf(stderr, "Bad checksum!\n");
+    return -1;
+  }
   
-  mtf_reset(&status);
+  return 0;
+}
+
+/**
+ * State of the sink of a streamed frame block.
+ */
+typedef struct {
+  srz_sink sink;            /* The sink of the caller. */
+  void *opaque;             /* The pointer given to the sink. */
+  size_t left;              /* Bytes of the block not given yet. */
+  unsigned int checksum;    /* Checksum of the bytes given. */
+} frame_sink;
 
-  // Read Elias-Gamma data
-  for (i = 0; i<(length<<1); i++) {
-    ((unsigned char *)tmp0)[i] = (unsigned char) (bitm_read_eg(bitma) - 1);
+/* ======================================================================== */
+/** 
+ * Gives a piece of a frame block to the sink of the caller (without the
+ * padding byte of the blocks of odd length) and updates the checksum.
+ * @param data The next piece of data.
+ * @param length The number of bytes of the piece.
+ * @param opaque The frame_sink structure.
+ * @return 0 if everything goes OK.
+ */
+static int _srz_frame_sink_write(const void *data, size_t length,
+                                 void *opaque) {
+  frame_sink *frame = (frame_sink *) opaque;
+  
+  if (length > frame->left) {
+    length = frame->left;
   }
+  frame->left -= length;
+  frame->checksum = xcrc32((const unsigned char *) data, length,
+                           frame->checksum);
+  return frame->sink(data, length, frame->opaque);
+}
+
+/* ======================================================================== */
+/** 
+ * Decompresses a block of a file through a sink and checks its checksum
+ * (the checksum is checked at the end, so the sink may have received the
+ * data of a corrupted block).
+ * @param src The compressed data (compress_block_bound bytes of the words
+ *            of the block, it is used as temporary data).
+ * @param buffer The output buffer of the pieces.
+ * @param buffer_length The number of words of the output buffer.
+ * @param block_header The block header (already checked).
+ * @param params The decompression parameters.
+ * @param sink The function that receives the pieces.
+ * @param opaque The pointer given to the sink.
+ * @return 0 if everything goes OK.
+ */
+int srz_decompress_frame_block_stream(unsigned char *src,
+                                      unsigned short *buffer,
+                                      size_t buffer_length,
+                                      const srz_block_header *block_header,
+                                      const srz_params *params,
+                                      srz_sink sink, void *opaque) {
+  srz_params block_params;
+  frame_sink frame;
+  size_t l;
   
-  // MTF decode
-  mtf_decode((unsigned char *) tmp0, (unsigned char *) tmp1, (length<<1),
-             &status);
+  if (block_header->compressed_length == block_header->length) {
+    // The data is not compressed (and the next block is a reset point)
+    if (_srz_checksum(src, block_header->length, params)
+        != block_header->checksum) {
+      fprintf(stderr, "Bad checksum!\n");
+      return -1;
+    }
+    srz_state_reset(params->state);
+    STATS_ADD(params, blocks, 1)
+    STATS_ADD(params, stored_blocks, 1)
+    return sink(src, block_header->length, opaque);
+  }
   
-  // Join bytes
-  join_bytes((unsigned char *) tmp1, tmp0, last_byte, length);
+  // Decompress the data (with the rank transform of the block)
+  if (block_header->transform >= MTF_TRANSFORMS) {
+    fprintf(stderr, "Wrong rank transform!\n");
+    return -1;
+  }
+  block_params = *params;
+  block_params.transform = block_header->transform;
   
-  // Join words
-  join_words(tmp0, dst, last_word, length, use_previous_byte);
+  frame.sink = sink;
+  frame.opaque = opaque;
+  frame.left = block_header->length;
+  frame.checksum = 0x80000000;
+  l = (block_header->length >> 1) + (block_header->length & 1);
+  if (decompress_block_stream(src, buffer, buffer_length,
+                              block_header->last_word,
+                              block_header->last_byte, l, &block_params,
+                              _srz_frame_sink_write, &frame) != (l<<1)) {
+    fprintf(stderr, "Error decompressing data block!\n");
+    return -1;
+  }
   
-  // Free resources
-  free(tmp0);
-  free(tmp1);
-  bitm_unwrap(bitma);
+  // Check the checksum
+  if (frame.checksum != block_header->checksum) {
+    fprintf(stderr, "Bad checksum!\n");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Calculates the size of the destination array of srz_compress_buffer.
+ * @param length The number of bytes of the source data.
+ * @return The size (in bytes) of the destination array.
+ */
+size_t srz_compress_bound(size_t length) {
+  // (The smallest blocks have the most headers)
+  return sizeof(srz_header) + length
+         + ((length + 1023) / 1024) * sizeof(srz_block_header);
+}
+
+/* ======================================================================== */
+/** 
+ * Compresses a list of fragments into a buffer (with the file format of
+ * srcomp) without copying them into an array.
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param dst The destination array.
+ * @param capacity The size of the destination array (srz_compress_bound
+ *                 bytes of the total length are always enough).
+ * @param block_size The block size (in kilobytes, 0 for
+ *                   SRZ_BUFFER_BLOCK_SIZE).
+ * @param params The compression parameters (with the work buffers of a
+ *               block_size block, or they are allocated).
+ * @return The compressed data length (in bytes) or (size_t) -1 in case of
+ *         an error.
+ */
+size_t srz_compress_iov(const struct iovec *iov, int iovcnt, void *dst,
+                        size_t capacity, int block_size,
+                        const srz_params *params) {
+  unsigned char *dst_b = (unsigned char *) dst;
+  srz_header header;
+  srz_block_header block_header;
+  srz_params block_params;
+  srz_context *context;
+  size_t bs, length, offset, position, read, cl;
+  int i;
+  
+  if (block_size == 0) {
+    block_size = SRZ_BUFFER_BLOCK_SIZE;
+  }
+  if (block_size < 1 || block_size > SRZ_MAX_BLOCK_SIZE) {
+    fprintf(stderr, "Wrong block size!\n");
+    return -1;
+  }
+  bs = (size_t) block_size * 1024;
+  
+  length = 0;
+  for (i = 0; i < iovcnt; i++) {
+    length += iov[i].iov_len;
+  }
+  
+  // Use the work buffers of the caller (if they are big enough)
+  block_params = *params;
+  block_params.state = NULL;
+  context = params->context;
+  if (context == NULL || context->block_size < bs) {
+    context = srz_context_alloc(bs);
+    if (context == NULL) {
+      perror("Error allocating memory\n");
+      return -1;
+    }
+  }
+  block_params.context = context;
+  
+  srz_init_header(&header, block_size, params);
+  header.content_size = length;
+  position = sizeof(header);
+  
+  for (offset = 0; offset < length; offset += read) {
+    read = length - offset;
+    if (read > bs) {
+      read = bs;
+    }
+    
+    memset(&block_header, 0, sizeof(block_header));
+    block_header.length = read;
+    block_header.checksum = _srz_checksum_iov(iov, iovcnt, offset, read,
+                                              &block_params);
+    block_header.transform = block_params.transform;
+    cl = compress_block_iov(iov, iovcnt, offset, context->data,
+                            (read + 1) >> 1, &block_header.last_word,
+                            &block_header.last_byte, &block_params);
+    if (cl == (size_t) -1) {
+      fprintf(stderr, "Error compressing data block!\n");
+      position = (size_t) -1;
+      break;
+    }
+    
+    // If the data can't be compressed, just store it
+    if (cl == SRZ_NOT_COMPRESSED) {
+      cl = read;
+    }
+    block_header.compressed_length = cl;
+    
+    if (position + sizeof(block_header) + cl > capacity) {
+      fprintf(stderr, "The destination buffer is too small!\n");
+      position = (size_t) -1;
+      break;
+    }
+    
+    memcpy(dst_b + position, &block_header, sizeof(block_header));
+    position += sizeof(block_header);
+    if (cl == read) {
+      _srz_iov_copy(iov, iovcnt, offset, dst_b + position, read);
+    }
+    else {
+      memcpy(dst_b + position, context->data, cl);
+    }
+    position += cl;
+    header.block_count++;
+  }
+  
+  // Write the file header
+  if (position != (size_t) -1) {
+    if (capacity < sizeof(header)) {
+      fprintf(stderr, "The destination buffer is too small!\n");
+      position = (size_t) -1;
+    }
+    else {
+      memcpy(dst_b, &header, sizeof(header));
+    }
+  }
+  
+  if (context != params->context) {
+    srz_context_free(context);
+  }
+  
+  return position;
+}
+
+/* ======================================================================== */
+/** 
+ * Compresses a buffer into a buffer (with the file format of srcomp).
+ * @param src The source data.
+ * @param length The number of bytes of the source data.
+ * @param dst The destination array.
+ * @param capacity The size of the destination array (srz_compress_bound
+ *                 bytes are always enough).
+ * @param block_size The block size (in kilobytes, 0 for
+ *                   SRZ_BUFFER_BLOCK_SIZE).
+ * @param params The compression parameters (with the work buffers of a
+ *               block_size block, or they are allocated).
+ * @return The compressed data length (in bytes) or (size_t) -1 in case of
+ *         an error.
+ */
+size_t srz_compress_buffer(const void *src, size_t length, void *dst,
+                           size_t capacity, int block_size,
+                           const srz_params *params) {
+  struct iovec iov;
+  
+  // (A buffer is a single fragment)
+  iov.iov_base = (void *) src;
+  iov.iov_len = length;
+  return srz_compress_iov(&iov, 1, dst, capacity, block_size, params);
+}
 
+/* ======================================================================== */
+/** 
+ * Decompresses a buffer into a buffer.
+ * @param src The compressed data.
+ * @param length The number of bytes of the compressed data.
+ * @param dst The destination array.
+ * @param capacity The size of the destination array (see
+ *                 srz_get_decompressed_size).
+ * @param params The decompression parameters (only the dictionary, the
+ *               profiling counters and the work buffers are used).
+ * @return The decompressed data length (in bytes) or (size_t) -1 in case
+ *         of an error.
+ */
+size_t srz_decompress_buffer(const void *src, size_t length, void *dst,
+                             size_t capacity, const srz_params *params) {
+  const unsigned char *src_b = (const unsigned char *) src;
+  unsigned char *dst_b = (unsigned char *) dst;
+  srz_header header;
+  srz_block_header block_header;
+  srz_params block_params;
+  srz_context *context;
+  unsigned short *words;
+  unsigned long long blocks;
+  size_t bs, offset, position, cl;
+  
+  if (length < sizeof(header)) {
+    fprintf(stderr, "Error reading file header\n");
+    return -1;
+  }
+  memcpy(&header, src_b, sizeof(header));
+  
+  block_params = *params;
+  if (srz_check_header(&header, params->dict, &block_params) != 0) {
+    return -1;
+  }
+  bs = (size_t) header.block_size * 1024;
+  
+  // Use the work buffers of the caller (if they are big enough)
+  context = params->context;
+  if (context == NULL || context->block_size < bs) {
+    context = srz_context_alloc(bs);
+    if (context == NULL) {
+      perror("Error allocating memory\n");
+      return -1;
+    }
+  }
+  block_params.context = context;
+  block_params.state = NULL;
+  if (header.link_blocks > 1) {
+    block_params.state = context->state;
+  }
+  
+  offset = sizeof(header);
+  position = 0;
+  for (blocks = 0; offset < length; blocks++) {
+    // Read and check the block header (the data must fit in the buffers)
+    if (length - offset < sizeof(block_header)) {
+      fprintf(stderr, "Error reading block header\n");
+      position = (size_t) -1;
+      break;
+    }
+    memcpy(&block_header, src_b + offset, sizeof(block_header));
+    offset += sizeof(block_header);
+    
+    cl = block_header.compressed_length;
+    if (block_header.length < 1 || block_header.length > bs
+        || cl > block_header.length || cl > length - offset) {
+      fprintf(stderr, "Wrong block header!\n");
+      position = (size_t) -1;
+      break;
+    }
+    if (block_header.length > capacity - position) {
+      fprintf(stderr, "The destination buffer is too small!\n");
+      position = (size_t) -1;
+      break;
+    }
+    
+    // Every segment of linked blocks starts at a reset point
+    if (header.link_blocks > 1 && (blocks % header.link_blocks) == 0) {
+      srz_state_reset(block_params.state);
+    }
+    
+    // The aligned words (with room for the padding) are decompressed in
+    // place (the rest are copied)
+    words = (unsigned short *) (dst_b + position);
+    if (((size_t) words & 1) == 1
+        || block_header.length + (block_header.length & 1)
+           > capacity - position) {
+      words = context->block;
+    }
+    
+    memcpy(context->data, src_b + offset, cl);
+    if (srz_decompress_frame_block(context->data, words, &block_header,
+                                   &block_params) != 0) {
+      position = (size_t) -1;
+      break;
+    }
+    
+    if (words == context->block) {
+      memcpy(dst_b + position, words, block_header.length);
+    }
+    position += block_header.length;
+    offset += cl;
+  }
+  
+  // Check the content size (the data can be truncated)
+  if (position != (size_t) -1 && header.content_size != SRZ_UNKNOWN_SIZE
+      && (position != header.content_size || blocks != header.block_count)) {
+    fprintf(stderr, "Wrong content size!\n");
+    position = (size_t) -1;
+  }
+  
+  if (context != params->context) {
+    srz_context_free(context);
+  }
   
-  return (length<<1);
-}
\ No newline at end of file
+  return position;
+}
@@ -18,39 +18,519 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
+
+#include "mtf.h"
+#include "split2b.h"
+#include "wseparator.h"
+
+/* Stages of the compression (and decompression) of a block */
+#define SRZ_STAGE_SEPARATE_WORDS 0
+#define SRZ_STAGE_SEPARATE_BYTES 1
+#define SRZ_STAGE_MTF_CODE       2
+#define SRZ_STAGE_EG_CODE        3
+#define SRZ_STAGE_EG_DECODE      4
+#define SRZ_STAGE_MTF_DECODE     5
+#define SRZ_STAGE_JOIN_BYTES     6
+#define SRZ_STAGE_JOIN_WORDS     7
+#define SRZ_STAGES               8
+
+#define SRZ_MTF_RANKS 256
+
+/**
+ * Profiling counters. They are only updated when the library is built
+ * with SRZ_STATS defined (configure --enable-stats).
+ */
+typedef struct {
+  double seconds[SRZ_STAGES];     /* Time spent in every stage. */
+  size_t bytes[SRZ_STAGES];       /* Bytes processed by every stage. */
+  size_t mtf_ranks[SRZ_MTF_RANKS]; /* Histogram of the MTF ranks. */
+  size_t eg_bits;                 /* Bits written by the Elias-Gamma coder. */
+  size_t eg_symbols;              /* Symbols written by the EG coder. */
+  size_t blocks;                  /* Number of blocks. */
+  size_t stored_blocks;           /* Blocks that can't be compressed. */
+  double checksum_seconds;        /* Time spent calculating checksums. */
+  size_t checksum_bytes;          /* Bytes of the checksums. */
+} srz_stats;
+
+#define SRZ_DICT_MAX_GROUPS (1 << 22)
+
+/**
+ * Trained dictionary (the state of the compressor after some sample data,
+ * used as the initial state of every block).
+ */
+typedef struct {
+  unsigned int id;          /* Identifier (hash of the dictionary). */
+  bool use_previous_byte;   /* Parameters used to train the dictionary. */
+  int context_mode;
+  int context_bits;
+  unsigned char mtf_order[SRZ_MTF_RANKS]; /* Initial MTF order. */
+  unsigned short previous;  /* Last words of the sample data. */
+  unsigned short previous2;
+  int groups;               /* Groups of the median table (0 if unused). */
+  unsigned char *median;    /* Median table of the word separator. */
+} srz_dict;
+
+/**
+ * State carried over from a block to the next one (linked blocks).
+ */
+typedef struct {
+  bool valid;               /* The state of a previous block is stored. */
+  mtf_status mtf[2];        /* MTF status (high and low bytes) at the end
+                               of the block. */
+  mtf16_status *mtf16;      /* Word MTF status at the end of the block (it
+                               is updated in place). */
+  unsigned short previous;  /* Last words of the block. */
+  unsigned short previous2;
+  int groups;               /* Groups of the median table. */
+  unsigned char *median;    /* Median table at the end of the block. */
+} srz_state;
+
+/* Version of the file format */
+#define SRZ_VERSION 11
+
+/* Content size of the files whose size is not known */
+#define SRZ_UNKNOWN_SIZE ((unsigned long long) -1)
+
+/* Returned by compress_block and compress_block_iov when the block can't
+   be compressed (or doesn't save params->min_savings percent): the caller
+   stores it and resets the state of the linked blocks */
+#define SRZ_NOT_COMPRESSED ((size_t) -2)
+
+/* Limits of the file header */
+#define SRZ_MAX_BLOCK_SIZE 65536
+#define SRZ_MAX_LINK_BLOCKS 1024
+
+/* Maximum number of interleaved Elias-Gamma streams of a block */
+#define SRZ_MAX_STREAMS 8
+
+/* Maximum size (in kilobytes) of the entropy chunks of a block */
+#define SRZ_MAX_CHUNK_SIZE 16384
+
+/* Block size (in kilobytes) of srz_compress_buffer by default */
+#define SRZ_BUFFER_BLOCK_SIZE 64
+
+/**
+ * File header.
+ */
+typedef struct {
+  unsigned char magic_number[2];
+  unsigned char version;
+  unsigned char use_previous_byte;
+  unsigned int block_size;        /* Block size (in kilobytes). */
+  unsigned char context_mode;
+  unsigned char context_bits;
+  unsigned char streams;          /* Interleaved Elias-Gamma streams. */
+  unsigned char split_bytes;      /* The high and low bytes are coded
+                                     separately. */
+  unsigned char word_mtf;         /* The words are coded with word MTF. */
+  unsigned char sorting_byte;     /* The byte of the words to sort by. */
+  unsigned short chunk_size;      /* Size (in kilobytes) of the entropy
+                                     chunks (0 if they are not used). */
+  unsigned int dict_id;           /* 0 if no dictionary is used. */
+  unsigned int link_blocks;       /* Blocks between reset points (0 or 1 if
+                                     the blocks are independent). */
+  unsigned long long content_size; /* Size of the decompressed data (or
+                                      SRZ_UNKNOWN_SIZE). */
+  unsigned long long block_count; /* Number of blocks (if the content size
+                                     is known). */
+} srz_header;
+
+/**
+ * Block header.
+ */
+typedef struct {
+  size_t length;                  /* Length (in bytes) of the data. */
+  size_t compressed_length;       /* Length of the compressed data (the
+                                     same length if it is stored). */
+  unsigned int checksum;          /* CRC-32 of the data. */
+  unsigned short last_word;
+  unsigned char last_byte;
+  unsigned char transform;        /* Rank transform (MTF_TRANSFORM_*). */
+} srz_block_header;
+
+/**
+ * Receives the decompressed data of a block in order, in pieces.
+ * @param data The next piece of data.
+ * @param length The number of bytes of the piece.
+ * @param opaque The pointer given to the decompression function.
+ * @return 0 if everything goes OK (otherwise the decompression stops).
+ */
+typedef int (*srz_sink)(const void *data, size_t length, void *opaque);
+
+/**
+ * Work buffers of the blocks (allocated once and reused by every block).
+ */
+typedef struct {
+  size_t block_size;        /* Maximum block size (in bytes). */
+  unsigned short *words;    /* Separated words (block_size bytes). */
+  unsigned short *block;    /* Padded block (block_size bytes). */
+  unsigned char *data;      /* Compressed block (compress_block_bound). */
+  ws_context *ws;           /* Word separator context. */
+  mtf16_status *mtf16;      /* Word MTF status (allocated when used). */
+  srz_state *state;         /* Linked blocks state. */
+} srz_context;
+
+/**
+ * Compression parameters.
+ */
+typedef struct {
+  bool use_previous_byte;   /* Use the median value of the previous byte. */
+  int context_mode;         /* Word grouping context (WS_CONTEXT_*). */
+  int context_bits;         /* Number of groups (in bits) of hashed contexts. */
+  int streams;              /* Number of interleaved Elias-Gamma streams
+                               (1 - SRZ_MAX_STREAMS). */
+  bool split_bytes;         /* Code the high and low bytes separately (with
+                               their own MTF status). */
+  bool word_mtf;            /* Code the separated words with a word (16-bit)
+                               MTF instead of separating their bytes (the
+                               split_bytes option is not used). */
+  int transform;            /* Rank transform of the bytes
+                               (MTF_TRANSFORM_*). */
+  int sorting_byte;         /* The byte of the words to sort the other byte
+                               by (0 or 1, not used with word_mtf). */
+  int chunk_size;           /* Size (in kilobytes of MTF symbols) of the
+                               chunks that are rank and Elias-Gamma coded
+                               independently (0 = the whole block, not used
+                               with split_bytes or word_mtf). */
+  int min_savings;          /* Minimum savings (in percent, 0-99) of the
+                               compressed blocks: the coding of a block
+                               stops as soon as it can't save them and the
+                               block is stored (0 = any saving). */
+  srz_stats *stats;         /* Profiling counters (NULL to disable them). */
+  const srz_dict *dict;     /* Trained dictionary (NULL if not used). */
+  srz_state *state;         /* Linked blocks state (NULL for independent
+                               blocks). */
+  srz_context *context;     /* Work buffers (NULL to allocate them for
+                               every block). */
+} srz_params;
+
+/** 
+ * Sets the default compression parameters.
+ * @param params The parameters to initialize.
+ */
+void srz_default_params(srz_params *params);
+
+/** 
+ * Checks if the library records the profiling counters.
+ * @return true if the library was built with SRZ_STATS.
+ */
+bool srz_stats_enabled();
+
+/** 
+ * Resets the profiling counters.
+ * @param stats The counters to reset.
+ */
+void srz_stats_reset(srz_stats *stats);
+
+/** 
+ * Adds some profiling counters to other ones.
+ * @param dst The counters to update.
+ * @param src The counters to add.
+ */
+void srz_stats_merge(srz_stats *dst, const srz_stats *src);
+
+/** 
+ * Prints a summary of the profiling counters.
+ * @param out The output file.
+ * @param stats The counters to print.
+ */
+void srz_stats_print(FILE *out, const srz_stats *stats);
+
+/** 
+ * Trains a dictionary with some sample data.
+ * @param sample The sample data.
+ * @param length The length (in bytes) of the sample data.
+ * @param params The compression parameters (the dictionary can only be used
+ *               with the same parameters).
+ * @return The dictionary (or NULL in case of error).
+ */
+srz_dict *srz_train(const unsigned char *sample, size_t length,
+                    const srz_params *params);
+
+/** 
+ * Releases a dictionary.
+ * @param dict The dictionary to release.
+ */
+void srz_dict_free(srz_dict *dict);
+
+/** 
+ * Writes a dictionary into a file.
+ * @param dict The dictionary.
+ * @param file The output file.
+ * @return 0 if everything goes OK.
+ */
+int srz_dict_save(const srz_dict *dict, FILE *file);
+
+/** 
+ * Reads a dictionary from a file.
+ * @param file The input file.
+ * @return The dictionary (or NULL in case of error).
+ */
+srz_dict *srz_dict_load(FILE *file);
+
+/** 
+ * Gets the size of the decompressed data of a file.
+ * @param src The beginning of the file (at least the file header).
+ * @param length The number of bytes of src.
+ * @param size The size of the decompressed data (or SRZ_UNKNOWN_SIZE if the
+ *             file doesn't store it, like the files written to a pipe).
+ * @return 0 if everything goes OK (-1 if src isn't a valid file header).
+ */
+int srz_get_decompressed_size(const void *src, size_t length,
+                              unsigned long long *size);
+
+/** 
+ * Allocates the work buffers of the blocks.
+ * @param block_size The maximum block size (in bytes).
+ * @return The work buffers (or NULL in case of error).
+ */
+srz_context *srz_context_alloc(size_t block_size);
+
+/** 
+ * Releases the work buffers of the blocks.
+ * @param context The work buffers to release.
+ */
+void srz_context_free(srz_context *context);
+
+/** 
+ * Initializes a file header.
+ * @param header The file header.
+ * @param block_size The block size (in kilobytes).
+ * @param params The compression parameters.
+ */
+void srz_init_header(srz_header *header, int block_size,
+                     const srz_params *params);
+
+/** 
+ * Checks a file header (the file can be corrupted) and sets the
+ * decompression parameters.
+ * @param header The file header.
+ * @param dict The dictionary (or NULL).
+ * @param params The decompression parameters.
+ * @return 0 if everything goes OK.
+ */
+int srz_check_header(const srz_header *header, const srz_dict *dict,
+                     srz_params *params);
+
+/** 
+ * Compresses a block of a file (the data that can't be compressed is
+ * stored).
+ * @param src The source data (with room for a padding byte if the length
+ *            is odd).
+ * @param length The number of bytes of the source data.
+ * @param dst The destination array (compress_block_bound bytes of the words
+ *            of the block).
+ * @param block_header The block header to fill.
+ * @param params The compression parameters.
+ * @return 0 if everything goes OK.
+ */
+int srz_compress_frame_block(unsigned short *src, size_t length,
+                             unsigned char *dst,
+                             srz_block_header *block_header,
+                             const srz_params *params);
+
+/** 
+ * Decompresses a block of a file and checks its checksum.
+ * @param src The compressed data (compress_block_bound bytes of the words
+ *            of the block, it is used as temporary data).
+ * @param dst The destination array (the words of the block).
+ * @param block_header The block header (already checked).
+ * @param params The decompression parameters.
+ * @return 0 if everything goes OK.
+ */
+int srz_decompress_frame_block(unsigned char *src, unsigned short *dst,
+                               const srz_block_header *block_header,
+                               const srz_params *params);
+
+/** 
+ * Decompresses a block of a file through a sink and checks its checksum
+ * (the checksum is checked at the end, so the sink may have received the
+ * data of a corrupted block).
+ * @param src The compressed data (compress_block_bound bytes of the words
+ *            of the block, it is used as temporary data).
+ * @param buffer The output buffer of the pieces.
+ * @param buffer_length The number of words of the output buffer.
+ * @param block_header The block header (already checked).
+ * @param params The decompression parameters.
+ * @param sink The function that receives the pieces.
+ * @param opaque The pointer given to the sink.
+ * @return 0 if everything goes OK.
+ */
+int srz_decompress_frame_block_stream(unsigned char *src,
+                                      unsigned short *buffer,
+                                      size_t buffer_length,
+                                      const srz_block_header *block_header,
+                                      const srz_params *params,
+                                      srz_sink sink, void *opaque);
+
+/** 
+ * Calculates the size of the destination array of srz_compress_buffer.
+ * @param length The number of bytes of the source data.
+ * @return The size (in bytes) of the destination array.
+ */
+size_t srz_compress_bound(size_t length);
+
+/** 
+ * Compresses a buffer into a buffer (with the file format of srcomp).
+ * @param src The source data.
+ * @param length The number of bytes of the source data.
+ * @param dst The destination array.
+ * @param capacity The size of the destination array (srz_compress_bound
+ *                 bytes are always enough).
+ * @param block_size The block size (in kilobytes, 0 for
+ *                   SRZ_BUFFER_BLOCK_SIZE).
+ * @param params The compression parameters (with the work buffers of a
+ *               block_size block, or they are allocated).
+ * @return The compressed data length (in bytes) or (size_t) -1 in case of
+ *         an error.
+ */
+size_t srz_compress_buffer(const void *src, size_t length, void *dst,
+                           size_t capacity, int block_size,
+                           const srz_params *params);
+
+/** 
+ * Compresses a list of fragments into a buffer (with the file format of
+ * srcomp) without copying them into an array.
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param dst The destination array.
+ * @param capacity The size of the destination array (srz_compress_bound
+ *                 bytes of the total length are always enough).
+ * @param block_size The block size (in kilobytes, 0 for
+ *                   SRZ_BUFFER_BLOCK_SIZE).
+ * @param params The compression parameters (with the work buffers of a
+ *               block_size block, or they are allocated).
+ * @return The compressed data length (in bytes) or (size_t) -1 in case of
+ *         an error.
+ */
+size_t srz_compress_iov(const struct iovec *iov, int iovcnt, void *dst,
+                        size_t capacity, int block_size,
+                        const srz_params *params);
+
+/** 
+ * Decompresses a buffer into a buffer.
+ * @param src The compressed data.
+ * @param length The number of bytes of the compressed data.
+ * @param dst The destination array.
+ * @param capacity The size of the destination array (see
+ *                 srz_get_decompressed_size).
+ * @param params The decompression parameters (only the dictionary, the
+ *               profiling counters and the work buffers are used).
+ * @return The decompressed data length (in bytes) or (size_t) -1 in case
+ *         of an error.
+ */
+size_t srz_decompress_buffer(const void *src, size_t length, void *dst,
+                             size_t capacity, const srz_params *params);
+
+/** 
+ * Allocates the state of linked blocks (the next block is independent).
+ * @return The state (or NULL in case of error).
+ */
+srz_state *srz_state_alloc();
+
+/** 
+ * Resets the state of linked blocks (the next block will be independent,
+ * a reset point).
+ * @param state The state to reset.
+ */
+void srz_state_reset(srz_state *state);
+
+/** 
+ * Releases the state of linked blocks.
+ * @param state The state to release.
+ */
+void srz_state_free(srz_state *state);
+
+/** 
+ * Calculates the size of the destination array of compress_block (the data
+ * that can't be compressed into less bytes than its own size is stored).
+ * @param length The number of words in the source array.
+ * @return The size (in bytes) of the destination array.
+ */
+size_t compress_block_bound(size_t length);
 
 /** 
  * Compress a data block. 
  * @param src The source array of words (to be compressed).
- * @param dst The destination array of bytes (its size must be double the
- *            source array size).
+ * @param dst The destination array of bytes (its size must be
+ *            compress_block_bound(length) bytes).
  * @param length The number of words in the source array.
  * @param last_byte Value of the last byte (before second separation). 
- * @param use_previous_byte Use the median value of the previous byte
- *                          to achieve a better sorting.
- * @return The compressed data length (in bytes) or negative number
- *         in case of an error.  
+ * @param params The compression parameters.
+ * @return The compressed data length (in bytes, smaller than the source
+ *         array), SRZ_NOT_COMPRESSED if the data can't be compressed (or
+ *         doesn't save params->min_savings percent) or (size_t) -1 in case
+ *         of an error.
  */
 size_t compress_block(unsigned short *src, unsigned char *dst, size_t length,
-                    unsigned char *last_byte, bool use_previous_byte);
+                    unsigned char *last_byte, const srz_params *params);
+
+/** 
+ * Compress a data block read from a list of fragments (a word can straddle
+ * two fragments).
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the block in the fragments.
+ * @param dst The destination array of bytes (its size must be
+ *            compress_block_bound(length) bytes).
+ * @param length The number of words in the block (the last byte is padded
+ *               with a 0 if the fragments end in the middle of a word).
+ * @param last_word Value of the last word (before separation).
+ * @param last_byte Value of the last byte (before second separation). 
+ * @param params The compression parameters.
+ * @return The compressed data length (in bytes, smaller than the source
+ *         data), SRZ_NOT_COMPRESSED if the data can't be compressed (or
+ *         doesn't save params->min_savings percent) or (size_t) -1 in case
+ *         of an error.
+ */
+size_t compress_block_iov(const struct iovec *iov, int iovcnt, size_t offset,
+                          unsigned char *dst, size_t length,
+                          unsigned short *last_word, unsigned char *last_byte,
+                          const srz_params *params);
 
 
 /* ======================================================================== */
 /** 
  * Decompress a data block.
- * @param src The source array of bytes (to be decopressed).
+ * @param src The source array of bytes (to be decopressed). Its size must be
+ *            compress_block_bound(length) bytes because it is used as
+ *            temporary data.
  * @param dst The destination array of words.
  * @param last_word Value of the last word (before separation).
  * @param last_byte Value of the last byte (before second separation).
  * @param length The number of words in the destination array.
- * @param use_previous_byte Use the median value of the previous byte
- *                          to achieve a better sorting.
+ * @param params The compression parameters (the same used to compress).
  * @return The decompressed data length (in bytes) or negative number
  *         in case of an error.   
  */
 size_t decompress_block(unsigned char *src, unsigned short *dst,
                       unsigned short last_word, unsigned char last_byte,
-                      size_t length, bool use_previous_byte);
+                      size_t length, const srz_params *params);
+
+/** 
+ * Decompress a data block through a sink: the words are given to the sink
+ * in pieces as soon as they are joined, so the whole block is never in the
+ * output buffer.
+ * @param src The source array of bytes (to be decopressed). Its size must be
+ *            compress_block_bound(length) bytes because it is used as
+ *            temporary data.
+ * @param buffer The output buffer of the pieces.
+ * @param buffer_length The number of words of the output buffer.
+ * @param last_word Value of the last word (before separation).
+ * @param last_byte Value of the last byte (before second separation).
+ * @param length The number of words of the block.
+ * @param params The compression parameters (the same used to compress).
+ * @param sink The function that receives the pieces.
+ * @param opaque The pointer given to the sink.
+ * @return The decompressed data length (in bytes) or negative number
+ *         in case of an error.   
+ */
+size_t decompress_block_stream(unsigned char *src, unsigned short *buffer,
+                               size_t buffer_length, unsigned short last_word,
+                               unsigned char last_byte, size_t length,
+                               const srz_params *params, srz_sink sink,
+                               void *opaque);
 
 
 #endif
\ No newline at end of file
@@ -1,5 +1,5 @@
-/* A function to split the data into 65536 2-byte groups based on 
-   the previous 2 bytes.
+/* A function to split the data into 2-byte groups based on the context
+   of the previous bytes.
 
    Copyright (C) 2022 Abraham Macias Paredes.
    
@@ -24,29 +24,430 @@
 /* number of symbols */
 #define NSYMBOLS 65536
 
-/* Median value of the byte previous to each symbol. */
-unsigned char median[NSYMBOLS];
+/* Multiplier of the context hash function (golden ratio) */
+#define HASH_MULTIPLIER 0x9E3779B1u
+
+/* The loops are inline templates: every instance is specialized for a
+   context mode, the use of the previous byte and the layout of the buckets */
+#ifdef __GNUC__
+#define WS_TEMPLATE static inline __attribute__((always_inline))
+#else
+#define WS_TEMPLATE static inline
+#endif
+
+/* Calls the instance of a template for a context mode (the mode is a
+   constant in every instance) */
+#define WS_SPECIALIZE_MODE(mode, call, ...)                              \
+  switch (mode) {                                                        \
+    case WS_CONTEXT_BYTE:                                                \
+      call(WS_CONTEXT_BYTE, __VA_ARGS__);                                \
+      break;                                                             \
+    case WS_CONTEXT_HASH3:                                               \
+      call(WS_CONTEXT_HASH3, __VA_ARGS__);                               \
+      break;                                                             \
+    case WS_CONTEXT_HASH4:                                               \
+      call(WS_CONTEXT_HASH4, __VA_ARGS__);                               \
+      break;                                                             \
+    default:                                                             \
+      call(WS_CONTEXT_WORD, __VA_ARGS__);                                \
+      break;                                                             \
+  }
+
+/* Calls the instance of a template for a context mode and the use of the
+   previous byte */
+#define WS_SPECIALIZE_PREVIOUS(mode, use_previous_byte, call, ...)       \
+  if (use_previous_byte) {                                               \
+    WS_SPECIALIZE_MODE(mode, call, true, __VA_ARGS__)                    \
+  }                                                                      \
+  else {                                                                 \
+    WS_SPECIALIZE_MODE(mode, call, false, __VA_ARGS__)                   \
+  }
+
+/* Calls the instance of a template for a context mode, the use of the
+   previous byte and the layout of the buckets (the runtime dispatch is done
+   once per block) */
+#define WS_SPECIALIZE(mode, use_previous_byte, narrow, call, ...)        \
+  if (narrow) {                                                          \
+    WS_SPECIALIZE_PREVIOUS(mode, use_previous_byte, call, true,          \
+                           __VA_ARGS__)                                  \
+  }                                                                      \
+  else {                                                                 \
+    WS_SPECIALIZE_PREVIOUS(mode, use_previous_byte, call, false,         \
+                           __VA_ARGS__)                                  \
+  }
+
+/**
+ * Reader of the words of a list of fragments.
+ */
+typedef struct {
+  const struct iovec *iov;
+  int iovcnt;
+  int index;                  /* Current fragment. */
+  const unsigned char *data;  /* Next byte of the current fragment. */
+  size_t left;                /* Bytes left in the current fragment. */
+} ws_iov_reader;
+
+/* ======================================================================== */
+/**
+ * Allocates a word separator context.
+ * @param mode The context mode (WS_CONTEXT_*).
+ * @param bits Number of groups (in bits) for the hashed contexts.
+ * @return A ws_context structure (or NULL in case of error).
+ */
+ws_context *ws_alloc(int mode, int bits) {
+  ws_context *ctx;
+
+  ctx = (ws_context *) malloc(sizeof(ws_context));
+  if (ctx == NULL) {
+    return NULL;
+  }
+  memset(ctx, 0, sizeof(ws_context));
+
+  ctx->mode = mode;
+  switch (mode) {
+    case WS_CONTEXT_BYTE:
+      ctx->bits = 8;
+      break;
+    case WS_CONTEXT_WORD:
+      ctx->bits = 16;
+      break;
+    case WS_CONTEXT_HASH3:
+    case WS_CONTEXT_HASH4:
+      if (bits < WS_HASH_MIN_BITS || bits > WS_HASH_MAX_BITS) {
+        free(ctx);
+        return NULL;
+      }
+      ctx->bits = bits;
+      break;
+    default:
+      free(ctx);
+      return NULL;
+  }
+  ctx->groups = (1 << ctx->bits);
+
+  ctx->count = (int *) malloc(ctx->groups * sizeof(int));
+  ctx->buckets = (ws_bucket *) malloc(ctx->groups * sizeof(ws_bucket));
+  if (ctx->count == NULL || ctx->buckets == NULL) {
+    ws_free(ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+/* ======================================================================== */
+/**
+ * Releases the memory of a word separator context.
+ * @param ctx The ws_context to release.
+ */
+void ws_free(ws_context *ctx) {
+  if (ctx == NULL) {
+    return;
+  }
+
+  free(ctx->count);
+  free(ctx->buckets);
+  free(ctx);
+}
+
+/* ======================================================================== */
+/**
+ * Sets the median of a group (in the current layout of the buckets).
+ * @param ctx The word separator context.
+ * @param g The group.
+ * @param median The median value.
+ */
+static inline void _ws_set_median(ws_context *ctx, int g,
+                                  unsigned char median) {
+  if (ctx->narrow) {
+    ((ws_bucket16 *) ctx->buckets)[g].median = median;
+  }
+  else {
+    ctx->buckets[g].median = median;
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Changes the layout of the buckets (the medians are kept, the positions
+ * are calculated again by every block).
+ * @param ctx The word separator context.
+ * @param narrow Use 16-bit offsets.
+ */
+static void _ws_set_layout(ws_context *ctx, bool narrow) {
+  ws_bucket16 *buckets16 = (ws_bucket16 *) ctx->buckets;
+  int g;
+  
+  if (ctx->narrow == narrow) {
+    return;
+  }
+  
+  // (The narrow buckets are smaller: they are packed from the first one
+  // and unpacked from the last one not to overwrite the next medians)
+  if (narrow) {
+    for (g = 0; g < ctx->groups; g++) {
+      buckets16[g].median = ctx->buckets[g].median;
+    }
+  }
+  else {
+    for (g = ctx->groups - 1; g >= 0; g--) {
+      ctx->buckets[g].median = buckets16[g].median;
+    }
+  }
+  ctx->narrow = narrow;
+}
+
+/* ======================================================================== */
+/**
+ * Sets every median of a word separator context to the initial value.
+ * @param ctx The word separator context.
+ */
+static void _ws_reset_median(ws_context *ctx) {
+  ws_bucket16 *buckets16 = (ws_bucket16 *) ctx->buckets;
+  int g, groups = ctx->groups;
+  
+  // (The layout is checked once, not for every group)
+  if (ctx->narrow) {
+    for (g = 0; g < groups; g++) {
+      buckets16[g].median = 127;
+    }
+  }
+  else {
+    for (g = 0; g < groups; g++) {
+      ctx->buckets[g].median = 127;
+    }
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Primes a word separator context with the state left by previous data
+ * (the context is used by the next separate_words or join_words call).
+ * @param ctx The word separator context.
+ * @param median The median table of the previous data (or NULL).
+ * @param groups The number of groups of the median table (a power of 2,
+ *               it is adapted to the groups of the context).
+ * @param previous The last word of the previous data.
+ * @param previous2 The word before the last one.
+ */
+void ws_prime(ws_context *ctx, const unsigned char *median, int groups,
+              unsigned short previous, unsigned short previous2) {
+  int g, shift;
+  
+  ctx->previous = previous;
+  ctx->previous2 = previous2;
+  ctx->primed = false;
+  
+  if (median == NULL || groups <= 0) {
+    return;
+  }
+  
+  // (The hashed groups are the higher bits of the hash)
+  if (groups >= ctx->groups) {
+    for (shift = 0; (ctx->groups << shift) < groups; shift++) {
+    }
+    for (g = 0; g < ctx->groups; g++) {
+      _ws_set_median(ctx, g, median[g << shift]);
+    }
+  }
+  else {
+    for (shift = 0; (groups << shift) < ctx->groups; shift++) {
+    }
+    for (g = 0; g < ctx->groups; g++) {
+      _ws_set_median(ctx, g, median[g >> shift]);
+    }
+  }
+  ctx->primed = true;
+}
+
+/* ======================================================================== */
+/**
+ * Gets the median table of a word separator context (the state left by the
+ * last separate_words or join_words call).
+ * @param ctx The word separator context.
+ * @param median An array of ctx->groups bytes that will contain the table.
+ */
+void ws_get_median(const ws_context *ctx, unsigned char *median) {
+  const ws_bucket16 *buckets16 = (const ws_bucket16 *) ctx->buckets;
+  int g;
+  
+  for (g = 0; g < ctx->groups; g++) {
+    median[g] = ctx->narrow ? buckets16[g].median : ctx->buckets[g].median;
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Checks if the group sizes of a context mode must be stored with the data.
+ * (The hashed contexts can't be calculated from the separated words).
+ * @param mode The context mode (WS_CONTEXT_*).
+ * @return true if the group sizes must be stored.
+ */
+bool ws_stores_counts(int mode) {
+  return (mode == WS_CONTEXT_HASH3 || mode == WS_CONTEXT_HASH4);
+}
+
+/* ======================================================================== */
+/**
+ * Calculates the group of a word for a context mode.
+ * @param mode The context mode (a constant in the templates).
+ * @param bits Number of groups (in bits) for the hashed contexts.
+ * @param previous The previous word.
+ * @param previous2 The word before the previous one.
+ * @return The group of the word.
+ */
+WS_TEMPLATE unsigned int _ws_group_mode(int mode, int bits,
+                                        unsigned short previous,
+                                        unsigned short previous2) {
+  switch (mode) {
+    case WS_CONTEXT_BYTE:
+      return (previous >> 8);
+    case WS_CONTEXT_HASH3:
+      return ((((unsigned int) (previous2 >> 8) << 16) | previous)
+              * HASH_MULTIPLIER) >> (32 - bits);
+    case WS_CONTEXT_HASH4:
+      return ((((unsigned int) previous2 << 16) | previous)
+              * HASH_MULTIPLIER) >> (32 - bits);
+    default:
+      return previous;
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Calculates the group of a word.
+ * @param ctx The word separator context.
+ * @param previous The previous word.
+ * @param previous2 The word before the previous one.
+ * @return The group of the word.
+ */
+static inline unsigned int _ws_group(ws_context *ctx, unsigned short previous,
+                                     unsigned short previous2) {
+  return _ws_group_mode(ctx->mode, ctx->bits, previous, previous2);
+}
+
+/* ======================================================================== */
+/**
+ * Takes the next position of a group with the median of the previous byte:
+ * the words whose previous byte is not above the median go to the front of
+ * the group and the rest to the back. The median moves one step towards the
+ * previous byte. (The outcome of the comparisons is close to random on real
+ * data, so both ends and the median are updated with arithmetic instead of
+ * branches).
+ * @param narrow The buckets use 16-bit offsets (a constant in the templates).
+ * @param buckets The buckets of the groups.
+ * @param group The group of the word.
+ * @param prev_byte The previous byte.
+ * @return The position of the word.
+ */
+WS_TEMPLATE int _ws_median_next(const bool narrow, ws_bucket *buckets,
+                                unsigned int group, int prev_byte) {
+  int m, front, f, b;
+  
+  if (narrow) {
+    ws_bucket16 *bucket = ((ws_bucket16 *) buckets) + group;
+    
+    m = bucket->median;
+    f = bucket->front;
+    b = bucket->back;
+    front = (m >= prev_byte);
+    bucket->front = f + front;
+    bucket->back = b - (front ^ 1);
+    bucket->median = (unsigned char) (m + (m < prev_byte) - (m > prev_byte));
+  }
+  else {
+    ws_bucket *bucket = buckets + group;
+    
+    m = bucket->median;
+    f = bucket->front;
+    b = bucket->back;
+    front = (m >= prev_byte);
+    bucket->front = f + front;
+    bucket->back = b - (front ^ 1);
+    bucket->median = (unsigned char) (m + (m < prev_byte) - (m > prev_byte));
+  }
+
+  return b + ((f - b) & -front);
+}
+
+/* ======================================================================== */
+/**
+ * Takes the next position at the front of a group.
+ * @param narrow The buckets use 16-bit offsets (a constant in the templates).
+ * @param buckets The buckets of the groups.
+ * @param group The group of the word.
+ * @return The position of the word.
+ */
+WS_TEMPLATE int _ws_front_next(const bool narrow, ws_bucket *buckets,
+                               unsigned int group) {
+  if (narrow) {
+    return ((ws_bucket16 *) buckets)[group].front++;
+  }
+  return buckets[group].front++;
+}
+
+/* ======================================================================== */
+/**
+ * Checks if every position of a group is taken.
+ * @param narrow The buckets use 16-bit offsets (a constant in the templates).
+ * @param buckets The buckets of the groups.
+ * @param group The group.
+ * @return true if the group is full.
+ */
+WS_TEMPLATE bool _ws_bucket_full(const bool narrow, ws_bucket *buckets,
+                                 unsigned int group) {
+  if (narrow) {
+    // (The offsets wrap around at the ends of a block of 65536 words)
+    return ((unsigned short) (((ws_bucket16 *) buckets)[group].back + 1)
+            == ((ws_bucket16 *) buckets)[group].front);
+  }
+  return (buckets[group].front > buckets[group].back);
+}
 
 /* ======================================================================== */
 /** 
- * Count words in an array. 
- * @param src The source data whose words will be counted.
+ * Count groups in an array (template).
+ * @param mode The context mode.
+ * @param src The source data whose groups will be counted.
  * @param len The number of words in the source data.
- * @param count An array of 65536*sizeof(int) bytes that will
- *              contain the counts.
+ * @param ctx The word separator context.
  */
-void count_words(unsigned short *src, int len, int *count) {
+WS_TEMPLATE void _ws_count_groups(const int mode, unsigned short *src,
+                                  int len, ws_context *ctx) {
   int i;
+  int *count = ctx->count;
+  int bits = ctx->bits;
+  unsigned short previous, previous2;
 
-  memset(count, 0, NSYMBOLS*sizeof(int));
-
+  // (The first word is grouped in the context of the previous data)
+  previous = ctx->previous;
+  previous2 = ctx->previous2;
   for (i = 0; i < len; i++) {
-    count[ src[i] ]++;
+    count[ _ws_group_mode(mode, bits, previous, previous2) ]++;
+    previous2 = previous;
+    previous = src[i];
   }
+}
+
+/* ======================================================================== */
+/** 
+ * Count groups in an array. 
+ * @param src The source data whose groups will be counted.
+ * @param len The number of words in the source data.
+ * @param ctx The word separator context (ctx->count will
+ *            contain the counts).
+ */
+void count_groups(unsigned short *src, int len, ws_context *ctx) {
+#ifdef DEBUG_COUNTS
+  int i;
+#endif
+
+  memset(ctx->count, 0, ctx->groups*sizeof(int));
+  WS_SPECIALIZE_MODE(ctx->mode, _ws_count_groups, src, len, ctx)
   
 #ifdef DEBUG_COUNTS
-  for (i = 0; i < NSYMBOLS; i++) {
-    fprintf(stdout, "Count[%i] = %li\n", i, count[i]);
+  for (i = 0; i < ctx->groups; i++) {
+    fprintf(stdout, "Count[%i] = %i\n", i, ctx->count[i]);
   }
 #endif
   
@@ -54,51 +455,149 @@ void count_words(unsigned short *src, int len, int *count) {
 
 /* ======================================================================== */
 /** 
- * Calculate the indexes of the destination array. 
- * @param count An array of 65536*sizeof(int) bytes that will
- *              contain the counts.
- * @param index An array of 65536*sizeof(int) bytes that will
- *              contain the indexes. 
+ * Count the groups of the words in an array (template).
+ * @param mode The context mode (only the previous word is used).
+ * @param src The source data whose words will be counted.
+ * @param len The number of words in the source data.
+ * @param ctx The word separator context.
  */
-void calculate_indexes(int *count, int *index) {
+WS_TEMPLATE void _ws_count_words(const int mode, unsigned short *src,
+                                 int len, ws_context *ctx) {
   int i;
+  int *count = ctx->count;
+  int bits = ctx->bits;
 
-  index[0] = 0;
-  for (i = 1; i < NSYMBOLS; i++) {
-    index[i] = index[i-1] + count[i-1];
-  }
-	
-#ifdef DEBUG_INDEX
-  for (i = 0; i < NSYMBOLS; i++) {
-    fprintf(stdout, "Index[%i] = %li\n", i, index[i]);
+  for (i = 0; i < len; i++) {
+    count[ _ws_group_mode(mode, bits, src[i], 0) ]++;
   }
-#endif	
 }
 
 /* ======================================================================== */
 /** 
- * Calculate the last indexes of the destination array. 
- * @param count An array of 65536*sizeof(int) bytes that will
- *              contain the counts.
- * @param lindex An array of 65536*sizeof(int) bytes that will
- *              contain the indexes. 
- * @param length The number of words in the source array.
+ * Count the groups of the words in an array (without knowing their order).
+ * @param src The source data whose words will be counted.
+ * @param len The number of words in the source data.
+ * @param last Value of the last word (before separation).
+ * @param ctx The word separator context (ctx->count will
+ *            contain the counts).
  */
-void calculate_last_indexes(int *count, int *lindex, int length) {
+void count_words(unsigned short *src, int len, unsigned short last,
+                 ws_context *ctx) {
+#ifdef DEBUG_COUNTS
   int i;
+#endif
+  int *count;
+
+  count = ctx->count;
+  memset(count, 0, ctx->groups*sizeof(int));
 
-  lindex[NSYMBOLS-1] = length-1;
-  for (i=NSYMBOLS-2; i>=0; i--) {
-    lindex[i] = lindex[i+1] - count[i+1];
+  WS_SPECIALIZE_MODE(ctx->mode, _ws_count_words, src, len, ctx)
+  // (There is no word after last, but the first word has a context!)
+  count[ _ws_group(ctx, last, 0) ]--;
+  count[ _ws_group(ctx, ctx->previous, 0) ]++;
+  
+#ifdef DEBUG_COUNTS
+  for (i = 0; i < ctx->groups; i++) {
+    fprintf(stdout, "Count[%i] = %i\n", i, count[i]);
   }
+#endif
+  
+}
+
+/* ======================================================================== */
+/** 
+ * Calculate the indexes of the destination array (template).
+ * @param narrow The buckets use 16-bit offsets.
+ * @param ctx The word separator context (the fronts of ctx->buckets will
+ *            contain the first index of every group and the backs the
+ *            last one).
+ */
+WS_TEMPLATE void _ws_calculate_indexes(const bool narrow, ws_context *ctx) {
+  int i, index, groups;
+  int *count = ctx->count;
+  ws_bucket *buckets = ctx->buckets;
+  ws_bucket16 *buckets16 = (ws_bucket16 *) ctx->buckets;
 
+  index = 0;
+  groups = ctx->groups;
+  for (i = 0; i < groups; i++) {
+    if (narrow) {
+      buckets16[i].front = (unsigned short) index;
+      buckets16[i].back = (unsigned short) (index + count[i] - 1);
+    }
+    else {
+      buckets[i].front = index;
+      buckets[i].back = index + count[i] - 1;
+    }
 #ifdef DEBUG_INDEX
-  for (i = 0; i < NSYMBOLS; i++) {
-    fprintf(stdout, "Last Index[%i] = %li\n", i, lindex[i]);
+    fprintf(stdout, "Index[%i] = %i, Last Index[%i] = %i\n", i, index, i,
+            index + count[i] - 1);
+#endif	
+    index += count[i];
+  }
+}
+
+/* ======================================================================== */
+/** 
+ * Calculate the indexes of the destination array. 
+ * @param ctx The word separator context (the fronts of ctx->buckets will
+ *            contain the first index of every group and the backs the
+ *            last one).
+ */
+void calculate_indexes(ws_context *ctx) {
+  if (ctx->narrow) {
+    _ws_calculate_indexes(true, ctx);
+  }
+  else {
+    _ws_calculate_indexes(false, ctx);
   }
-#endif  
 }
 
+/* ======================================================================== */
+/** 
+ * Separate words (template).
+ * @param mode The context mode.
+ * @param use_previous_byte Use the median value of the previous byte.
+ * @param narrow The buckets use 16-bit offsets.
+ * @param src The source array of words.
+ * @param dst The destination array of words.
+ * @param length The number of words in the source array.
+ * @param ctx The word separator context (with the indexes).
+ */
+WS_TEMPLATE void _ws_separate(const int mode, const bool use_previous_byte,
+                              const bool narrow, unsigned short *src,
+                              unsigned short *dst, int length,
+                              ws_context *ctx) {
+  long i;
+  unsigned short previous, previous2;
+  unsigned short current;
+  unsigned int group;
+  ws_bucket *buckets = ctx->buckets;
+  int bits = ctx->bits;
+  int prev_byte;
+
+  previous = ctx->previous;
+  previous2 = ctx->previous2;
+  prev_byte = (previous2 & 0xFF);
+  for (i = 0; i < length; i++) {
+    current = src[i];
+    group = _ws_group_mode(mode, bits, previous, previous2);
+
+    if (use_previous_byte) {
+      dst[ _ws_median_next(narrow, buckets, group, prev_byte) ] = current;
+      prev_byte = (previous & 0xFF);
+    } 
+    else {   
+#ifdef DEBUG
+      fprintf(stdout, "dst[]=%i (group=%i)\n", current, group);
+#endif
+      dst[ _ws_front_next(narrow, buckets, group) ] = current;
+    }   
+    
+    previous2 = previous;
+    previous = current;
+  }
+}
 
 /* ======================================================================== */
 /** 
@@ -108,155 +607,355 @@ void calculate_last_indexes(int *count, int *lindex, int length) {
  * @param length The number of words in the source array.
  * @param use_previous_byte Use the median value of the previous byte
  *                          to achieve a better sorting.
+ * @param ctx The word separator context (ctx->count will contain
+ *            the size of every group).
  */
 void separate_words(unsigned short *src, unsigned short *dst, int length,
-                    bool use_previous_byte) {
-  long i;
-  unsigned short previous;
-  unsigned short current;
-  int count[NSYMBOLS];
-  int index[NSYMBOLS];
-  int lindex[NSYMBOLS];
-  int prev_byte;
+                    bool use_previous_byte, ws_context *ctx) {
+  _ws_set_layout(ctx, length <= WS_NARROW_LENGTH);
+  if (use_previous_byte && !ctx->primed) {
+    _ws_reset_median(ctx);
+  }
+  
+  // Count the groups
+  count_groups(src, length, ctx);
+  
+  // Calculate the indexes
+  calculate_indexes(ctx);
 
-  if (use_previous_byte) {
-      memset(median, 127, NSYMBOLS*sizeof(unsigned char));
+  // Separate the words (with the instance of the mode and layout)
+  WS_SPECIALIZE(ctx->mode, use_previous_byte, ctx->narrow, _ws_separate, src,
+                dst, length, ctx)
+}
+
+/* ======================================================================== */
+/**
+ * Initializes a reader of the words of a list of fragments.
+ * @param reader The reader.
+ * @param iov The fragments.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the first word.
+ */
+static void _ws_iov_init(ws_iov_reader *reader, const struct iovec *iov,
+                         int iovcnt, size_t offset) {
+  reader->iov = iov;
+  reader->iovcnt = iovcnt;
+  reader->index = -1;
+  reader->data = NULL;
+  reader->left = 0;
+  
+  // Skip the fragments before the offset
+  while (reader->index + 1 < iovcnt) {
+    reader->index++;
+    if (offset < iov[reader->index].iov_len) {
+      reader->data = (const unsigned char *) iov[reader->index].iov_base
+                     + offset;
+      reader->left = iov[reader->index].iov_len - offset;
+      break;
+    }
+    offset -= iov[reader->index].iov_len;
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Reads the next byte of a list of fragments.
+ * @param reader The reader.
+ * @return The byte (0 after the end of the fragments).
+ */
+static unsigned char _ws_iov_next_byte(ws_iov_reader *reader) {
+  while (reader->left == 0) {
+    if (reader->index + 1 >= reader->iovcnt) {
+      return 0;
+    }
+    reader->index++;
+    reader->data = (const unsigned char *) reader->iov[reader->index].iov_base;
+    reader->left = reader->iov[reader->index].iov_len;
   }
   
-  // Count the words
-  count_words(src, length, count);
-  // (There is no word after last!)
-  count[src[length -1]]--;
-  count[0]++;  
+  reader->left--;
+  return *(reader->data++);
+}
+
+/* ======================================================================== */
+/**
+ * Reads the next word of a list of fragments.
+ * @param reader The reader.
+ * @return The word.
+ */
+static inline unsigned short _ws_iov_next(ws_iov_reader *reader) {
+  unsigned short word;
+  unsigned char bytes[2];
   
+  if (reader->left >= 2) {
+    // (The fragments don't need to be aligned)
+    memcpy(&word, reader->data, sizeof(word));
+    reader->data += 2;
+    reader->left -= 2;
+    return word;
+  }
   
-  // Calculate the indexes
-  calculate_indexes(count, index);
+  // The word straddles two fragments (or it is the padded last word)
+  bytes[0] = _ws_iov_next_byte(reader);
+  bytes[1] = _ws_iov_next_byte(reader);
+  memcpy(&word, bytes, sizeof(word));
+  return word;
+}
+
+/* ======================================================================== */
+/** 
+ * Count the groups of the words of a list of fragments (template).
+ * @param mode The context mode.
+ * @param reader The reader of the fragments (at the first word).
+ * @param length The number of words.
+ * @param ctx The word separator context.
+ */
+WS_TEMPLATE void _ws_count_groups_iov(const int mode, ws_iov_reader *reader,
+                                      int length, ws_context *ctx) {
+  long i;
+  int *count = ctx->count;
+  int bits = ctx->bits;
+  unsigned short previous, previous2;
   
-  if (use_previous_byte) {
-	calculate_last_indexes(count, lindex, length);
-  } 
+  previous = ctx->previous;
+  previous2 = ctx->previous2;
+  for (i = 0; i < length; i++) {
+    count[ _ws_group_mode(mode, bits, previous, previous2) ]++;
+    previous2 = previous;
+    previous = _ws_iov_next(reader);
+  }
+}
 
-  // Separate the words
-  previous = 0;
-  prev_byte = 0; 
+/* ======================================================================== */
+/** 
+ * Separate the words of a list of fragments (template).
+ * @param mode The context mode.
+ * @param use_previous_byte Use the median value of the previous byte.
+ * @param narrow The buckets use 16-bit offsets.
+ * @param reader The reader of the fragments (at the first word).
+ * @param dst The destination array of words.
+ * @param length The number of words.
+ * @param ctx The word separator context (with the indexes).
+ * @param last An array of 2 words that will contain the last word and the
+ *             previous one.
+ */
+WS_TEMPLATE void _ws_separate_iov(const int mode, const bool use_previous_byte,
+                                  const bool narrow, ws_iov_reader *reader,
+                                  unsigned short *dst, int length,
+                                  ws_context *ctx,
+                                  unsigned short *last) {
+  long i;
+  unsigned short previous, previous2;
+  unsigned short current;
+  unsigned int group;
+  ws_bucket *buckets = ctx->buckets;
+  int bits = ctx->bits;
+  int prev_byte;
+  
+  previous = ctx->previous;
+  previous2 = ctx->previous2;
+  prev_byte = (previous2 & 0xFF);
   for (i = 0; i < length; i++) {
-    current = src[i];
+    current = _ws_iov_next(reader);
+    group = _ws_group_mode(mode, bits, previous, previous2);
 
     if (use_previous_byte) {
-#ifdef DEBUG
-      fprintf(stdout, "median[previous]=%i)\n", median[previous]);
-#endif    
-      if (median[previous] >= prev_byte) {
-#ifdef DEBUG
-        fprintf(stdout, "dst[%li]=%i (previous=%i)\n", index[previous],
-            current, previous);
-#endif
-        dst[ index[previous]++ ] = current;
-      }
-      else {
-        dst[ lindex[previous]-- ] = current;
-      }
-	} 
-    else {   
-#ifdef DEBUG
-      fprintf(stdout, "dst[%li]=%i (previous=%i)\n", index[previous],
-          current, previous);
-#endif
-      dst[ index[previous]++ ] = current;
-    }   
-    
-    if (use_previous_byte) {   
-      if (median[previous] < prev_byte) {
-        median[previous]++;
-      }
-      else if (median[previous] > prev_byte) {
-        median[previous]--;
-      }
+      dst[ _ws_median_next(narrow, buckets, group, prev_byte) ] = current;
       prev_byte = (previous & 0xFF);
     }
+    else {
+      dst[ _ws_front_next(narrow, buckets, group) ] = current;
+    }
+    
+    previous2 = previous;
     previous = current;
   }
-
+  
+  last[0] = previous;
+  last[1] = previous2;
 }
 
 /* ======================================================================== */
 /** 
- * Join words. (Reverse the separate_words operation).
- * @param src The source array of words (to be joined from groups).
+ * Separate words read from a list of fragments (without copying them into
+ * an array). A word can straddle two fragments and the last byte is padded
+ * with a 0 if the number of bytes is odd.
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the first word.
  * @param dst The destination array of words.
- * @param last Value of the last word (before separation).
- * @param length The number of words in the source array.
+ * @param length The number of words to separate.
  * @param use_previous_byte Use the median value of the previous byte
  *                          to achieve a better sorting.
+ * @param ctx The word separator context (ctx->count will contain
+ *            the size of every group).
+ * @param last An array of 2 words that will contain the last word and the
+ *             previous one (the context of the next data).
  */
-void join_words(unsigned short *src, unsigned short *dst, unsigned short last,
-                int length, bool use_previous_byte) {
-  long i;
-  unsigned short previous;
-  unsigned short current;
-  int count[NSYMBOLS];
-  int index[NSYMBOLS];
-  int lindex[NSYMBOLS];
-  int prev_byte; 
+void separate_words_iov(const struct iovec *iov, int iovcnt, size_t offset,
+                        unsigned short *dst, int length,
+                        bool use_previous_byte, ws_context *ctx,
+                        unsigned short *last) {
+  ws_iov_reader reader;
 
-  if (use_previous_byte) {
-    memset(median, 127, NSYMBOLS*sizeof(unsigned char));
-  }    
+  _ws_set_layout(ctx, length <= WS_NARROW_LENGTH);
+  if (use_previous_byte && !ctx->primed) {
+    _ws_reset_median(ctx);
+  }
   
-  // Count the words
-  count_words(src, length, count);
-  // (There is no word after last!)
-  count[last]--;
-  count[0]++;
+  // Count the groups (first pass)
+  memset(ctx->count, 0, ctx->groups*sizeof(int));
+  _ws_iov_init(&reader, iov, iovcnt, offset);
+  WS_SPECIALIZE_MODE(ctx->mode, _ws_count_groups_iov, &reader, length, ctx)
   
   // Calculate the indexes
-  calculate_indexes(count, index);
-  
-  if (use_previous_byte) {
-	calculate_last_indexes(count, lindex, length);
-  } 
+  calculate_indexes(ctx);
   
-  // join the words    
-  previous = 0;
-  prev_byte = 0; 
+  // Separate the words (second pass)
+  _ws_iov_init(&reader, iov, iovcnt, offset);
+  WS_SPECIALIZE(ctx->mode, use_previous_byte, ctx->narrow, _ws_separate_iov,
+                &reader, dst, length, ctx, last)
+}
+
+/* ======================================================================== */
+/** 
+ * Join words (template).
+ * @param mode The context mode.
+ * @param use_previous_byte Use the median value of the previous byte.
+ * @param narrow The buckets use 16-bit offsets.
+ * @param src The source array of words (grouped).
+ * @param dst The destination array of the next words.
+ * @param length The number of words to join.
+ * @param ctx The word separator context (with the indexes and the context
+ *            of the next word, which is updated).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+WS_TEMPLATE int _ws_join(const int mode, const bool use_previous_byte,
+                         const bool narrow, unsigned short *src,
+                         unsigned short *dst, int length, ws_context *ctx) {
+  long i;
+  unsigned short previous, previous2;
+  unsigned short current;
+  unsigned int group;
+  ws_bucket *buckets = ctx->buckets;
+  int bits = ctx->bits;
+  int prev_byte; 
+
+  previous = ctx->previous;
+  previous2 = ctx->previous2;
+  prev_byte = (previous2 & 0xFF);
   for (i = 0; i < length; i++) {
+    group = _ws_group_mode(mode, bits, previous, previous2);
+    
+    // A group can't have more words than its size
+    if (_ws_bucket_full(narrow, buckets, group)) {
+      return -1;
+    }
     
     if (use_previous_byte) {
-#ifdef DEBUG
-      fprintf(stdout, "median[previous]=%i)\n", median[previous]);
-#endif    
-      if (median[previous] >= prev_byte) {
-#ifdef DEBUG
-        fprintf(stdout, "dst[%li]=%i (previous=%i)\n", index[previous],
-                src[index[previous]], previous);
-#endif
-        current = src[ index[previous]++ ];
-      }
-      else {
-        current = src[ lindex[previous]-- ];
-      }
+      current = src[ _ws_median_next(narrow, buckets, group, prev_byte) ];
+      prev_byte = (previous & 0xFF);
     }
     else {
+      current = src[ _ws_front_next(narrow, buckets, group) ];
 #ifdef DEBUG
-      fprintf(stdout, "dst[%li]=%i (previous=%i)\n", index[previous],
-              src[index[previous]], previous);
+      fprintf(stdout, "dst[%li]=%i (group=%i)\n", i, current, group);
 #endif
-      current = src[ index[previous]++ ];
     }    
     
-    if (use_previous_byte) {    
-      if (median[previous] < prev_byte) {
-        median[previous]++;
-      }
-      else if (median[previous] > prev_byte) {
-        median[previous]--;
-      }
-      prev_byte = (previous & 0xFF);
-    }
-
     dst[i] = current;
+    previous2 = previous;
     previous = current;
   }
 
+  // (The next words are joined with the context of the last ones)
+  ctx->previous = previous;
+  ctx->previous2 = previous2;
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Prepares a block to join its words in several pieces (in order, with
+ * join_words_next).
+ * @param src The source array of words (to be joined from groups).
+ * @param last Value of the last word (before separation).
+ * @param length The number of words in the source array.
+ * @param use_previous_byte Use the median value of the previous byte
+ *                          to achieve a better sorting.
+ * @param ctx The word separator context (for hashed contexts ctx->count
+ *            must contain the size of every group).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+int join_words_begin(unsigned short *src, unsigned short last, int length,
+                     bool use_previous_byte, ws_context *ctx) {
+  unsigned int first;
+  
+  // Count the words (the last word must be in the data)
+  if (!ws_stores_counts(ctx->mode)) {
+    count_words(src, length, last, ctx);
+    if (ctx->count[ _ws_group(ctx, last, 0) ] < 0) {
+      return -1;
+    }
+  }
+  
+  // (A group of 65536 words can't be told from a full one with 16-bit
+  // offsets, so a block whose words are all in one group is wide)
+  first = _ws_group(ctx, ctx->previous, ctx->previous2);
+  _ws_set_layout(ctx, length <= WS_NARROW_LENGTH
+                 && ctx->count[first] < WS_NARROW_LENGTH);
+  if (use_previous_byte && !ctx->primed) {
+    _ws_reset_median(ctx);
+  }    
+  
+  // Calculate the indexes (the last indexes are also the limits of the
+  // groups)
+  calculate_indexes(ctx);
+  
+  return 0;
+}
+
+/* ======================================================================== */
+/** 
+ * Joins the next words of a block (prepared by join_words_begin).
+ * @param src The source array of words (the whole block).
+ * @param dst The destination array of the next words.
+ * @param length The number of words to join.
+ * @param use_previous_byte Use the median value of the previous byte
+ *                          to achieve a better sorting.
+ * @param ctx The word separator context (ctx->previous and ctx->previous2
+ *            will contain the last joined words).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+int join_words_next(unsigned short *src, unsigned short *dst, int length,
+                    bool use_previous_byte, ws_context *ctx) {
+  int ret = 0;
+  
+  // join the words (with the instance of the mode)
+  WS_SPECIALIZE(ctx->mode, use_previous_byte, ctx->narrow, ret = _ws_join,
+                src, dst, length, ctx)
+
+  return ret;
+}
+
+/* ======================================================================== */
+/** 
+ * Join words. (Reverse the separate_words operation).
+ * @param src The source array of words (to be joined from groups).
+ * @param dst The destination array of words.
+ * @param last Value of the last word (before separation).
+ * @param length The number of words in the source array.
+ * @param use_previous_byte Use the median value of the previous byte
+ *                          to achieve a better sorting.
+ * @param ctx The word separator context (for hashed contexts ctx->count
+ *            must contain the size of every group).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+int join_words(unsigned short *src, unsigned short *dst, unsigned short last,
+               int length, bool use_previous_byte, ws_context *ctx) {
+  if (join_words_begin(src, last, length, use_previous_byte, ctx) != 0) {
+    return -1;
+  }
+  
+  return join_words_next(src, dst, length, use_previous_byte, ctx);
 }
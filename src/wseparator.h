@@ -1,5 +1,5 @@
-/* A function to split the data into 65536 2-byte groups based on 
-   the previous 2 bytes.
+/* A function to split the data into 2-byte groups based on the context
+   of the previous bytes.
 
    Copyright (C) 2022 Abraham Macias Paredes.
    
@@ -19,20 +19,143 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
-/** 
- * Separate words. 
+/* Context modes (the words are grouped by this context) */
+#define WS_CONTEXT_BYTE  0  /* Previous byte (256 groups). */
+#define WS_CONTEXT_WORD  1  /* Previous word (65536 groups). */
+#define WS_CONTEXT_HASH3 2  /* Hash of the previous 3 bytes. */
+#define WS_CONTEXT_HASH4 3  /* Hash of the previous 4 bytes. */
+
+/* Number of groups (in bits) of the hashed contexts */
+#define WS_HASH_MIN_BITS 8
+#define WS_HASH_MAX_BITS 22
+#define WS_HASH_DEFAULT_BITS 16
+
+/* Maximum length (in words) of the blocks whose groups use 16-bit offsets */
+#define WS_NARROW_LENGTH 65536
+
+/**
+ * Metadata of a group (padded to 16 bytes: the buckets are allocated with
+ * malloc, which aligns them to 16 bytes, so a bucket never straddles two
+ * cache lines and the positions and the median used by a word are loaded
+ * together).
+ */
+typedef struct {
+  int front;                  /* Next position at the front of the group. */
+  int back;                   /* Next position at the back of the group. */
+  unsigned char median;       /* Median of the previous byte. */
+  unsigned char padding[7];
+} ws_bucket;
+
+/**
+ * Metadata of a group of a block of up to WS_NARROW_LENGTH words (padded
+ * to 8 bytes, so the address of a bucket is a scaled index and it never
+ * straddles two cache lines either).
+ */
+typedef struct {
+  unsigned short front;
+  unsigned short back;
+  unsigned char median;
+  unsigned char padding[3];
+} ws_bucket16;
+
+/**
+ * Word separator context.
+ */
+typedef struct {
+  int mode;
+  int bits;
+  int groups;
+  int *count;
+  ws_bucket *buckets;         /* Group metadata (an array of ws_bucket16 if
+                                 narrow is set). */
+  bool narrow;                /* The buckets use 16-bit offsets. */
+  bool primed;                /* The median table is already initialized. */
+  unsigned short previous;    /* Context of the first word of the block. */
+  unsigned short previous2;
+} ws_context;
+
+
+/**
+ * Allocates a word separator context.
+ * @param mode The context mode (WS_CONTEXT_*).
+ * @param bits Number of groups (in bits) for the hashed contexts.
+ * @return A ws_context structure (or NULL in case of error).
+ */
+ws_context *ws_alloc(int mode, int bits);
+
+/**
+ * Releases the memory of a word separator context.
+ * @param ctx The ws_context to release.
+ */
+void ws_free(ws_context *ctx);
+
+/**
+ * Primes a word separator context with the state left by previous data
+ * (the context is used by the next separate_words or join_words call).
+ * @param ctx The word separator context.
+ * @param median The median table of the previous data (or NULL).
+ * @param groups The number of groups of the median table (a power of 2,
+ *               it is adapted to the groups of the context).
+ * @param previous The last word of the previous data.
+ * @param previous2 The word before the last one.
+ */
+void ws_prime(ws_context *ctx, const unsigned char *median, int groups,
+              unsigned short previous, unsigned short previous2);
+
+/**
+ * Gets the median table of a word separator context (the state left by the
+ * last separate_words or join_words call).
+ * @param ctx The word separator context.
+ * @param median An array of ctx->groups bytes that will contain the table.
+ */
+void ws_get_median(const ws_context *ctx, unsigned char *median);
+
+/**
+ * Checks if the group sizes of a context mode must be stored with the data.
+ * (The hashed contexts can't be calculated from the separated words).
+ * @param mode The context mode (WS_CONTEXT_*).
+ * @return true if the group sizes must be stored.
+ */
+bool ws_stores_counts(int mode);
+
+/**
+ * Separate words.
  * @param src The source array of words (to be separated into groups).
  * @param dst The destination array of words.
  * @param length The number of words in the source array.
  * @param use_previous_byte Use the median value of the previous byte
  *                          to achieve a better sorting.
+ * @param ctx The word separator context (ctx->count will contain
+ *            the size of every group).
  */
 void separate_words(unsigned short *src, unsigned short *dst, int length,
-                    bool use_previous_byte);
+                    bool use_previous_byte, ws_context *ctx);
+
+/**
+ * Separate words read from a list of fragments (without copying them into
+ * an array). A word can straddle two fragments and the last byte is padded
+ * with a 0 if the number of bytes is odd.
+ * @param iov The fragments of the source data.
+ * @param iovcnt The number of fragments.
+ * @param offset The position (in bytes) of the first word.
+ * @param dst The destination array of words.
+ * @param length The number of words to separate.
+ * @param use_previous_byte Use the median value of the previous byte
+ *                          to achieve a better sorting.
+ * @param ctx The word separator context (ctx->count will contain
+ *            the size of every group).
+ * @param last An array of 2 words that will contain the last word and the
+ *             previous one (the context of the next data).
+ */
+void separate_words_iov(const struct iovec *iov, int iovcnt, size_t offset,
+                        unsigned short *dst, int length,
+                        bool use_previous_byte, ws_context *ctx,
+                        unsigned short *last);
 
 
-/** 
+/**
  * Join words. (Reverse the separate_words operation).
  * @param src The source array of words (to be joined from groups).
  * @param dst The destination array of words.
@@ -40,9 +163,41 @@ void separate_words(unsigned short *src, unsigned short *dst, int length,
  * @param length The number of words in the source array.
  * @param use_previous_byte Use the median value of the previous byte
  *                          to achieve a better sorting.
+ * @param ctx The word separator context (for hashed contexts ctx->count
+ *            must contain the size of every group).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+int join_words(unsigned short *src, unsigned short *dst, unsigned short last,
+               int length, bool use_previous_byte, ws_context *ctx);
+
+/**
+ * Prepares a block to join its words in several pieces (in order, with
+ * join_words_next).
+ * @param src The source array of words (to be joined from groups).
+ * @param last Value of the last word (before separation).
+ * @param length The number of words in the source array.
+ * @param use_previous_byte Use the median value of the previous byte
+ *                          to achieve a better sorting.
+ * @param ctx The word separator context (for hashed contexts ctx->count
+ *            must contain the size of every group).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
+ */
+int join_words_begin(unsigned short *src, unsigned short last, int length,
+                     bool use_previous_byte, ws_context *ctx);
+
+/**
+ * Joins the next words of a block (prepared by join_words_begin).
+ * @param src The source array of words (the whole block).
+ * @param dst The destination array of the next words.
+ * @param length The number of words to join.
+ * @param use_previous_byte Use the median value of the previous byte
+ *                          to achieve a better sorting.
+ * @param ctx The word separator context (ctx->previous and ctx->previous2
+ *            will contain the last joined words).
+ * @return 0 if everything goes OK or -1 if the data is corrupted.
  */
-void join_words(unsigned short *src, unsigned short *dst, unsigned short last,
-                int length, bool use_previous_byte);
+int join_words_next(unsigned short *src, unsigned short *dst, int length,
+                    bool use_previous_byte, ws_context *ctx);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,191 @@
+/* Fuzzing harness of the block decompression.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* The harness is not built by default. To build it with libFuzzer:
+
+     clang -g -O1 -fsanitize=fuzzer,address -DFUZZ_LIBFUZZER -I../src \
+       fuzz_srz.c ../src/srz.c ../src/wseparator.c ../src/split2b.c \
+       ../src/bitm.c ../src/mtf.c ../src/mem.c -liberty -o fuzz_srz
+
+   Without FUZZ_LIBFUZZER it reads one input from stdin (for AFL):
+
+     afl-clang-fast -I../src fuzz_srz.c ../src/srz.c ... -o fuzz_srz
+     afl-fuzz -i seeds -o findings ./fuzz_srz
+
+   The default target fuzzes a block: the input is a block header (the
+   parameters, length, last word and last byte) followed by the compressed
+   data. The data is also compressed and decompressed with the same
+   parameters to check the round trip.
+
+   With -DFUZZ_FRAME the target fuzzes srz_decompress_buffer: the input is
+   a whole compressed file (the files written by srcomp are good seeds). */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "srz.h"
+#include "wseparator.h"
+#include "mtf.h"
+
+#define FUZZ_HEADER_LENGTH 8
+#define FUZZ_MAX_LENGTH 65536
+#define FUZZ_MAX_FRAME_LENGTH (4<<20)
+
+#ifndef FUZZ_FRAME
+/* ======================================================================== */
+/** 
+ * Reads the parameters of a block from the fuzzing input.
+ * @param data The input data (at least FUZZ_HEADER_LENGTH bytes).
+ * @param params The parameters to set.
+ */
+static void _fuzz_params(const uint8_t *data, srz_params *params) {
+  srz_default_params(params);
+  params->use_previous_byte = data[0] & 1;
+  params->context_mode = (data[0] >> 1) & 3;
+  params->split_bytes = (data[0] >> 3) & 1;
+  params->word_mtf = (data[0] >> 4) & 1;
+  params->sorting_byte = (data[0] >> 5) & 1;
+  params->transform = (data[0] >> 6) % MTF_TRANSFORMS;
+  params->context_bits = WS_HASH_MIN_BITS
+                         + data[1] % (WS_HASH_MAX_BITS - WS_HASH_MIN_BITS + 1);
+  params->streams = 1 + (data[2] & 7) % SRZ_MAX_STREAMS;
+  params->chunk_size = data[2] >> 3;
+}
+
+/* ======================================================================== */
+/** 
+ * Runs one fuzzing input of a block.
+ * @param data The input data.
+ * @param size The size of the input data.
+ */
+static void _fuzz_block(const uint8_t *data, size_t size) {
+  srz_params params;
+  unsigned short *dst, *src, last_word;
+  unsigned char *buffer, last_byte, lb;
+  size_t length, bound, cl;
+  
+  if (size < FUZZ_HEADER_LENGTH) {
+    return;
+  }
+  
+  _fuzz_params(data, &params);
+  length = (((size_t) data[3] << 8) | data[4]) + 1;
+  last_word = ((unsigned short) data[5] << 8) | data[6];
+  last_byte = data[7];
+  data += FUZZ_HEADER_LENGTH;
+  size -= FUZZ_HEADER_LENGTH;
+  
+  // Decompress the data (it can be wrong, but it can't crash)
+  bound = compress_block_bound(length);
+  buffer = (unsigned char *) calloc(bound, 1);
+  dst = (unsigned short *) malloc(length<<1);
+  if (buffer == NULL || dst == NULL) {
+    free(buffer);
+    free(dst);
+    return;
+  }
+  memcpy(buffer, data, (size < bound) ? size : bound);
+  decompress_block(buffer, dst, last_word, last_byte, length, &params);
+  free(buffer);
+  free(dst);
+  
+  // Round trip of the data
+  length = size >> 1;
+  if (length == 0 || length > FUZZ_MAX_LENGTH) {
+    return;
+  }
+  src = (unsigned short *) malloc(length<<1);
+  dst = (unsigned short *) malloc(length<<1);
+  buffer = (unsigned char *) malloc(compress_block_bound(length));
+  if (src != NULL && dst != NULL && buffer != NULL) {
+    memcpy(src, data, length<<1);
+    cl = compress_block(src, buffer, length, &lb, &params);
+    if (cl != SRZ_NOT_COMPRESSED && cl != (size_t) -1
+        && (decompress_block(buffer, dst, src[length - 1], lb, length,
+                             &params) != (length<<1)
+            || memcmp(src, dst, length<<1) != 0)) {
+      fprintf(stderr, "The block wasn't decompressed correctly!\n");
+      abort();
+    }
+  }
+  free(src);
+  free(dst);
+  free(buffer);
+}
+
+#else
+/* ======================================================================== */
+/** 
+ * Runs one fuzzing input of a compressed file.
+ * @param data The input data.
+ * @param size The size of the input data.
+ */
+static void _fuzz_frame(const uint8_t *data, size_t size) {
+  srz_params params;
+  unsigned long long length;
+  unsigned char *dst;
+  
+  // (The stored size can be wrong too, the output is bounded)
+  if (srz_get_decompressed_size(data, size, &length) != 0) {
+    return;
+  }
+  if (length == SRZ_UNKNOWN_SIZE || length > FUZZ_MAX_FRAME_LENGTH) {
+    length = FUZZ_MAX_FRAME_LENGTH;
+  }
+  
+  // Decompress the file (it can be wrong, but it can't crash)
+  srz_default_params(&params);
+  dst = (unsigned char *) malloc(length + 1);
+  if (dst != NULL) {
+    srz_decompress_buffer(data, size, dst, length, &params);
+  }
+  free(dst);
+}
+
+#endif
+
+/* ======================================================================== */
+/** 
+ * Runs one fuzzing input.
+ * @param data The input data.
+ * @param size The size of the input data.
+ * @return 0.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+#ifdef FUZZ_FRAME
+  _fuzz_frame(data, size);
+#else
+  _fuzz_block(data, size);
+#endif
+  
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+/* ======================================================================== */
+/** 
+ * Main program (runs the input read from stdin).
+ * @return 0 if everything goes OK.
+ */
+int main() {
+  static uint8_t data[FUZZ_HEADER_LENGTH + (FUZZ_MAX_LENGTH<<2)];
+  size_t size;
+  
+  size = fread(data, 1, sizeof(data), stdin);
+  return LLVMFuzzerTestOneInput(data, size);
+}
+#endif
@@ -347,6 +347,87 @@ void reset_test() {
 }
 
 
+/* ======================================================================== */
+/**
+ * Test that an array is full when the written elements don't fit.
+ */
+void is_full_test() {
+  bitm_array *bma;
+  int i;
+  
+  // given
+  bma = bitm_alloc(2);
+  
+  // when (63 bits)
+  for (i = 0; i < 21; i++) {
+    bitm_write_eg(bma, 2);
+  }
+  
+  // then (the last bits are not stored yet)
+  assert_int_equal(0, bitm_is_full(bma));
+  assert_int_equal(1, bitm_get_index(bma));
+  
+  // when (69 bits)
+  bitm_write_eg(bma, 2);
+  bitm_write_eg(bma, 2);
+  
+  // then
+  assert_int_equal(1, bitm_is_full(bma));
+  assert_int_equal(2, bitm_get_index(bma));
+  
+  // cleanup
+  bitm_free(bma);
+}
+
+
+/* ======================================================================== */
+/**
+ * Test the inline Elias-Gamma reader (short and long codes, and the end of
+ * the data).
+ */
+void reader_eg_test() {
+  bitm_array *bma;
+  bitm_reader r;
+  int i;
+  
+  // given
+  bma = bitm_alloc(1000);
+  for (i = 1; i <= 300; i++) {
+    bitm_write_eg(bma, i);
+  }
+  bitm_write_eg(bma, 65536);
+  bitm_write_eg(bma, 0x3FFFFFFF);
+  bitm_write_eg(bma, 1);
+  bitm_flush(bma);
+  
+  // when
+  bitm_reader_init(&r, bitm_get_data(bma), bitm_get_index(bma));
+  
+  // then
+  for (i = 1; i <= 300; i++) {
+    assert_int_equal(i, bitm_reader_eg(&r));
+  }
+  assert_int_equal(65536, bitm_reader_eg(&r));
+  assert_int_equal(0x3FFFFFFF, bitm_reader_eg(&r));
+  assert_int_equal(1, bitm_reader_eg(&r));
+  assert_int_equal(0, bitm_reader_overrun(&r));
+  
+  // when (the data is truncated, the reader reads zeroes after it)
+  bitm_reader_init(&r, bitm_get_data(bma), bitm_get_index(bma) - 2);
+  for (i = 1; i <= 300; i++) {
+    assert_int_equal(i, bitm_reader_eg(&r));
+  }
+  bitm_reader_eg(&r);
+  bitm_reader_eg(&r);
+  
+  // then
+  assert_int_equal(1, bitm_reader_overrun(&r));
+  
+  // cleanup
+  bitm_free(bma);
+}
+
+
 /* ======================================================================== */
 /**
  * Test to write and read all the numbers from 1 to 256 in unary coding.
@@ -399,4 +480,44 @@ void unsigned_char_eg_test() {
   
   // cleanup
   bitm_free(bma);
-}
\ No newline at end of file
+}
+/* ======================================================================== */
+/**
+ * Test that the data can't be read beyond the end of the array.
+ */
+void read_end_test() {
+  bitm_array *bma;
+  int i;
+  
+  // given
+  bma = bitm_alloc(2);
+  bitm_get_data(bma)[0] = 0x00000001;
+  bitm_get_data(bma)[1] = 0x00000000;
+  
+  // when - then
+  for (i = 0; i < 31; i++) {
+    assert_int_equal(0, bitm_read_bit(bma));
+  }
+  assert_int_equal(1, bitm_read_bit(bma));
+  assert_int_equal(0, bitm_read_nbits(bma, 32));
+  assert_int_equal(-1, bitm_read_bit(bma));
+  assert_int_equal(-1, bitm_read_nbits(bma, 1));
+  
+  // (32 bits in one element and across two elements)
+  bitm_reset(bma);
+  bitm_get_data(bma)[0] = 0x7ABCDEF1;
+  bitm_get_data(bma)[1] = 0x23456789;
+  assert_int_equal(0x7ABCDEF1, bitm_read_nbits(bma, 32));
+  bitm_reset(bma);
+  assert_int_equal(0x7, bitm_read_nbits(bma, 4));
+  assert_int_equal(0xABCDEF12, (unsigned int) bitm_read_nbits(bma, 32));
+  assert_int_equal(-1, bitm_read_nbits(bma, 32));
+  
+  // (an exponent of zeroes that doesn't fit in an int)
+  bitm_reset(bma);
+  bitm_get_data(bma)[0] = 0x00000000;
+  assert_int_equal(-1, bitm_read_eg(bma));
+  
+  // cleanup
+  bitm_free(bma);
+}
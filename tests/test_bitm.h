@@ -79,6 +79,17 @@ void write_eg_test();
  */
 void reset_test();
 
+/**
+ * Test that an array is full when the written elements don't fit.
+ */
+void is_full_test();
+
+/**
+ * Test the inline Elias-Gamma reader (short and long codes, and the end of
+ * the data).
+ */
+void reader_eg_test();
+
 /**
  * Test to write and read all the numbers from 1 to 256 in unary coding.
  */
@@ -89,4 +100,9 @@ void unsigned_char_unary_test();
  */
 void unsigned_char_eg_test();
 
+/**
+ * Test that the data can't be read beyond the end of the array.
+ */
+void read_end_test();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+/* Test data generators implementation.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "test_data.h"
+
+#include <string.h>
+
+static const char *test_words[] = {
+  "the ", "of ", "compression ", "data ", "block ", "word ", "and ",
+  "a ", "byte ", "to ", "in ", "separate ", "context ", "\n"
+};
+
+/* ======================================================================== */
+/** 
+ * Generates a pseudo-random number (xorshift).
+ * @param state The generator state.
+ * @return The random number.
+ */
+static unsigned int _test_random(unsigned int *state) {
+  unsigned int x = *state;
+  
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  
+  return x;
+}
+
+/* ======================================================================== */
+/**
+ * Fills an array of words with test data.
+ * @param dst The destination array.
+ * @param length The number of words.
+ * @param kind The kind of data (TEST_DATA_*).
+ * @param seed The seed of the random generator.
+ */
+void test_data_fill(unsigned short *dst, int length, int kind,
+                    unsigned int seed) {
+  unsigned char *bytes = (unsigned char *) dst;
+  unsigned int state = seed | 1;
+  unsigned short tmp;
+  const char *word;
+  int i, j, n;
+  
+  switch (kind) {
+    case TEST_DATA_TEXT:
+      n = sizeof(test_words) / sizeof(char *);
+      for (i = 0; i < (length<<1); ) {
+        word = test_words[_test_random(&state) % n];
+        for (j = 0; word[j] != '\0' && i < (length<<1); j++) {
+          bytes[i++] = word[j];
+        }
+      }
+      break;
+    case TEST_DATA_SAME:
+      for (i = 0; i < length; i++) {
+        dst[i] = 0x4142;
+      }
+      break;
+    case TEST_DATA_DISTINCT:
+      for (i = 0; i < length; i++) {
+        dst[i] = (unsigned short) i;
+      }
+      for (i = length - 1; i > 0; i--) {
+        j = _test_random(&state) % (i + 1);
+        tmp = dst[i];
+        dst[i] = dst[j];
+        dst[j] = tmp;
+      }
+      break;
+    default:
+      for (i = 0; i < (length<<1); i++) {
+        bytes[i] = (unsigned char) (_test_random(&state) >> 24);
+      }
+      break;
+  }
+}
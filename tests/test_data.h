@@ -0,0 +1,36 @@
+/* Test data generators definition.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef TEST_DATA_H
+#define TEST_DATA_H
+
+/* Kinds of test data */
+#define TEST_DATA_RANDOM   0  /* Random bytes. */
+#define TEST_DATA_TEXT     1  /* Text made of a few words. */
+#define TEST_DATA_SAME     2  /* The same word repeated. */
+#define TEST_DATA_DISTINCT 3  /* Every word value (in a shuffled order). */
+#define TEST_DATA_KINDS    4
+
+/**
+ * Fills an array of words with test data.
+ * @param dst The destination array.
+ * @param length The number of words.
+ * @param kind The kind of data (TEST_DATA_*).
+ * @param seed The seed of the random generator.
+ */
+void test_data_fill(unsigned short *dst, int length, int kind,
+                    unsigned int seed);
+
+#endif
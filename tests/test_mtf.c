@@ -0,0 +1,323 @@
+/* Move-To-Front tests implementation.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "test_mtf.h"
+#include "test_data.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#define TEST_LENGTH 65536
+
+/* ======================================================================== */
+/** 
+ * Reference Move-To-Front coder (a list of symbols).
+ * @param src The source array of data.
+ * @param dst The destination array of data.
+ * @param length The number of bytes in the source array.
+ */
+static void _reference_mtf_code(unsigned char *src, unsigned char *dst,
+                                int length) {
+  unsigned char list[BYTE_SYMBOLS];
+  int i, p;
+  
+  for (i = 0; i < BYTE_SYMBOLS; i++) {
+    list[i] = i;
+  }
+  
+  for (i = 0; i < length; i++) {
+    for (p = 0; list[p] != src[i]; p++) {
+    }
+    dst[i] = p;
+    memmove(list + 1, list, p);
+    list[0] = src[i];
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Test to code and decode data with Move-To-Front.
+ */
+void mtf_round_trip_test() {
+  unsigned char *src, *coded, *decoded;
+  mtf_status status;
+  int kind;
+  
+  // given
+  src = (unsigned char *) malloc(TEST_LENGTH);
+  coded = (unsigned char *) malloc(TEST_LENGTH);
+  decoded = (unsigned char *) malloc(TEST_LENGTH);
+  assert_non_null(src);
+  assert_non_null(coded);
+  assert_non_null(decoded);
+  
+  for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+    test_data_fill((unsigned short *) src, TEST_LENGTH>>1, kind, kind + 1);
+    
+    // when
+    mtf_reset(&status);
+    mtf_code(src, coded, TEST_LENGTH, &status);
+    mtf_reset(&status);
+    mtf_decode(coded, decoded, TEST_LENGTH, &status);
+    
+    // then
+    assert_memory_equal(src, decoded, TEST_LENGTH);
+  }
+  
+  // cleanup
+  free(src);
+  free(coded);
+  free(decoded);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the coded data matches a reference Move-To-Front coder.
+ */
+void mtf_reference_test() {
+  unsigned char *src, *coded, *expected;
+  mtf_status status;
+  int kind;
+  
+  // given
+  src = (unsigned char *) malloc(TEST_LENGTH);
+  coded = (unsigned char *) malloc(TEST_LENGTH);
+  expected = (unsigned char *) malloc(TEST_LENGTH);
+  assert_non_null(src);
+  assert_non_null(coded);
+  assert_non_null(expected);
+  
+  for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+    test_data_fill((unsigned short *) src, TEST_LENGTH>>1, kind, kind + 7);
+    _reference_mtf_code(src, expected, TEST_LENGTH);
+    
+    // when
+    mtf_reset(&status);
+    mtf_code(src, coded, TEST_LENGTH, &status);
+    
+    // then
+    assert_memory_equal(expected, coded, TEST_LENGTH);
+  }
+  
+  // cleanup
+  free(src);
+  free(coded);
+  free(expected);
+}
+
+/* ======================================================================== */
+/**
+ * Test that a repeated byte is coded as zeroes.
+ */
+void mtf_same_byte_test() {
+  unsigned char src[64], coded[64];
+  mtf_status status;
+  int i;
+  
+  // given
+  memset(src, 'x', sizeof(src));
+  
+  // when
+  mtf_reset(&status);
+  mtf_code(src, coded, sizeof(src), &status);
+  
+  // then
+  assert_int_equal('x', coded[0]);
+  for (i = 1; i < sizeof(src); i++) {
+    assert_int_equal(0, coded[i]);
+  }
+}
+
+/* ======================================================================== */
+/**
+ * Test to code the data in several calls with the same status.
+ */
+void mtf_split_test() {
+  unsigned char src[1000], coded[1000], expected[1000], decoded[1000];
+  mtf_status status;
+  
+  // given
+  test_data_fill((unsigned short *) src, sizeof(src)>>1, TEST_DATA_TEXT, 3);
+  mtf_reset(&status);
+  mtf_code(src, expected, sizeof(src), &status);
+  
+  // when
+  mtf_reset(&status);
+  mtf_code(src, coded, 333, &status);
+  mtf_code(src + 333, coded + 333, sizeof(src) - 333, &status);
+  mtf_reset(&status);
+  mtf_decode(coded, decoded, 1, &status);
+  mtf_decode(coded + 1, decoded + 1, sizeof(src) - 1, &status);
+  
+  // then
+  assert_memory_equal(expected, coded, sizeof(src));
+  assert_memory_equal(src, decoded, sizeof(src));
+}
+
+/* ======================================================================== */
+/**
+ * Test to code and decode data with every rank transform (in several calls
+ * with the same status).
+ */
+void mtf_transforms_test() {
+  unsigned char *src, *coded, *decoded, *expected;
+  mtf_status status;
+  int kind, t;
+  
+  // given
+  src = (unsigned char *) malloc(TEST_LENGTH);
+  coded = (unsigned char *) malloc(TEST_LENGTH);
+  decoded = (unsigned char *) malloc(TEST_LENGTH);
+  expected = (unsigned char *) malloc(TEST_LENGTH);
+  assert_non_null(src);
+  assert_non_null(coded);
+  assert_non_null(decoded);
+  assert_non_null(expected);
+  
+  for (t = 0; t < MTF_TRANSFORMS; t++) {
+    for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+      test_data_fill((unsigned short *) src, TEST_LENGTH>>1, kind, kind + 9);
+      mtf_reset(&status);
+      mtf_transforms[t].code(src, expected, TEST_LENGTH, &status);
+      
+      // when
+      mtf_reset(&status);
+      mtf_transforms[t].code(src, coded, 333, &status);
+      mtf_transforms[t].code(src + 333, coded + 333, TEST_LENGTH - 333,
+                             &status);
+      mtf_reset(&status);
+      mtf_transforms[t].decode(coded, decoded, 1, &status);
+      mtf_transforms[t].decode(coded + 1, decoded + 1, TEST_LENGTH - 1,
+                               &status);
+      
+      // then
+      assert_memory_equal(expected, coded, TEST_LENGTH);
+      assert_memory_equal(src, decoded, TEST_LENGTH);
+    }
+  }
+  
+  // cleanup
+  free(src);
+  free(coded);
+  free(decoded);
+  free(expected);
+}
+
+/* ======================================================================== */
+/**
+ * Test the ranks of MTF-1 and MTF-2 (the symbols move to the rank 1 and
+ * then to the front, but with MTF-2 only if the previous rank wasn't 0).
+ */
+void mtf1_ranks_test() {
+  unsigned char src[7] = { 'b', 'b', 'b', 'a', 'b', 'a', 'a' };
+  unsigned char mtf1[7] = { 'b', 1, 0, 'b', 0, 1, 0 };
+  unsigned char mtf2[7] = { 'b', 1, 0, 'b', 0, 1, 1 };
+  unsigned char coded[7];
+  mtf_status status;
+  
+  // when
+  mtf_reset(&status);
+  mtf1_code(src, coded, sizeof(src), &status);
+  
+  // then
+  assert_memory_equal(mtf1, coded, sizeof(src));
+  
+  // when
+  mtf_reset(&status);
+  mtf2_code(src, coded, sizeof(src), &status);
+  
+  // then
+  assert_memory_equal(mtf2, coded, sizeof(src));
+}
+
+/* ======================================================================== */
+/** 
+ * Reference word Move-To-Front coder (a list of symbols).
+ * @param src The source array of words.
+ * @param dst The destination array of ranks.
+ * @param length The number of words in the source array.
+ */
+static void _reference_mtf16_code(unsigned short *src, unsigned short *dst,
+                                  int length) {
+  unsigned short *list;
+  int i, p;
+  
+  list = (unsigned short *) malloc(WORD_SYMBOLS * sizeof(unsigned short));
+  assert_non_null(list);
+  for (i = 0; i < WORD_SYMBOLS; i++) {
+    list[i] = i;
+  }
+  
+  for (i = 0; i < length; i++) {
+    for (p = 0; list[p] != src[i]; p++) {
+    }
+    dst[i] = p;
+    memmove(list + 1, list, p * sizeof(unsigned short));
+    list[0] = src[i];
+  }
+  
+  free(list);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the word Move-To-Front matches a reference coder and decodes
+ * the data (with enough distinct words to renumber the times).
+ */
+void mtf16_round_trip_test() {
+  unsigned short *src, *coded, *expected, *decoded;
+  mtf16_status *status;
+  int kind, length;
+  
+  // given
+  length = (TEST_LENGTH<<1) + 1000;
+  src = (unsigned short *) malloc(length * sizeof(unsigned short));
+  coded = (unsigned short *) malloc(length * sizeof(unsigned short));
+  expected = (unsigned short *) malloc(length * sizeof(unsigned short));
+  decoded = (unsigned short *) malloc(length * sizeof(unsigned short));
+  status = mtf16_alloc();
+  assert_non_null(src);
+  assert_non_null(coded);
+  assert_non_null(expected);
+  assert_non_null(decoded);
+  assert_non_null(status);
+  
+  for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+    test_data_fill(src, length, kind, kind + 5);
+    _reference_mtf16_code(src, expected, length);
+    
+    // when (in two calls with the same status)
+    mtf16_reset(status);
+    mtf16_code(src, coded, 1000, status);
+    mtf16_code(src + 1000, coded + 1000, length - 1000, status);
+    mtf16_reset(status);
+    mtf16_decode(coded, decoded, length, status);
+    
+    // then
+    assert_memory_equal(expected, coded, length * sizeof(unsigned short));
+    assert_memory_equal(src, decoded, length * sizeof(unsigned short));
+  }
+  
+  // cleanup
+  free(src);
+  free(coded);
+  free(expected);
+  free(decoded);
+  mtf16_free(status);
+}
@@ -0,0 +1,60 @@
+/* Move-To-Front tests definition.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef TEST_MTF_H
+#define TEST_MTF_H
+
+
+#include "mtf.h"
+
+/**
+ * Test to code and decode data with Move-To-Front.
+ */
+void mtf_round_trip_test();
+
+/**
+ * Test that the coded data matches a reference Move-To-Front coder.
+ */
+void mtf_reference_test();
+
+/**
+ * Test that a repeated byte is coded as zeroes.
+ */
+void mtf_same_byte_test();
+
+/**
+ * Test to code the data in several calls with the same status.
+ */
+void mtf_split_test();
+
+/**
+ * Test to code and decode data with every rank transform (in several calls
+ * with the same status).
+ */
+void mtf_transforms_test();
+
+/**
+ * Test the ranks of MTF-1 and MTF-2 (the symbols move to the rank 1 and
+ * then to the front, but with MTF-2 only if the previous rank wasn't 0).
+ */
+void mtf1_ranks_test();
+
+/**
+ * Test that the word Move-To-Front matches a reference coder and decodes
+ * the data (with enough distinct words to renumber the times).
+ */
+void mtf16_round_trip_test();
+
+#endif
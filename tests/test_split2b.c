@@ -0,0 +1,132 @@
+/* Byte separation tests implementation.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "test_split2b.h"
+#include "test_data.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#define TEST_LENGTH 65536
+
+/* Block lengths (in words) of the round trip tests */
+static const int test_lengths[] = { 1, 2, 3, 255, 256, 257, 4095, 65536 };
+
+/* ======================================================================== */
+/**
+ * Test to separate and join the bytes of blocks of several lengths.
+ */
+void split2b_round_trip_test() {
+  unsigned short *src, *joined;
+  unsigned char *separated;
+  int i, kind, length, sorting_byte;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH<<1);
+  joined = (unsigned short *) malloc(TEST_LENGTH<<1);
+  separated = (unsigned char *) malloc(TEST_LENGTH<<1);
+  assert_non_null(src);
+  assert_non_null(joined);
+  assert_non_null(separated);
+  
+  for (sorting_byte = 0; sorting_byte < 2; sorting_byte++) {
+    for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+      for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+        length = test_lengths[i];
+        test_data_fill(src, length, kind, length + kind);
+        
+        // when
+        separate_bytes(src, separated, length, sorting_byte);
+        join_bytes(separated, joined, separated[(length<<1) - 1], length,
+                   sorting_byte);
+        
+        // then
+        assert_memory_equal(src, joined, length<<1);
+      }
+    }
+  }
+  
+  // cleanup
+  free(src);
+  free(joined);
+  free(separated);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the in-place separation matches separate_bytes.
+ */
+void split2b_inplace_test() {
+  unsigned short *src, *data;
+  unsigned char *expected, *tmp;
+  int i, kind, length, sorting_byte;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH<<1);
+  data = (unsigned short *) malloc(TEST_LENGTH<<1);
+  expected = (unsigned char *) malloc(TEST_LENGTH<<1);
+  tmp = (unsigned char *) malloc(TEST_LENGTH<<1);
+  assert_non_null(src);
+  assert_non_null(data);
+  assert_non_null(expected);
+  assert_non_null(tmp);
+  
+  for (sorting_byte = 0; sorting_byte < 2; sorting_byte++) {
+    for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+      for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+        length = test_lengths[i];
+        test_data_fill(src, length, kind, length * 3 + kind);
+        separate_bytes(src, expected, length, sorting_byte);
+        memcpy(data, src, length<<1);
+        
+        // when
+        separate_bytes_inplace(data, tmp, length, sorting_byte);
+        
+        // then
+        assert_memory_equal(expected, data, length<<1);
+      }
+    }
+  }
+  
+  // cleanup
+  free(src);
+  free(data);
+  free(expected);
+  free(tmp);
+}
+
+/* ======================================================================== */
+/**
+ * Test the order of the separated bytes.
+ */
+void split2b_order_test() {
+  unsigned short src[4];
+  unsigned char separated[8], sorted_low[8];
+  
+  // given
+  memcpy(src, "bxaycxaz", 8);
+  
+  // when
+  separate_bytes(src, separated, 4, 0);
+  separate_bytes(src, sorted_low, 4, 1);
+  
+  // then (the second bytes are grouped by the first ones or vice versa)
+  assert_memory_equal("bacayzxx", separated, 8);
+  assert_memory_equal("bcaaxyxz", sorted_low, 8);
+}
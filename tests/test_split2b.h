@@ -0,0 +1,37 @@
+/* Byte separation tests definition.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef TEST_SPLIT2B_H
+#define TEST_SPLIT2B_H
+
+
+#include "split2b.h"
+
+/**
+ * Test to separate and join the bytes of blocks of several lengths.
+ */
+void split2b_round_trip_test();
+
+/**
+ * Test that the in-place separation matches separate_bytes.
+ */
+void split2b_inplace_test();
+
+/**
+ * Test the order of the separated bytes.
+ */
+void split2b_order_test();
+
+#endif
@@ -0,0 +1,1054 @@
+/* Block compression tests implementation.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "test_srz.h"
+#include "test_data.h"
+#include "wseparator.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#define TEST_LENGTH 131072
+#define GUARD_LENGTH 64
+#define GUARD_BYTE 0x5A
+
+/* Block lengths (in bytes) of the round trip tests */
+static const int test_lengths[] = { 1, 2, 3, 255, 4097, 131072 };
+
+/* ======================================================================== */
+/**
+ * Compresses and decompresses a block of bytes (as srcomp does).
+ * @param src The block (with room for a padding byte).
+ * @param read The number of bytes.
+ * @param params The compression parameters.
+ */
+static void _srz_round_trip(unsigned short *src, size_t read,
+                            const srz_params *params) {
+  unsigned char *compressed, *work, last_byte;
+  unsigned short *decompressed;
+  size_t l, cl, bound;
+  
+  // If the number of bytes is odd we need 1 byte of padding
+  if ((read & 1) == 1) {
+    ((unsigned char *) src)[read] = 0;
+  }
+  l = (read + 1) >> 1;
+  bound = compress_block_bound(l);
+  
+  compressed = (unsigned char *) malloc(bound);
+  work = (unsigned char *) malloc(bound);
+  decompressed = (unsigned short *) malloc(l<<1);
+  assert_non_null(compressed);
+  assert_non_null(work);
+  assert_non_null(decompressed);
+  
+  cl = compress_block(src, compressed, l, &last_byte, params);
+  
+  // (The data that can't be compressed is stored)
+  assert_true(cl != (size_t) -1);
+  if (cl != SRZ_NOT_COMPRESSED) {
+    assert_true(cl < read);
+    memcpy(work, compressed, cl);
+    assert_int_equal(l<<1, decompress_block(work, decompressed, src[l - 1],
+                                            last_byte, l, params));
+    assert_memory_equal(src, decompressed, read);
+  }
+  
+  free(compressed);
+  free(work);
+  free(decompressed);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress blocks with every context mode.
+ */
+void srz_round_trip_test() {
+  unsigned short *src;
+  srz_params params;
+  int i, kind, mode, p;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  assert_non_null(src);
+  srz_default_params(&params);
+  params.context_bits = 12;
+  
+  for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+    for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+      test_data_fill(src, (test_lengths[i] + 1) >> 1, kind, i + 11);
+      
+      for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+        for (p = 0; p < 4; p++) {
+          params.context_mode = mode;
+          params.use_previous_byte = p & 1;
+          params.sorting_byte = p >> 1;
+          
+          // when / then
+          _srz_round_trip(src, test_lengths[i], &params);
+        }
+      }
+    }
+  }
+  
+  // cleanup
+  free(src);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress blocks with interleaved streams.
+ */
+void srz_streams_test() {
+  unsigned short *src, *dst;
+  unsigned char *compressed, last_byte;
+  unsigned int *table;
+  srz_params params;
+  size_t l, cl;
+  int i, kind, mode, streams;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  assert_non_null(src);
+  srz_default_params(&params);
+  params.context_bits = 12;
+  
+  for (streams = 2; streams <= SRZ_MAX_STREAMS; streams <<= 1) {
+    params.streams = streams;
+    params.split_bytes = (streams == 4);
+    for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+      for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+        test_data_fill(src, (test_lengths[i] + 1) >> 1, kind, i + 11);
+        
+        for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+          params.context_mode = mode;
+          
+          // when / then
+          _srz_round_trip(src, test_lengths[i], &params);
+        }
+      }
+    }
+  }
+  
+  params.split_bytes = false;
+  
+  // when (a stream length of the table is wrong)
+  l = 4096;
+  dst = (unsigned short *) malloc(l<<1);
+  compressed = (unsigned char *) malloc(compress_block_bound(l));
+  assert_non_null(dst);
+  assert_non_null(compressed);
+  test_data_fill(src, l, TEST_DATA_TEXT, 17);
+  params.streams = 4;
+  params.context_mode = WS_CONTEXT_WORD;
+  cl = compress_block(src, compressed, l, &last_byte, &params);
+  assert_true(cl < (l<<1));
+  table = (unsigned int *) compressed;
+  table[2] = compress_block_bound(l);
+  
+  // then
+  assert_int_equal((size_t) -1, decompress_block(compressed, dst, src[l - 1],
+                                                 last_byte, l, &params));
+  
+  // cleanup
+  free(src);
+  free(dst);
+  free(compressed);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress blocks whose symbols are coded in
+ * independent chunks.
+ */
+void srz_chunks_test() {
+  unsigned short *src, *dst;
+  unsigned char *compressed, last_byte;
+  unsigned int *table, total;
+  srz_params params;
+  size_t l, cl;
+  int i, kind, mode, chunk_size;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  assert_non_null(src);
+  srz_default_params(&params);
+  params.context_bits = 12;
+  
+  for (chunk_size = 1; chunk_size <= 64; chunk_size <<= 3) {
+    params.chunk_size = chunk_size;
+    params.streams = (chunk_size == 1) ? 1 : 2;
+    for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+      for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+        test_data_fill(src, (test_lengths[i] + 1) >> 1, kind, i + 13);
+        
+        for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+          params.context_mode = mode;
+          params.use_previous_byte = (mode == WS_CONTEXT_WORD);
+          
+          // when / then
+          _srz_round_trip(src, test_lengths[i], &params);
+        }
+      }
+    }
+  }
+  
+  // when (a block of 8192 symbols in chunks of 1 KB)
+  l = 4096;
+  dst = (unsigned short *) malloc(l<<1);
+  compressed = (unsigned char *) malloc(compress_block_bound(l));
+  assert_non_null(dst);
+  assert_non_null(compressed);
+  test_data_fill(src, l, TEST_DATA_TEXT, 23);
+  params.chunk_size = 1;
+  params.streams = 1;
+  params.use_previous_byte = false;
+  params.context_mode = WS_CONTEXT_WORD;
+  cl = compress_block(src, compressed, l, &last_byte, &params);
+  
+  // then (the table has the length of every chunk)
+  assert_true(cl < (l<<1));
+  table = (unsigned int *) compressed;
+  assert_int_equal(0, table[0]);
+  for (i = 1, total = 9; i <= 8; i++) {
+    total += table[i];
+  }
+  assert_int_equal(cl >> 2, total);
+  assert_int_equal(l<<1, decompress_block(compressed, dst, src[l - 1],
+                                          last_byte, l, &params));
+  assert_memory_equal(src, dst, l<<1);
+  
+  // cleanup
+  free(src);
+  free(dst);
+  free(compressed);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress blocks whose high and low bytes are coded
+ * separately (sorted by both bytes).
+ */
+void srz_split_bytes_test() {
+  unsigned short *src;
+  srz_params params;
+  int i, kind, mode, p;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  assert_non_null(src);
+  srz_default_params(&params);
+  params.context_bits = 12;
+  params.split_bytes = true;
+  
+  for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+    for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+      test_data_fill(src, (test_lengths[i] + 1) >> 1, kind, i + 11);
+      
+      for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+        for (p = 0; p < 4; p++) {
+          params.context_mode = mode;
+          params.use_previous_byte = p & 1;
+          params.sorting_byte = p >> 1;
+          
+          // when / then
+          _srz_round_trip(src, test_lengths[i], &params);
+        }
+      }
+    }
+  }
+  
+  // cleanup
+  free(src);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress blocks with word MTF.
+ */
+void srz_word_mtf_test() {
+  unsigned short *src;
+  srz_params params;
+  int i, kind, mode, streams;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  assert_non_null(src);
+  srz_default_params(&params);
+  params.context_bits = 12;
+  params.word_mtf = true;
+  
+  for (streams = 1; streams <= 4; streams += 3) {
+    params.streams = streams;
+    for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+      for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+        test_data_fill(src, (test_lengths[i] + 1) >> 1, kind, i + 11);
+        
+        for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+          params.context_mode = mode;
+          params.use_previous_byte = (mode == WS_CONTEXT_WORD);
+          
+          // when / then
+          _srz_round_trip(src, test_lengths[i], &params);
+        }
+      }
+    }
+  }
+  
+  // cleanup
+  free(src);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress blocks with every rank transform (the
+ * transform of a block is taken from its header).
+ */
+void srz_transforms_test() {
+  unsigned short *src, *dst;
+  unsigned char *compressed;
+  srz_block_header block_header;
+  srz_params params, dparams;
+  size_t l;
+  int transform, kind, mode;
+  
+  // given
+  l = 4096;
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  dst = (unsigned short *) malloc(l<<1);
+  compressed = (unsigned char *) malloc(compress_block_bound(l));
+  assert_non_null(src);
+  assert_non_null(dst);
+  assert_non_null(compressed);
+  srz_default_params(&params);
+  srz_default_params(&dparams);
+  params.context_bits = 12;
+  dparams.context_bits = 12;
+  
+  for (transform = 0; transform < MTF_TRANSFORMS; transform++) {
+    params.transform = transform;
+    for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+      test_data_fill(src, TEST_LENGTH>>1, kind, transform + 3);
+      
+      for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+        params.context_mode = mode;
+        params.split_bytes = (mode == WS_CONTEXT_HASH3);
+        
+        // when / then
+        _srz_round_trip(src, TEST_LENGTH, &params);
+      }
+    }
+    
+    // when (the decompression parameters have another transform)
+    test_data_fill(src, l, TEST_DATA_TEXT, 19);
+    params.context_mode = WS_CONTEXT_WORD;
+    params.split_bytes = false;
+    dparams.context_mode = WS_CONTEXT_WORD;
+    assert_int_equal(0, srz_compress_frame_block(src, l<<1, compressed,
+                                                 &block_header, &params));
+    
+    // then
+    assert_int_equal(transform, block_header.transform);
+    assert_true(block_header.compressed_length < (l<<1));
+    assert_int_equal(0, srz_decompress_frame_block(compressed, dst,
+                                                   &block_header, &dparams));
+    assert_memory_equal(src, dst, l<<1);
+  }
+  
+  // when (a wrong transform)
+  assert_int_equal(0, srz_compress_frame_block(src, l<<1, compressed,
+                                               &block_header, &params));
+  block_header.transform = MTF_TRANSFORMS;
+  
+  // then
+  assert_int_equal(-1, srz_decompress_frame_block(compressed, dst,
+                                                  &block_header, &dparams));
+  
+  // cleanup
+  free(src);
+  free(dst);
+  free(compressed);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the compression of incompressible data doesn't write more
+ * than compress_block_bound bytes.
+ */
+void srz_bound_test() {
+  unsigned short *src;
+  unsigned char *dst, last_byte;
+  srz_params params;
+  size_t l, cl, bound;
+  int i;
+  
+  // given
+  l = TEST_LENGTH >> 1;
+  bound = compress_block_bound(l);
+  src = (unsigned short *) malloc(l<<1);
+  dst = (unsigned char *) malloc(bound + GUARD_LENGTH);
+  assert_non_null(src);
+  assert_non_null(dst);
+  test_data_fill(src, l, TEST_DATA_RANDOM, 99);
+  memset(dst + bound, GUARD_BYTE, GUARD_LENGTH);
+  srz_default_params(&params);
+  
+  // when
+  cl = compress_block(src, dst, l, &last_byte, &params);
+  
+  // then
+  assert_int_equal(SRZ_NOT_COMPRESSED, cl);
+  for (i = 0; i < GUARD_LENGTH; i++) {
+    assert_int_equal(GUARD_BYTE, dst[bound + i]);
+  }
+  
+  // cleanup
+  free(src);
+  free(dst);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the blocks that don't save the minimum savings are not
+ * compressed, and that the other ones are compressed as usual.
+ */
+void srz_min_savings_test() {
+  unsigned short *src;
+  unsigned char *dst, *expected, last_byte;
+  srz_params params;
+  size_t l, cl, expected_cl, bound;
+  int mode, kind, savings;
+  
+  // given
+  l = 4096;
+  bound = compress_block_bound(l);
+  src = (unsigned short *) malloc(l<<1);
+  dst = (unsigned char *) malloc(bound);
+  expected = (unsigned char *) malloc(bound);
+  assert_non_null(src);
+  assert_non_null(dst);
+  assert_non_null(expected);
+  test_data_fill(src, l, TEST_DATA_TEXT, 61);
+  
+  for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+    // (kind: plain, split bytes, word MTF, chunks with 4 streams)
+    for (kind = 0; kind < 4; kind++) {
+      srz_default_params(&params);
+      params.context_mode = mode;
+      params.context_bits = 10;
+      params.split_bytes = (kind == 1);
+      params.word_mtf = (kind == 2);
+      params.chunk_size = (kind == 3) ? 2 : 0;
+      params.streams = (kind == 3) ? 4 : 1;
+      expected_cl = compress_block(src, expected, l, &last_byte, &params);
+      assert_true(expected_cl < (l<<1));
+      savings = 100 - (int) ((expected_cl * 100) / (l<<1));
+      
+      // when (the block saves more than the minimum)
+      params.min_savings = savings - 5;
+      cl = compress_block(src, dst, l, &last_byte, &params);
+      
+      // then
+      assert_int_equal(expected_cl, cl);
+      assert_memory_equal(expected, dst, cl);
+      
+      // when (the block doesn't save the minimum)
+      params.min_savings = savings + 5;
+      cl = compress_block(src, dst, l, &last_byte, &params);
+      
+      // then
+      assert_int_equal(SRZ_NOT_COMPRESSED, cl);
+      
+      // when (the block can't save the minimum whatever its ranks are)
+      params.min_savings = 95;
+      cl = compress_block(src, dst, l, &last_byte, &params);
+      
+      // then
+      assert_int_equal(SRZ_NOT_COMPRESSED, cl);
+    }
+  }
+  
+  // cleanup
+  free(src);
+  free(dst);
+  free(expected);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the decompression of corrupted data fails without reading or
+ * writing out of the buffers.
+ */
+void srz_corrupted_test() {
+  unsigned short *src, *dst, *random;
+  unsigned char *compressed, *work, last_byte;
+  srz_params params;
+  size_t l, cl, bound, result;
+  int mode, i;
+  
+  // given
+  l = 4096;
+  bound = compress_block_bound(l);
+  src = (unsigned short *) malloc(l<<1);
+  dst = (unsigned short *) malloc(l<<1);
+  random = (unsigned short *) malloc(bound);
+  compressed = (unsigned char *) malloc(bound);
+  work = (unsigned char *) malloc(bound);
+  assert_non_null(src);
+  assert_non_null(dst);
+  assert_non_null(random);
+  assert_non_null(compressed);
+  assert_non_null(work);
+  test_data_fill(src, l, TEST_DATA_TEXT, 17);
+  test_data_fill(random, bound>>1, TEST_DATA_RANDOM, 23);
+  srz_default_params(&params);
+  params.context_bits = 10;
+  
+  for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+    params.context_mode = mode;
+    cl = compress_block(src, compressed, l, &last_byte, &params);
+    assert_true(cl < (l<<1));
+    
+    // when (random data)
+    memcpy(work, random, bound);
+    result = decompress_block(work, dst, src[l - 1], last_byte, l, &params);
+    
+    // then
+    assert_true(result == (size_t) -1 || result == (l<<1));
+    
+    // when (the compressed data is truncated with zeroes)
+    memcpy(work, compressed, cl);
+    memset(work + (cl>>1), 0, bound - (cl>>1));
+    result = decompress_block(work, dst, src[l - 1], last_byte, l, &params);
+    
+    // then
+    assert_true(result == (size_t) -1 || memcmp(src, dst, l<<1) != 0);
+    
+    // when (a wrong last word)
+    for (i = 0; i < 8; i++) {
+      memcpy(work, compressed, cl);
+      decompress_block(work, dst, (unsigned short) (src[l - 1] + i * 4099),
+                       last_byte, l, &params);
+    }
+  }
+  
+  // cleanup
+  free(src);
+  free(dst);
+  free(random);
+  free(compressed);
+  free(work);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress small blocks with a trained dictionary.
+ */
+void srz_dict_test() {
+  unsigned short *sample, *src;
+  srz_dict *dict, *loaded;
+  srz_params params;
+  size_t cl, cl_dict;
+  unsigned char last_byte;
+  unsigned char *dst;
+  FILE *f;
+  int mode, p;
+  
+  // given
+  sample = (unsigned short *) malloc(TEST_LENGTH);
+  src = (unsigned short *) malloc(1024);
+  dst = (unsigned char *) malloc(compress_block_bound(512));
+  assert_non_null(sample);
+  assert_non_null(src);
+  assert_non_null(dst);
+  test_data_fill(sample, TEST_LENGTH>>1, TEST_DATA_TEXT, 31);
+  test_data_fill(src, 512, TEST_DATA_TEXT, 37);
+  
+  for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+    for (p = 0; p < 2; p++) {
+      srz_default_params(&params);
+      params.context_mode = mode;
+      params.context_bits = 10;
+      params.use_previous_byte = p;
+      
+      // when
+      dict = srz_train((unsigned char *) sample, TEST_LENGTH, &params);
+      assert_non_null(dict);
+      
+      f = tmpfile();
+      assert_non_null(f);
+      assert_int_equal(0, srz_dict_save(dict, f));
+      rewind(f);
+      loaded = srz_dict_load(f);
+      fclose(f);
+      
+      // then
+      assert_non_null(loaded);
+      assert_int_equal(dict->id, loaded->id);
+      
+      cl = compress_block(src, dst, 512, &last_byte, &params);
+      params.dict = loaded;
+      cl_dict = compress_block(src, dst, 512, &last_byte, &params);
+      assert_true(cl_dict < cl);
+      _srz_round_trip(src, 1024, &params);
+      _srz_round_trip(src, 77, &params);
+      
+      srz_dict_free(dict);
+      srz_dict_free(loaded);
+    }
+  }
+  
+  // cleanup
+  free(sample);
+  free(src);
+  free(dst);
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress consecutive linked blocks (the state of
+ * a block is kept for the next one).
+ */
+void srz_linked_test() {
+  unsigned short *src, *decompressed;
+  unsigned char *compressed, *work, last_byte;
+  srz_state *cstate, *dstate;
+  srz_params cparams, dparams;
+  size_t offset, read, l, cl, bound, total, total_linked;
+  int mode, p, linked;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  bound = compress_block_bound(512);
+  compressed = (unsigned char *) malloc(bound);
+  work = (unsigned char *) malloc(bound);
+  decompressed = (unsigned short *) malloc(1024);
+  cstate = srz_state_alloc();
+  dstate = srz_state_alloc();
+  assert_non_null(src);
+  assert_non_null(compressed);
+  assert_non_null(work);
+  assert_non_null(decompressed);
+  assert_non_null(cstate);
+  assert_non_null(dstate);
+  test_data_fill(src, (TEST_LENGTH>>1) + 1, TEST_DATA_TEXT, 41);
+  
+  for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+    // (p: previous byte and word MTF flags)
+    for (p = 0; p < 4; p++) {
+      total = 0;
+      total_linked = 0;
+      for (linked = 0; linked < 2; linked++) {
+        srz_default_params(&cparams);
+        cparams.context_mode = mode;
+        cparams.context_bits = 10;
+        cparams.use_previous_byte = p & 1;
+        cparams.word_mtf = p >> 1;
+        dparams = cparams;
+        if (linked) {
+          srz_state_reset(cstate);
+          srz_state_reset(dstate);
+          cparams.state = cstate;
+          dparams.state = dstate;
+        }
+        
+        // when (the last block has an odd length)
+        for (offset = 0; offset < 16*1024 + 333; offset += read) {
+          read = 16*1024 + 333 - offset;
+          if (read > 1024) {
+            read = 1024;
+          }
+          if ((read & 1) == 1) {
+            ((unsigned char *) src)[offset + read] = 0;
+          }
+          l = (read + 1) >> 1;
+          
+          cl = compress_block(src + (offset>>1), compressed, l, &last_byte,
+                              &cparams);
+          
+          // then
+          assert_true(cl != (size_t) -1);
+          if (cl == SRZ_NOT_COMPRESSED) {
+            srz_state_reset(cstate);
+            srz_state_reset(dstate);
+            cl = read;
+          }
+          else {
+            assert_true(cl < read);
+            memcpy(work, compressed, cl);
+            assert_int_equal(l<<1, decompress_block(work, decompressed,
+                                                    src[(offset>>1) + l - 1],
+                                                    last_byte, l, &dparams));
+            assert_memory_equal(src + (offset>>1), decompressed, read);
+          }
+          
+          if (linked) {
+            total_linked += cl;
+          }
+          else {
+            total += cl;
+          }
+        }
+      }
+      
+      assert_true(total_linked < total);
+    }
+  }
+  
+  // cleanup
+  srz_state_free(cstate);
+  srz_state_free(dstate);
+  free(src);
+  free(compressed);
+  free(work);
+  free(decompressed);
+}
+
+/* ======================================================================== */
+/**
+ * Output of the stream test (the sink appends the pieces).
+ */
+typedef struct {
+  unsigned char *data;
+  size_t length;
+  size_t pieces;
+  size_t max_pieces;
+} test_output;
+
+/* ======================================================================== */
+/**
+ * Appends a piece of a block to the test output.
+ * @param data The piece of data.
+ * @param length The number of bytes of the piece.
+ * @param opaque The test output.
+ * @return 0 (or -1 after max_pieces pieces).
+ */
+static int _srz_test_sink(const void *data, size_t length, void *opaque) {
+  test_output *output = (test_output *) opaque;
+  
+  if (output->pieces == output->max_pieces) {
+    return -1;
+  }
+  memcpy(output->data + output->length, data, length);
+  output->length += length;
+  output->pieces++;
+  return 0;
+}
+
+/* ======================================================================== */
+/**
+ * Test to decompress linked blocks through a sink with a small output
+ * buffer (the pieces must be the same data as the whole block).
+ */
+void srz_stream_test() {
+  unsigned short *src, *buffer;
+  unsigned char *compressed;
+  srz_block_header block_header;
+  srz_state *cstate, *dstate;
+  srz_params cparams, dparams;
+  test_output output;
+  size_t offset, read;
+  int mode, p, kind;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH + 2);
+  compressed = (unsigned char *) malloc(compress_block_bound(4096));
+  buffer = (unsigned short *) malloc(100 * sizeof(unsigned short));
+  output.data = (unsigned char *) malloc(TEST_LENGTH);
+  cstate = srz_state_alloc();
+  dstate = srz_state_alloc();
+  assert_non_null(src);
+  assert_non_null(compressed);
+  assert_non_null(buffer);
+  assert_non_null(output.data);
+  assert_non_null(cstate);
+  assert_non_null(dstate);
+  
+  for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+    test_data_fill(src, (TEST_LENGTH>>1) + 1, kind, 47);
+    for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+      for (p = 0; p < 2; p++) {
+        srz_default_params(&cparams);
+        cparams.context_mode = mode;
+        cparams.context_bits = 10;
+        cparams.use_previous_byte = p;
+        dparams = cparams;
+        srz_state_reset(cstate);
+        srz_state_reset(dstate);
+        cparams.state = cstate;
+        dparams.state = dstate;
+        output.length = 0;
+        output.pieces = 0;
+        output.max_pieces = (size_t) -1;
+        
+        // when (linked blocks, the last one has an odd length)
+        for (offset = 0; offset < 20*1024 + 333; offset += read) {
+          read = 20*1024 + 333 - offset;
+          if (read > 8192) {
+            read = 8192;
+          }
+          assert_int_equal(0, srz_compress_frame_block(src + (offset>>1),
+                                                       read, compressed,
+                                                       &block_header,
+                                                       &cparams));
+          assert_int_equal(0, srz_decompress_frame_block_stream(
+                              compressed, buffer, 100, &block_header,
+                              &dparams, _srz_test_sink, &output));
+        }
+        
+        // then
+        assert_int_equal(20*1024 + 333, output.length);
+        assert_memory_equal(src, output.data, output.length);
+      }
+    }
+  }
+  
+  // when (the sink stops the decompression)
+  test_data_fill(src, 4096, TEST_DATA_TEXT, 53);
+  srz_default_params(&cparams);
+  assert_int_equal(0, srz_compress_frame_block(src, 8192, compressed,
+                                               &block_header, &cparams));
+  assert_true(block_header.compressed_length < 8192);
+  output.length = 0;
+  output.pieces = 0;
+  output.max_pieces = 3;
+  
+  // then
+  assert_int_equal(-1, srz_decompress_frame_block_stream(compressed, buffer,
+                                                         100, &block_header,
+                                                         &cparams,
+                                                         _srz_test_sink,
+                                                         &output));
+  assert_int_equal(3, output.pieces);
+  
+  // when (a wrong checksum)
+  assert_int_equal(0, srz_compress_frame_block(src, 8192, compressed,
+                                               &block_header, &cparams));
+  block_header.checksum ^= 1;
+  output.length = 0;
+  output.pieces = 0;
+  output.max_pieces = (size_t) -1;
+  
+  // then (the data is given before the checksum is checked)
+  assert_int_equal(-1, srz_decompress_frame_block_stream(compressed, buffer,
+                                                         100, &block_header,
+                                                         &cparams,
+                                                         _srz_test_sink,
+                                                         &output));
+  assert_int_equal(8192, output.length);
+  assert_int_equal((4096 + 99) / 100, output.pieces);
+  
+  // cleanup
+  srz_state_free(cstate);
+  srz_state_free(dstate);
+  free(src);
+  free(compressed);
+  free(buffer);
+  free(output.data);
+}
+
+/* ======================================================================== */
+/**
+ * Test to get the size of the decompressed data from a file header.
+ */
+void srz_decompressed_size_test() {
+  srz_header header;
+  unsigned long long size;
+  
+  // given
+  memset(&header, 0, sizeof(header));
+  header.magic_number[0] = 'S';
+  header.magic_number[1] = 'R';
+  header.version = SRZ_VERSION;
+  header.content_size = 123456789012ULL;
+  
+  // when / then
+  size = 0;
+  assert_int_equal(0, srz_get_decompressed_size(&header, sizeof(header),
+                                                &size));
+  assert_true(size == 123456789012ULL);
+  
+  header.content_size = SRZ_UNKNOWN_SIZE;
+  assert_int_equal(0, srz_get_decompressed_size(&header, sizeof(header),
+                                                &size));
+  assert_true(size == SRZ_UNKNOWN_SIZE);
+  
+  // (The header is truncated or it isn't a header)
+  assert_int_equal(-1, srz_get_decompressed_size(&header, sizeof(header) - 1,
+                                                 &size));
+  header.magic_number[1] = 'Z';
+  assert_int_equal(-1, srz_get_decompressed_size(&header, sizeof(header),
+                                                 &size));
+}
+
+/* ======================================================================== */
+/**
+ * Test to compress and decompress buffers with the one-shot functions
+ * (with and without work buffers, and with unaligned buffers).
+ */
+void srz_buffer_test() {
+  unsigned char *src, *compressed, *decompressed;
+  unsigned long long size;
+  srz_context *context;
+  srz_params params;
+  size_t length, bound, cl;
+  int i, c, kind;
+  
+  // given
+  length = 3*TEST_LENGTH + 5;
+  bound = srz_compress_bound(length);
+  src = (unsigned char *) malloc(length + 2);
+  compressed = (unsigned char *) malloc(bound + 1);
+  decompressed = (unsigned char *) malloc(length + 2);
+  context = srz_context_alloc(64*1024);
+  assert_non_null(src);
+  assert_non_null(compressed);
+  assert_non_null(decompressed);
+  assert_non_null(context);
+  
+  for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+    test_data_fill((unsigned short *) src, (length + 2) >> 1, kind, 43);
+    
+    for (c = 0; c < 2; c++) {
+      for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+        srz_default_params(&params);
+        params.use_previous_byte = true;
+        params.context = c ? context : NULL;
+        
+        // when (the source and destination buffers are unaligned)
+        cl = srz_compress_buffer(src + 1, test_lengths[i], compressed + 1,
+                                 srz_compress_bound(test_lengths[i]), 64,
+                                 &params);
+        
+        // then
+        assert_true(cl != (size_t) -1);
+        assert_true(cl <= srz_compress_bound(test_lengths[i]));
+        assert_int_equal(0, srz_get_decompressed_size(compressed + 1, cl,
+                                                      &size));
+        assert_true(size == test_lengths[i]);
+        assert_int_equal(test_lengths[i],
+                         srz_decompress_buffer(compressed + 1, cl,
+                                               decompressed + 1,
+                                               test_lengths[i], &params));
+        assert_memory_equal(src + 1, decompressed + 1, test_lengths[i]);
+      }
+      
+      // Several blocks (the last one is odd)
+      cl = srz_compress_buffer(src, length, compressed, bound, 64, &params);
+      assert_true(cl != (size_t) -1);
+      assert_int_equal(length, srz_decompress_buffer(compressed, cl,
+                                                     decompressed, length,
+                                                     &params));
+      assert_memory_equal(src, decompressed, length);
+      
+      // The destination buffers are too small
+      assert_true(srz_decompress_buffer(compressed, cl, decompressed,
+                                        length - 1, &params) == (size_t) -1);
+      assert_true(srz_decompress_buffer(compressed, cl - 1, decompressed,
+                                        length, &params) == (size_t) -1);
+      assert_true(srz_compress_buffer(src, length, compressed, cl - 1, 64,
+                                      &params) == (size_t) -1);
+    }
+  }
+  
+  // when (a wrong number of groups in the header of a word mode file)
+  srz_default_params(&params);
+  cl = srz_compress_buffer(src, length, compressed, bound, 64, &params);
+  assert_true(cl != (size_t) -1);
+  ((srz_header *) compressed)->context_bits = 70;
+  
+  // then
+  assert_true(srz_decompress_buffer(compressed, cl, decompressed, length,
+                                    &params) == (size_t) -1);
+  
+  // cleanup
+  srz_context_free(context);
+  free(src);
+  free(compressed);
+  free(decompressed);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the compression of a list of fragments is the same as the
+ * compression of an array.
+ */
+void srz_iov_test() {
+  unsigned char *src, *compressed, *compressed_iov, *decompressed;
+  unsigned char last_byte, last_byte_iov;
+  unsigned short last_word;
+  struct iovec iov[5];
+  srz_params params;
+  size_t length, bound, cl;
+  
+  // given (fragments of odd and empty lengths)
+  length = 3*1024 + 11;
+  bound = srz_compress_bound(length);
+  src = (unsigned char *) malloc(length + 1);
+  compressed = (unsigned char *) malloc(bound);
+  compressed_iov = (unsigned char *) malloc(bound);
+  decompressed = (unsigned char *) malloc(length);
+  assert_non_null(src);
+  assert_non_null(compressed);
+  assert_non_null(compressed_iov);
+  assert_non_null(decompressed);
+  test_data_fill((unsigned short *) src, (length + 1) >> 1, TEST_DATA_TEXT,
+                 47);
+  src[length] = 0;
+  iov[0].iov_base = src;
+  iov[0].iov_len = 1;
+  iov[1].iov_base = src + 1;
+  iov[1].iov_len = 1500;
+  iov[2].iov_base = src + 1501;
+  iov[2].iov_len = 0;
+  iov[3].iov_base = src + 1501;
+  iov[3].iov_len = 1023;
+  iov[4].iov_base = src + 2524;
+  iov[4].iov_len = length - 2524;
+  srz_default_params(&params);
+  params.use_previous_byte = true;
+  
+  // when (a block in the middle of a fragment)
+  cl = compress_block((unsigned short *) (src + 2), compressed, 1024,
+                      &last_byte, &params);
+  
+  // then
+  assert_int_equal(cl, compress_block_iov(iov, 5, 2, compressed_iov, 1024,
+                                          &last_word, &last_byte_iov,
+                                          &params));
+  assert_memory_equal(compressed, compressed_iov, cl);
+  assert_int_equal(last_byte, last_byte_iov);
+  assert_int_equal(((unsigned short *) src)[1024], last_word);
+  
+  // when (blocks of 1K and an odd length)
+  cl = srz_compress_iov(iov, 5, compressed_iov, bound, 1, &params);
+  
+  // then
+  assert_true(cl != (size_t) -1);
+  assert_int_equal(length, srz_decompress_buffer(compressed_iov, cl,
+                                                 decompressed, length,
+                                                 &params));
+  assert_memory_equal(src, decompressed, length);
+  
+  // cleanup
+  free(src);
+  free(compressed);
+  free(compressed_iov);
+  free(decompressed);
+}
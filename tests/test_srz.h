@@ -0,0 +1,107 @@
+/* Block compression tests definition.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef TEST_SRZ_H
+#define TEST_SRZ_H
+
+
+#include "srz.h"
+
+/**
+ * Test to compress and decompress blocks with every context mode.
+ */
+void srz_round_trip_test();
+
+/**
+ * Test to compress and decompress blocks with interleaved streams.
+ */
+void srz_streams_test();
+
+/**
+ * Test to compress and decompress blocks whose symbols are coded in
+ * independent chunks.
+ */
+void srz_chunks_test();
+
+/**
+ * Test to compress and decompress blocks whose high and low bytes are coded
+ * separately (sorted by both bytes).
+ */
+void srz_split_bytes_test();
+
+/**
+ * Test to compress and decompress blocks with word MTF.
+ */
+void srz_word_mtf_test();
+
+/**
+ * Test to compress and decompress blocks with every rank transform (the
+ * transform of a block is taken from its header).
+ */
+void srz_transforms_test();
+
+/**
+ * Test that the compression of incompressible data doesn't write more
+ * than compress_block_bound bytes.
+ */
+void srz_bound_test();
+
+/**
+ * Test that the blocks that don't save the minimum savings are not
+ * compressed, and that the other ones are compressed as usual.
+ */
+void srz_min_savings_test();
+
+/**
+ * Test that the decompression of corrupted data fails without reading or
+ * writing out of the buffers.
+ */
+void srz_corrupted_test();
+
+/**
+ * Test to compress and decompress small blocks with a trained dictionary.
+ */
+void srz_dict_test();
+
+/**
+ * Test to compress and decompress consecutive linked blocks (the state of
+ * a block is kept for the next one).
+ */
+void srz_linked_test();
+
+/**
+ * Test to decompress linked blocks through a sink with a small output
+ * buffer (the pieces must be the same data as the whole block).
+ */
+void srz_stream_test();
+
+/**
+ * Test to get the size of the decompressed data from a file header.
+ */
+void srz_decompressed_size_test();
+
+/**
+ * Test to compress and decompress buffers with the one-shot functions
+ * (with and without work buffers, and with unaligned buffers).
+ */
+void srz_buffer_test();
+
+/**
+ * Test that the compression of a list of fragments is the same as the
+ * compression of an array.
+ */
+void srz_iov_test();
+
+#endif
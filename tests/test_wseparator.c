@@ -0,0 +1,339 @@
+/* Word separation tests implementation.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "test_wseparator.h"
+#include "test_data.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#define TEST_LENGTH 65536
+
+/* Block lengths (in words) of the round trip tests */
+static const int test_lengths[] = { 1, 2, 3, 1000, 65536 };
+
+/* ======================================================================== */
+/**
+ * Test the allocation of word separator contexts.
+ */
+void ws_alloc_test() {
+  ws_context *ctx;
+  
+  // when
+  ctx = ws_alloc(WS_CONTEXT_BYTE, 0);
+  
+  // then
+  assert_non_null(ctx);
+  assert_int_equal(256, ctx->groups);
+  assert_false(ws_stores_counts(ctx->mode));
+  ws_free(ctx);
+  
+  ctx = ws_alloc(WS_CONTEXT_HASH3, 12);
+  assert_non_null(ctx);
+  assert_int_equal(4096, ctx->groups);
+  assert_true(ws_stores_counts(ctx->mode));
+  ws_free(ctx);
+  
+  assert_null(ws_alloc(WS_CONTEXT_HASH4, WS_HASH_MAX_BITS + 1));
+  assert_null(ws_alloc(WS_CONTEXT_HASH4, WS_HASH_MIN_BITS - 1));
+  assert_null(ws_alloc(-1, WS_HASH_DEFAULT_BITS));
+}
+
+/* ======================================================================== */
+/**
+ * Separates and joins a block of words.
+ * @param src The block of words.
+ * @param length The number of words.
+ * @param mode The context mode.
+ * @param use_previous_byte Use the median value of the previous byte.
+ */
+static void _ws_round_trip(unsigned short *src, int length, int mode,
+                           bool use_previous_byte) {
+  unsigned short *separated, *joined;
+  ws_context *ctx, *ctx2;
+  
+  separated = (unsigned short *) malloc(length<<1);
+  joined = (unsigned short *) malloc(length<<1);
+  ctx = ws_alloc(mode, 10);
+  ctx2 = ws_alloc(mode, 10);
+  assert_non_null(separated);
+  assert_non_null(joined);
+  assert_non_null(ctx);
+  assert_non_null(ctx2);
+  
+  separate_words(src, separated, length, use_previous_byte, ctx);
+  
+  // (A new context only gets the group sizes, as in decompress_block)
+  if (ws_stores_counts(mode)) {
+    memcpy(ctx2->count, ctx->count, ctx->groups * sizeof(int));
+  }
+  join_words(separated, joined, src[length - 1], length, use_previous_byte,
+             ctx2);
+  
+  assert_memory_equal(src, joined, length<<1);
+  
+  free(separated);
+  free(joined);
+  ws_free(ctx);
+  ws_free(ctx2);
+}
+
+/* ======================================================================== */
+/**
+ * Test to separate and join words with every context mode.
+ */
+void ws_round_trip_test() {
+  unsigned short *src;
+  int i, kind, mode, p;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH<<1);
+  assert_non_null(src);
+  
+  for (i = 0; i < sizeof(test_lengths) / sizeof(int); i++) {
+    for (kind = 0; kind < TEST_DATA_KINDS; kind++) {
+      test_data_fill(src, test_lengths[i], kind, i + 1);
+      
+      for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+        for (p = 0; p < 2; p++) {
+          // when / then
+          _ws_round_trip(src, test_lengths[i], mode, p);
+        }
+      }
+    }
+  }
+  
+  // cleanup
+  free(src);
+}
+
+/* ======================================================================== */
+/** 
+ * Compares two sorting keys (for qsort).
+ * @param a First key.
+ * @param b Second key.
+ * @return The comparison result.
+ */
+static int _compare_keys(const void *a, const void *b) {
+  unsigned int ka = *(const unsigned int *) a;
+  unsigned int kb = *(const unsigned int *) b;
+  
+  return (ka > kb) - (ka < kb);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the separated words match a reference (stable) grouping.
+ */
+void ws_reference_test() {
+  unsigned short *src, *separated, *expected;
+  unsigned int *keys;
+  ws_context *ctx;
+  int i, mode, previous;
+  
+  // given
+  src = (unsigned short *) malloc(TEST_LENGTH<<1);
+  separated = (unsigned short *) malloc(TEST_LENGTH<<1);
+  expected = (unsigned short *) malloc(TEST_LENGTH<<1);
+  assert_non_null(src);
+  assert_non_null(separated);
+  keys = (unsigned int *) malloc(TEST_LENGTH * sizeof(unsigned int));
+  assert_non_null(expected);
+  assert_non_null(keys);
+  test_data_fill(src, TEST_LENGTH, TEST_DATA_TEXT, 5);
+  
+  for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_WORD; mode++) {
+    // Every group keeps the order of the words (the first word is in the
+    // context of zeroes)
+    for (i = 0; i < TEST_LENGTH; i++) {
+      previous = (i == 0) ? 0 : src[i - 1];
+      keys[i] = ((mode == WS_CONTEXT_BYTE) ? (previous >> 8) : previous);
+      keys[i] = (keys[i] << 16) | i;
+    }
+    qsort(keys, TEST_LENGTH, sizeof(unsigned int), _compare_keys);
+    for (i = 0; i < TEST_LENGTH; i++) {
+      expected[i] = src[keys[i] & 0xFFFF];
+    }
+    
+    // when
+    ctx = ws_alloc(mode, 0);
+    assert_non_null(ctx);
+    separate_words(src, separated, TEST_LENGTH, false, ctx);
+    
+    // then
+    assert_memory_equal(expected, separated, TEST_LENGTH<<1);
+    ws_free(ctx);
+  }
+  
+  // cleanup
+  free(src);
+  free(separated);
+  free(expected);
+  free(keys);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the words separated from a list of fragments (of odd and empty
+ * lengths) are the same as the words separated from an array.
+ */
+void ws_iov_test() {
+  unsigned short *src, *separated, *expected, last[2];
+  struct iovec iov[64];
+  ws_context *ctx, *ctx2;
+  size_t length, offset, n;
+  int iovcnt, mode, p;
+  
+  // given (the data has an odd length, the last byte is padded)
+  length = (TEST_LENGTH<<1) - 1;
+  src = (unsigned short *) malloc(TEST_LENGTH<<1);
+  separated = (unsigned short *) malloc(TEST_LENGTH<<1);
+  expected = (unsigned short *) malloc(TEST_LENGTH<<1);
+  assert_non_null(src);
+  assert_non_null(separated);
+  assert_non_null(expected);
+  test_data_fill(src, TEST_LENGTH, TEST_DATA_TEXT, 7);
+  ((unsigned char *) src)[length] = 0;
+  
+  srand(11);
+  for (iovcnt = 0, offset = 0; offset < length; iovcnt++) {
+    n = (iovcnt == 63) ? length - offset : (size_t) (rand() % 4096);
+    if (n > length - offset) {
+      n = length - offset;
+    }
+    iov[iovcnt].iov_base = (unsigned char *) src + offset;
+    iov[iovcnt].iov_len = n;
+    offset += n;
+  }
+  
+  for (mode = WS_CONTEXT_BYTE; mode <= WS_CONTEXT_HASH4; mode++) {
+    for (p = 0; p < 2; p++) {
+      // when (the first word is in the middle of a fragment)
+      ctx = ws_alloc(mode, 10);
+      ctx2 = ws_alloc(mode, 10);
+      assert_non_null(ctx);
+      assert_non_null(ctx2);
+      separate_words(src + 3, expected, TEST_LENGTH - 3, p, ctx);
+      separate_words_iov(iov, iovcnt, 6, separated, TEST_LENGTH - 3, p, ctx2,
+                         last);
+      
+      // then
+      assert_memory_equal(expected, separated, (TEST_LENGTH - 3)<<1);
+      assert_memory_equal(ctx->count, ctx2->count, ctx->groups * sizeof(int));
+      assert_int_equal(src[TEST_LENGTH - 1], last[0]);
+      assert_int_equal(src[TEST_LENGTH - 2], last[1]);
+      ws_free(ctx);
+      ws_free(ctx2);
+    }
+  }
+  
+  // cleanup
+  free(src);
+  free(separated);
+  free(expected);
+}
+
+/* ======================================================================== */
+/**
+ * Test that the medians are kept when the buckets change from 16-bit to
+ * 32-bit offsets (and back) with the block length.
+ */
+void ws_layout_test() {
+  static const int lengths[] = { TEST_LENGTH, 2, WS_NARROW_LENGTH + 1, 1000 };
+  unsigned short *src, *separated;
+  unsigned char *median, *expected;
+  ws_context *ctx;
+  int g, i;
+  
+  // given
+  src = (unsigned short *) malloc((WS_NARROW_LENGTH + 1)<<1);
+  separated = (unsigned short *) malloc((WS_NARROW_LENGTH + 1)<<1);
+  ctx = ws_alloc(WS_CONTEXT_WORD, 0);
+  assert_non_null(src);
+  assert_non_null(separated);
+  assert_non_null(ctx);
+  median = (unsigned char *) malloc(ctx->groups);
+  expected = (unsigned char *) malloc(ctx->groups);
+  assert_non_null(median);
+  assert_non_null(expected);
+  test_data_fill(src, WS_NARROW_LENGTH + 1, TEST_DATA_TEXT, 13);
+  for (g = 0; g < ctx->groups; g++) {
+    expected[g] = (unsigned char) (g * 7);
+  }
+  ws_prime(ctx, expected, ctx->groups, 0, 0);
+  
+  for (i = 0; i < sizeof(lengths) / sizeof(int); i++) {
+    // when (the medians are not updated without the previous byte)
+    separate_words(src, separated, lengths[i], false, ctx);
+    ws_get_median(ctx, median);
+    
+    // then
+    assert_int_equal(lengths[i] <= WS_NARROW_LENGTH, ctx->narrow);
+    assert_memory_equal(expected, median, ctx->groups);
+  }
+  
+  // cleanup
+  free(src);
+  free(separated);
+  free(median);
+  free(expected);
+  ws_free(ctx);
+}
+
+/* ======================================================================== */
+/**
+ * Test to join a block of 65536 words in one group (its size doesn't fit
+ * in the 16-bit offsets).
+ */
+void ws_single_group_test() {
+  unsigned short *src, *separated, *joined;
+  ws_context *ctx, *ctx2;
+  int p;
+  
+  // given (every word follows a zero)
+  src = (unsigned short *) calloc(WS_NARROW_LENGTH, sizeof(unsigned short));
+  separated = (unsigned short *) malloc(WS_NARROW_LENGTH<<1);
+  joined = (unsigned short *) malloc(WS_NARROW_LENGTH<<1);
+  assert_non_null(src);
+  assert_non_null(separated);
+  assert_non_null(joined);
+  
+  for (p = 0; p < 2; p++) {
+    ctx = ws_alloc(WS_CONTEXT_WORD, 0);
+    ctx2 = ws_alloc(WS_CONTEXT_WORD, 0);
+    assert_non_null(ctx);
+    assert_non_null(ctx2);
+    separate_words(src, separated, WS_NARROW_LENGTH, p, ctx);
+    
+    // when
+    assert_int_equal(0, join_words(separated, joined, 0, WS_NARROW_LENGTH,
+                                   p, ctx2));
+    
+    // then
+    assert_false(ctx2->narrow);
+    assert_memory_equal(src, joined, WS_NARROW_LENGTH<<1);
+    ws_free(ctx);
+    ws_free(ctx2);
+  }
+  
+  // cleanup
+  free(src);
+  free(separated);
+  free(joined);
+}
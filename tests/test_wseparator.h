@@ -0,0 +1,55 @@
+/* Word separation tests definition.
+
+   Copyright (C) 2022 Abraham Macias Paredes.
+   
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#ifndef TEST_WSEPARATOR_H
+#define TEST_WSEPARATOR_H
+
+
+#include "wseparator.h"
+
+/**
+ * Test the allocation of word separator contexts.
+ */
+void ws_alloc_test();
+
+/**
+ * Test to separate and join words with every context mode.
+ */
+void ws_round_trip_test();
+
+/**
+ * Test that the separated words match a reference (stable) grouping.
+ */
+void ws_reference_test();
+
+/**
+ * Test that the words separated from a list of fragments (of odd and empty
+ * lengths) are the same as the words separated from an array.
+ */
+void ws_iov_test();
+
+/**
+ * Test that the medians are kept when the buckets change from 16-bit to
+ * 32-bit offsets (and back) with the block length.
+ */
+void ws_layout_test();
+
+/**
+ * Test to join a block of 65536 words in one group (its size doesn't fit
+ * in the 16-bit offsets).
+ */
+void ws_single_group_test();
+
+#endif
@@ -21,6 +21,10 @@
 #include <cmocka.h>
 
 #include "test_bitm.h"
+#include "test_mtf.h"
+#include "test_split2b.h"
+#include "test_wseparator.h"
+#include "test_srz.h"
 
 
 /* ======================================================================== */
@@ -41,8 +45,42 @@ int main(void) {
     cmocka_unit_test(read_eg_test),
     cmocka_unit_test(write_eg_test),
     cmocka_unit_test(reset_test),
+    cmocka_unit_test(is_full_test),
+    cmocka_unit_test(reader_eg_test),
     cmocka_unit_test(unsigned_char_unary_test),
     cmocka_unit_test(unsigned_char_eg_test),
+    cmocka_unit_test(read_end_test),
+    cmocka_unit_test(mtf_round_trip_test),
+    cmocka_unit_test(mtf_reference_test),
+    cmocka_unit_test(mtf_same_byte_test),
+    cmocka_unit_test(mtf_split_test),
+    cmocka_unit_test(mtf_transforms_test),
+    cmocka_unit_test(mtf1_ranks_test),
+    cmocka_unit_test(mtf16_round_trip_test),
+    cmocka_unit_test(split2b_round_trip_test),
+    cmocka_unit_test(split2b_inplace_test),
+    cmocka_unit_test(split2b_order_test),
+    cmocka_unit_test(ws_alloc_test),
+    cmocka_unit_test(ws_round_trip_test),
+    cmocka_unit_test(ws_reference_test),
+    cmocka_unit_test(ws_iov_test),
+    cmocka_unit_test(ws_layout_test),
+    cmocka_unit_test(ws_single_group_test),
+    cmocka_unit_test(srz_round_trip_test),
+    cmocka_unit_test(srz_streams_test),
+    cmocka_unit_test(srz_chunks_test),
+    cmocka_unit_test(srz_split_bytes_test),
+    cmocka_unit_test(srz_word_mtf_test),
+    cmocka_unit_test(srz_transforms_test),
+    cmocka_unit_test(srz_bound_test),
+    cmocka_unit_test(srz_min_savings_test),
+    cmocka_unit_test(srz_corrupted_test),
+    cmocka_unit_test(srz_dict_test),
+    cmocka_unit_test(srz_linked_test),
+    cmocka_unit_test(srz_stream_test),
+    cmocka_unit_test(srz_decompressed_size_test),
+    cmocka_unit_test(srz_buffer_test),
+    cmocka_unit_test(srz_iov_test),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }